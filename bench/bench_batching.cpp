@@ -0,0 +1,307 @@
+// texture batching (texture/texture_packer.h) against a texture per object:
+// quads showing 64 procedural images of different sizes, some repeating in size
+// so they become layers of an array and the rest packed into atlas pages. drawn
+// once with a glBindTexture, a model uniform and a glDrawArrays per object
+// (shader.vert / shader.frag), then with BuildBatches and one instanced draw per
+// array texture (batched.vert / batched.frag). a grid of magnified quads is drawn
+// both ways into an offscreen target first and compared, so a wrong layer or uv
+// rectangle shows up as a mismatch rather than a fast time. gpu times come from
+// timer queries. run it from the repository root.
+//
+// usage: bench_batching [iterations] [objects]
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "geometry/mvp_instances.h"
+#include "shader/shader.h"
+#include "texture/texture_packer.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const int TARGET_SIZE = 256;
+static const int IMAGE_COUNT = 64;
+
+// the fastest of iterations runs of draw in gpu milliseconds, cpu is the submit
+// time of that run
+template <typename F>
+static double gpuMilliseconds(int iterations, double &cpu, F &&draw) {
+    unsigned int query;
+    glGenQueries(1, &query);
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        auto start = std::chrono::steady_clock::now();
+        draw();
+        double submit = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        if (nanoseconds / 1e6 < best) {
+            best = nanoseconds / 1e6;
+            cpu = submit;
+        }
+    }
+    glDeleteQueries(1, &query);
+    return best;
+}
+
+// draws once into the cleared target and reads it back
+template <typename F>
+static std::vector<unsigned char> drawPixels(F &&draw) {
+    glClear(GL_COLOR_BUFFER_BIT);
+    draw();
+    std::vector<unsigned char> pixels((size_t)TARGET_SIZE * TARGET_SIZE * 4);
+    glReadPixels(0, 0, TARGET_SIZE, TARGET_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    return pixels;
+}
+
+// pixels off by more than a few steps in a channel. the uvs reach the sampler
+// through a different sum in each shader, so an edge texel may blend a little
+static int differingPixels(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b) {
+    int differing = 0;
+    for (size_t i = 0; i < a.size(); i += 4) {
+        for (int c = 0; c < 4; c++) {
+            if (std::abs((int)a[i + c] - (int)b[i + c]) > 8) {
+                differing++;
+                break;
+            }
+        }
+    }
+    return differing;
+}
+
+// a blocky pattern of random colours, so a shifted uv or a wrong layer shows
+static std::vector<unsigned char> makeImage(int width, int height, int channels, uint32_t seed) {
+    std::vector<unsigned char> pixels((size_t)width * height * channels);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t h = seed * 2654435761u ^ (uint32_t)(x / 2) * 40503u ^ (uint32_t)(y / 2) * 9973u;
+            h ^= h >> 13;
+            h *= 0x5bd1e995u;
+            h ^= h >> 15;
+            for (int c = 0; c < channels; c++) {
+                pixels[((size_t)y * width + x) * channels + c] = c == 3 ? 255 : (unsigned char)(h >> (c * 8));
+            }
+        }
+    }
+    return pixels;
+}
+
+// objects on a square grid filling the view, instance i shows image i % IMAGE_COUNT
+static std::vector<glm::mat4> gridModels(int count) {
+    int side = 1;
+    while (side * side < count) {
+        side++;
+    }
+    std::vector<glm::mat4> models;
+    float cell = 2.0f / side;
+    for (int i = 0; i < count; i++) {
+        glm::vec3 center(-1.0f + cell * ((float)(i % side) + 0.5f), -1.0f + cell * ((float)(i / side) + 0.5f), 0.0f);
+        models.push_back(glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(cell * 0.9f)));
+    }
+    return models;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+    int objects = argc > 2 ? std::max(1, atoi(argv[2])) : 20000;
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(128, 128, "bench_batching", NULL, NULL);
+    if (window == NULL) {
+        printf("failed to create a GL context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        printf("failed to load GL\n");
+        glfwTerminate();
+        return 1;
+    }
+    printf("%s\n", (const char *)glGetString(GL_RENDERER));
+
+    // a hidden window's pixels may not be owned, so everything goes to a target of its own
+    unsigned int framebuffer, colorBuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, TARGET_SIZE, TARGET_SIZE);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+    glDisable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // 48 images of sizes no other image has, so packed into the atlas, and
+    // 16 of 16 x 16 that become the layers of an array. odd ones are rgb
+    std::vector<std::vector<unsigned char>> images;
+    std::vector<glm::ivec3> sizes;
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        int width = i < 48 ? 8 + i % 8 * 3 : 16;
+        int height = i < 48 ? 8 + i / 8 * 3 : 16;
+        int channels = i % 2 ? 3 : 4;
+        images.push_back(makeImage(width, height, channels, (uint32_t)i + 1));
+        sizes.push_back(glm::ivec3(width, height, channels));
+    }
+
+    TexturePacker packer;
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        packer.Add(images[i].data(), sizes[i].x, sizes[i].y, sizes[i].z);
+    }
+    std::vector<int> unpacked(1, 0);
+    bool emptyBeforePack = packer.BuildBatches(unpacked).empty();
+    packer.Pack();
+    packer.Upload();
+
+    // the same images as textures of their own, wrapping like the array they went to
+    std::vector<unsigned int> textures(IMAGE_COUNT);
+    glGenTextures(IMAGE_COUNT, textures.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        const TextureSlot &slot = packer.Slot(i);
+        GLint wrap = slot.uvRect == glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, sizes[i].x, sizes[i].y, 0, sizes[i].z == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE,
+                     images[i].data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    int atlased = 0;
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        atlased += packer.Slot(i).uvRect != glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    }
+    printf("\n%d images in %d array textures, %d of them in atlas pages\n", IMAGE_COUNT, packer.ArrayCount(), atlased);
+
+    // a quad, position and uv like shader.vert
+    float quad[] = {
+        -0.5f, -0.5f, 0.0f, 0.0f, 0.0f,   0.5f, -0.5f, 0.0f, 1.0f, 0.0f,   0.5f, 0.5f, 0.0f, 1.0f, 1.0f,
+        -0.5f, -0.5f, 0.0f, 0.0f, 0.0f,   0.5f, 0.5f, 0.0f, 1.0f, 1.0f,   -0.5f, 0.5f, 0.0f, 0.0f, 1.0f,
+    };
+    // one vao for each shader, the batched one also has the per instance attributes
+    unsigned int vaos[2], quadBuffer, textureBuffer, modelBuffer;
+    glGenVertexArrays(2, vaos);
+    glGenBuffers(1, &quadBuffer);
+    glGenBuffers(1, &textureBuffer);
+    glGenBuffers(1, &modelBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    for (unsigned int vao : vaos) {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+    }
+    setupInstanceTextureAttributes(textureBuffer, 2);
+    setupMat4InstanceAttribute(modelBuffer, 4);
+
+    glm::mat4 viewProjection(1.0f);
+    Shader single("include/shader/shader.vert", "include/shader/shader.frag");
+    single.use();
+    single.setMat4("viewProjection", viewProjection);
+    single.setInt("texture1", 0);
+    single.setInt("texture2", 0);
+    single.setFloat("mixValue", 0.0f);
+    GLint modelLocation = glGetUniformLocation(single.ID, "model");
+    Shader batched("include/shader/batched.vert", "include/shader/batched.frag");
+    batched.use();
+    batched.setMat4("viewProjection", viewProjection);
+    batched.setInt("textures", 0);
+
+    std::vector<glm::mat4> models;
+    std::vector<int> instanceImages;
+    int drawCalls = 0;
+    auto drawEach = [&]() {
+        single.use();
+        glBindVertexArray(vaos[0]);
+        glActiveTexture(GL_TEXTURE0);
+        for (size_t i = 0; i < models.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[instanceImages[i]]);
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &models[i][0][0]);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        drawCalls = (int)models.size();
+    };
+    std::vector<glm::mat4> batchModels;
+    auto drawBatched = [&]() {
+        batched.use();
+        glBindVertexArray(vaos[1]);
+        glActiveTexture(GL_TEXTURE0);
+        std::vector<TextureBatch> batches = packer.BuildBatches(instanceImages);
+        for (const TextureBatch &batch : batches) {
+            batchModels.clear();
+            for (int instance : batch.instances) {
+                batchModels.push_back(models[instance]);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, textureBuffer);
+            glBufferData(GL_ARRAY_BUFFER, batch.data.size() * sizeof(InstanceTexture), batch.data.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, modelBuffer);
+            glBufferData(GL_ARRAY_BUFFER, batchModels.size() * sizeof(glm::mat4), batchModels.data(), GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, packer.ArrayTexture(batch.array));
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)batch.instances.size());
+        }
+        drawCalls = (int)batches.size();
+    };
+
+    // every image once, big enough that every texel covers a few pixels
+    models = gridModels(IMAGE_COUNT);
+    instanceImages.clear();
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        instanceImages.push_back(i);
+    }
+    int differing = differingPixels(drawPixels(drawEach), drawPixels(drawBatched));
+    printf("  %s, %d of %d pixels differ\n", differing * 200 < TARGET_SIZE * TARGET_SIZE ? "same picture" : "PICTURES DIFFER",
+           differing, TARGET_SIZE * TARGET_SIZE);
+    // the ids BuildBatches has to leave out
+    std::vector<int> invalid = { -1, IMAGE_COUNT, 0 };
+    std::vector<TextureBatch> kept = packer.BuildBatches(invalid);
+    bool skipped = emptyBeforePack && kept.size() == 1 && kept[0].instances.size() == 1 && kept[0].instances[0] == 2;
+    printf("  unknown image ids and an unpacked packer %s\n", skipped ? "give no instances" : "GIVE INSTANCES");
+
+    models = gridModels(objects);
+    instanceImages.clear();
+    for (int i = 0; i < objects; i++) {
+        instanceImages.push_back(i % IMAGE_COUNT);
+    }
+    printf("\n%d objects\n", objects);
+    double eachCpu = 0.0, batchedCpu = 0.0;
+    double eachMs = gpuMilliseconds(iterations, eachCpu, drawEach);
+    int eachCalls = drawCalls;
+    double batchedMs = gpuMilliseconds(iterations, batchedCpu, drawBatched);
+    int batchedCalls = drawCalls;
+    printf("  texture per object          %8.3f ms gpu %8.3f ms cpu  %6d draws\n", eachMs, eachCpu, eachCalls);
+    printf("  batched by array texture    %8.3f ms gpu %8.3f ms cpu  %6d draws\n", batchedMs, batchedCpu, batchedCalls);
+
+    packer.Release();
+    glDeleteVertexArrays(2, vaos);
+    glDeleteBuffers(1, &quadBuffer);
+    glDeleteBuffers(1, &textureBuffer);
+    glDeleteBuffers(1, &modelBuffer);
+    glDeleteTextures(IMAGE_COUNT, textures.data());
+    glDeleteProgram(single.ID);
+    glDeleteProgram(batched.ID);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glfwTerminate();
+    return differing * 200 < TARGET_SIZE * TARGET_SIZE && skipped ? 0 : 1;
+}
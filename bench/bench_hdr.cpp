@@ -0,0 +1,138 @@
+// hdr texel packing: the scalar row kernels against the SSE2 ones (and F16C for
+// half float when the cpu has it), one row at a time on one thread like
+// packHdrImage calls them. checks that every kernel gives the same bits as the
+// scalar code on random values mixed with edge cases (zero, negatives, float
+// denormals, values past each format's max, inf, NaN, rounding ties).
+//
+// usage: bench_hdr [iterations] [width] [height]
+
+#include "texture/hdr_texture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+static const float edgeValues[] = {
+    0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 1e-40f, -1e-40f, 1e30f, -1e30f,
+    std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+    std::numeric_limits<float>::quiet_NaN(),
+    // largest value of each format and just past it
+    65408.0f, 65409.0f, 65024.0f, 65025.0f, 64512.0f, 64513.0f, 65504.0f, 65519.0f, 65520.0f,
+    // smallest normals and denormals of the formats
+    1.0f / 16384.0f, 1.0f / 32768.0f, 5.9604645e-8f, 2.9802322e-8f, 1.0f / 1048576.0f,
+    // half way between two halves, once rounding down to even and once up
+    1.0f + 1.0f / 2048.0f, 1.0f + 3.0f / 2048.0f,
+    // shared exponent rounding up into the next power of two
+    511.75f, 1.999f, 0.99999f,
+};
+
+template <typename F>
+static double secondsPerRun(int iterations, F &&run) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        run();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+template <typename T>
+static size_t countDifferences(const std::vector<T> &reference, const std::vector<T> &kernel) {
+    size_t differences = 0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        differences += reference[i] != kernel[i];
+    }
+    return differences;
+}
+
+static void printTiming(const char *name, double seconds, double scalarSeconds, double megatexels) {
+    printf("  %-6s %9.2f ms  %7.2f Mtexel/s  %5.2fx\n", name, seconds * 1000.0, megatexels / seconds,
+           scalarSeconds / seconds);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 5;
+    int width = argc > 2 ? std::max(1, atoi(argv[2])) : 2048;
+    int height = argc > 3 ? std::max(1, atoi(argv[3])) : 1024;
+    size_t texels = (size_t)width * height;
+    double megatexels = (double)texels / 1e6;
+    printf("%dx%d rgba float, %s\n", width, height, cpuHasF16c() ? "f16c" : "no f16c");
+
+    // log uniform magnitudes over the range of the formats and past it, either sign
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> exponent(-26.0f, 18.0f);
+    std::vector<float> src(texels * 4);
+    for (float &value : src) {
+        value = std::exp2(exponent(random)) * (random() % 8 == 0 ? -1.0f : 1.0f);
+    }
+    const size_t edgeCount = sizeof(edgeValues) / sizeof(edgeValues[0]);
+    for (size_t i = 0; i < src.size(); i += 37) {
+        src[i] = edgeValues[random() % edgeCount];
+    }
+
+    bool allMatch = true;
+    auto packImage = [&](auto packRow, auto &dst, int valuesPerTexel) {
+        for (int y = 0; y < height; y++) {
+            size_t offset = (size_t)y * width;
+            packRow(dst.data() + offset * valuesPerTexel, src.data() + offset * 4, width * valuesPerTexel);
+        }
+    };
+
+    struct WordCase {
+        const char *name;
+        hdr_detail::PackWordRowFn scalar;
+        hdr_detail::PackWordRowFn sse;
+    };
+#if defined(CPU_SSE2)
+    const WordCase wordCases[] = {
+        { "rgb9_e5", hdr_detail::packRgb9e5RowScalar, hdr_detail::packRgb9e5RowSse },
+        { "r11f_g11f_b10f", hdr_detail::packR11G11B10RowScalar, hdr_detail::packR11G11B10RowSse },
+    };
+#else
+    const WordCase wordCases[] = {
+        { "rgb9_e5", hdr_detail::packRgb9e5RowScalar, nullptr },
+        { "r11f_g11f_b10f", hdr_detail::packR11G11B10RowScalar, nullptr },
+    };
+#endif
+    for (const WordCase &wordCase : wordCases) {
+        std::vector<uint32_t> reference(texels), kernel(texels);
+        double scalarSeconds = secondsPerRun(iterations, [&]() { packImage(wordCase.scalar, reference, 1); });
+        printf("%s\n", wordCase.name);
+        printTiming("scalar", scalarSeconds, scalarSeconds, megatexels);
+        if (wordCase.sse) {
+            double sseSeconds = secondsPerRun(iterations, [&]() { packImage(wordCase.sse, kernel, 1); });
+            size_t differences = countDifferences(reference, kernel);
+            allMatch = allMatch && differences == 0;
+            printTiming("sse2", sseSeconds, scalarSeconds, megatexels);
+            printf("         %zu differing texels\n", differences);
+        }
+    }
+
+    // texels * 4 halves, the row kernels count floats rather than texels
+    std::vector<uint16_t> reference(texels * 4), kernel(texels * 4);
+    double scalarSeconds = secondsPerRun(iterations, [&]() { packImage(hdr_detail::packHalfRowScalar, reference, 4); });
+    printf("rgba16f\n");
+    printTiming("scalar", scalarSeconds, scalarSeconds, megatexels);
+#if defined(CPU_SSE2)
+    double sseSeconds = secondsPerRun(iterations, [&]() { packImage(hdr_detail::packHalfRowSse, kernel, 4); });
+    size_t sseDifferences = countDifferences(reference, kernel);
+    allMatch = allMatch && sseDifferences == 0;
+    printTiming("sse2", sseSeconds, scalarSeconds, megatexels);
+    printf("         %zu differing halves\n", sseDifferences);
+#endif
+#if defined(CPU_AVX2)
+    if (cpuHasF16c()) {
+        std::fill(kernel.begin(), kernel.end(), (uint16_t)0);
+        double f16cSeconds = secondsPerRun(iterations, [&]() { packImage(hdr_detail::packHalfRowF16c, kernel, 4); });
+        size_t f16cDifferences = countDifferences(reference, kernel);
+        allMatch = allMatch && f16cDifferences == 0;
+        printTiming("f16c", f16cSeconds, scalarSeconds, megatexels);
+        printf("         %zu differing halves\n", f16cDifferences);
+    }
+#endif
+    return allMatch ? 0 : 1;
+}
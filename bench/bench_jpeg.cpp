@@ -0,0 +1,105 @@
+// JPEG decode throughput of the stb_image SIMD kernels (generic C, SSE2, AVX2)
+// and a check that every kernel set decodes to the same pixels as generic C.
+//
+// usage: bench_jpeg [iterations] [file.jpg ...]
+// without files it decodes the jpegs bundled in include/images: flower_bee.jpg is
+// 4:4:4, flower_bee_420.jpg is the same picture at 4:2:0 so the hv_2 chroma
+// upsamplers run too. it is 601 wide so the rows end in the scalar tail
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "images/stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct KernelSet {
+    const char *name;
+    int level;
+};
+
+static const KernelSet kernelSets[] = {
+    { "generic", STBI_SIMD_NONE },
+    { "sse2",    STBI_SIMD_SSE2 },
+    { "avx2",    STBI_SIMD_AVX2 },
+};
+
+static std::vector<unsigned char> readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 50;
+    std::vector<std::string> files;
+    for (int i = 2; i < argc; i++) {
+        files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        files.push_back("include/images/flower_bee.jpg");
+        files.push_back("include/images/flower_bee_420.jpg");
+    }
+
+    bool allMatch = true;
+    for (const std::string &path : files) {
+        std::vector<unsigned char> encoded = readFile(path);
+        if (encoded.empty()) {
+            printf("%s: could not read\n", path.c_str());
+            allMatch = false;
+            continue;
+        }
+
+        // 0 keeps the file's channels (rgb, the 3 byte conversion path), 4 is the rgba path
+        for (int reqComp : { 0, 4 }) {
+            std::vector<unsigned char> reference;
+            printf("%s, req_comp %d\n", path.c_str(), reqComp);
+            for (const KernelSet &kernels : kernelSets) {
+                stbi_set_simd_level(kernels.level);
+                int w, h, n;
+                unsigned char *pixels = stbi_load_from_memory(encoded.data(), (int)encoded.size(), &w, &h, &n, reqComp);
+                if (!pixels) {
+                    printf("  %-8s decode failed: %s\n", kernels.name, stbi_failure_reason());
+                    allMatch = false;
+                    continue;
+                }
+                size_t bytes = (size_t)w * h * (reqComp ? reqComp : n);
+
+                // compare against the generic C decode
+                int maxDiff = 0;
+                size_t differing = 0;
+                if (reference.empty()) {
+                    reference.assign(pixels, pixels + bytes);
+                } else {
+                    for (size_t i = 0; i < bytes; i++) {
+                        int diff = std::abs((int)pixels[i] - (int)reference[i]);
+                        maxDiff = std::max(maxDiff, diff);
+                        differing += diff != 0;
+                    }
+                }
+                stbi_image_free(pixels);
+
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < iterations; i++) {
+                    stbi_image_free(stbi_load_from_memory(encoded.data(), (int)encoded.size(), &w, &h, &n, reqComp));
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+                printf("  %-8s %8.3f ms  %8.1f MB/s decoded  %7.1f MB/s compressed  ",
+                       kernels.name, seconds * 1000.0, bytes / seconds / 1e6, encoded.size() / seconds / 1e6);
+                if (differing == 0) {
+                    printf("bit-identical\n");
+                } else {
+                    printf("%zu bytes differ, max diff %d\n", differing, maxDiff);
+                    allMatch = false;
+                }
+            }
+        }
+    }
+    stbi_set_simd_level(STBI_SIMD_AUTO);
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// procedural noise generation: glm::simplex and the scalar worley one texel at a
+// time on one thread, the SSE2 row kernels on one thread, and the kernels on the
+// thread pool. checks that the kernels give the same values as the scalar code,
+// then times a cold and a warm NoiseTextureCache lookup.
+//
+// usage: bench_noise [iterations] [size]
+
+#include "texture/procedural_texture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct NoiseCase {
+    const char *name;
+    NoiseType type;
+    bool tileable;
+    bool edges;
+};
+
+static const NoiseCase noiseCases[] = {
+    { "simplex fbm",          NOISE_SIMPLEX_FBM, false, false },
+    { "simplex fbm tileable", NOISE_SIMPLEX_FBM, true,  false },
+    { "worley fbm tileable",  NOISE_WORLEY,      true,  false },
+    { "worley edges",         NOISE_WORLEY,      true,  true  },
+};
+
+template <typename F>
+static double secondsPerRun(int iterations, F &&run) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        run();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 3;
+    int size = argc > 2 ? std::max(4, atoi(argv[2])) : 512;
+    ThreadPool &pool = ThreadPool::Shared();
+    printf("%dx%d, 5 octaves, %d worker threads\n", size, size, (int)pool.Size());
+
+    bool allMatch = true;
+    for (const NoiseCase &noiseCase : noiseCases) {
+        NoiseSettings settings;
+        settings.type = noiseCase.type;
+        settings.tileable = noiseCase.tileable;
+        settings.worleyEdges = noiseCase.edges;
+        settings.width = size;
+        settings.height = size;
+        const noise_detail::NoisePlan plan = noise_detail::makePlan(settings);
+        const noise_detail::NoiseRowFn noiseRow = noise_detail::selectNoiseRow();
+
+        std::vector<float> reference((size_t)size * size);
+        std::vector<float> kernel((size_t)size * size);
+        std::vector<float> pooled;
+        double scalarSeconds = secondsPerRun(iterations, [&]() {
+            for (int y = 0; y < size; y++) {
+                noise_detail::noiseRowScalar(plan, y, reference.data() + (size_t)y * size, size);
+            }
+        });
+        double kernelSeconds = secondsPerRun(iterations, [&]() {
+            for (int y = 0; y < size; y++) {
+                noiseRow(plan, y, kernel.data() + (size_t)y * size, size);
+            }
+        });
+        double pooledSeconds = secondsPerRun(iterations, [&]() {
+            pooled = generateNoise(settings, pool);
+        });
+
+        float maxError = 0.0f;
+        for (size_t i = 0; i < reference.size(); i++) {
+            maxError = std::max(maxError, std::max(std::abs(kernel[i] - reference[i]), std::abs(pooled[i] - reference[i])));
+        }
+        allMatch = allMatch && maxError == 0.0f;
+
+        double megatexels = (double)size * size / 1e6;
+        printf("%s\n", noiseCase.name);
+        printf("  scalar      %9.2f ms  %7.2f Mtexel/s\n", scalarSeconds * 1000.0, megatexels / scalarSeconds);
+        printf("  simd        %9.2f ms  %7.2f Mtexel/s  %5.2fx\n", kernelSeconds * 1000.0, megatexels / kernelSeconds,
+               scalarSeconds / kernelSeconds);
+        printf("  simd + pool %9.2f ms  %7.2f Mtexel/s  %5.2fx  max difference %g\n", pooledSeconds * 1000.0,
+               megatexels / pooledSeconds, scalarSeconds / pooledSeconds, maxError);
+    }
+
+    // the first lookup generates and writes the file, the second only decodes it
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bench_noise_cache";
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+    NoiseTextureCache cache(directory.string());
+    NoiseSettings settings;
+    settings.width = size;
+    settings.height = size;
+    std::vector<unsigned char> generated, cached;
+    double coldSeconds = secondsPerRun(1, [&]() {
+        generated = cache.Get(settings, pool);
+    });
+    double warmSeconds = secondsPerRun(iterations, [&]() {
+        cached = cache.Get(settings, pool);
+    });
+    bool identical = generated == cached;
+    allMatch = allMatch && identical;
+    printf("cache: cold %.2f ms, warm %.2f ms, %zu hits, %zu misses, %s\n", coldSeconds * 1000.0, warmSeconds * 1000.0,
+           cache.Hits(), cache.Misses(), identical ? "identical" : "DIFFERENT");
+    std::filesystem::remove_all(directory, error);
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// PNG decode throughput of stb_image with the original decoder (STBI_SIMD_NONE)
+// against the fast inflate loop plus SSE2 and AVX2 row unfilters, and a check
+// that every variant decodes to the same pixels.
+//
+// usage: bench_png [iterations] [file.png | directory ...]
+// directories are searched (not recursively) for .png files. without arguments
+// it decodes the pngs bundled in include/images
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "images/stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct KernelSet {
+    const char *name;
+    int level;
+};
+
+static const KernelSet kernelSets[] = {
+    { "generic", STBI_SIMD_NONE },
+    { "sse2",    STBI_SIMD_SSE2 },
+    { "avx2",    STBI_SIMD_AVX2 },
+};
+
+static std::vector<unsigned char> readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void addCorpus(const std::string &path, std::vector<std::string> &files) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    for (const auto &entry : std::filesystem::directory_iterator(path, error)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (entry.is_regular_file() && extension == ".png") {
+            found.push_back(entry.path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 50;
+    std::vector<std::string> files;
+    for (int i = 2; i < argc; i++) {
+        addCorpus(argv[i], files);
+    }
+    if (files.empty()) {
+        files.push_back("include/images/awesomeface.png");
+    }
+
+    bool allMatch = true;
+    // seconds and decoded bytes over the whole corpus, per kernel set
+    double totalSeconds[3] = {};
+    double totalBytes[3] = {};
+    for (const std::string &path : files) {
+        std::vector<unsigned char> encoded = readFile(path);
+        if (encoded.empty()) {
+            printf("%s: could not read\n", path.c_str());
+            allMatch = false;
+            continue;
+        }
+
+        std::vector<unsigned char> reference;
+        printf("%s\n", path.c_str());
+        for (int set = 0; set < 3; set++) {
+            const KernelSet &kernels = kernelSets[set];
+            stbi_set_simd_level(kernels.level);
+            int w, h, n;
+            unsigned char *pixels = stbi_load_from_memory(encoded.data(), (int)encoded.size(), &w, &h, &n, 0);
+            if (!pixels) {
+                printf("  %-8s decode failed: %s\n", kernels.name, stbi_failure_reason());
+                allMatch = false;
+                continue;
+            }
+            size_t bytes = (size_t)w * h * n;
+
+            bool identical = true;
+            if (reference.empty()) {
+                reference.assign(pixels, pixels + bytes);
+            } else {
+                identical = reference.size() == bytes && memcmp(reference.data(), pixels, bytes) == 0;
+            }
+            stbi_image_free(pixels);
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                stbi_image_free(stbi_load_from_memory(encoded.data(), (int)encoded.size(), &w, &h, &n, 0));
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+            totalSeconds[set] += seconds;
+            totalBytes[set] += (double)bytes;
+
+            printf("  %-8s %8.3f ms  %8.1f MB/s decoded  %7.1f MB/s compressed  %s\n",
+                   kernels.name, seconds * 1000.0, bytes / seconds / 1e6, encoded.size() / seconds / 1e6,
+                   identical ? "identical" : "DIFFERENT");
+            allMatch = allMatch && identical;
+        }
+    }
+
+    printf("corpus of %zu files\n", files.size());
+    for (int set = 0; set < 3; set++) {
+        if (totalSeconds[set] > 0.0) {
+            printf("  %-8s %8.3f ms  %8.1f MB/s decoded  %5.2fx\n", kernelSets[set].name, totalSeconds[set] * 1000.0,
+                   totalBytes[set] / totalSeconds[set] / 1e6, totalSeconds[0] / totalSeconds[set]);
+        }
+    }
+    stbi_set_simd_level(STBI_SIMD_AUTO);
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+// vertex pulling (geometry/vertex_pulling.h) against a vao per mesh: many small
+// balls of different sizes, each in its own vao drawn with glDrawElements, then
+// the same meshes from the shared buffers with one glDrawArrays per mesh and with
+// one glMultiDrawArrays for all of them. every way is drawn into the same offscreen
+// target first and its pixels compared with the vaos', so a wrong index or first
+// vertex shows up as a mismatch rather than a fast time. when the meshes don't fit
+// GL_MAX_TEXTURE_BUFFER_SIZE Upload fails and only the vaos are timed, as a program
+// would fall back to them. both draw with shader.frag and a uv gradient texture.
+// run it from the repository root.
+//
+// usage: bench_pulling [iterations] [meshes] [--textures]
+//   --textures keeps the 3.3 buffer texture path (pulled.vert) on a 4.3 context
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "geometry/vertex_pulling.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const int TARGET_SIZE = 256;
+
+// the fastest of iterations runs of draw in gpu milliseconds, cpu is the submit
+// time of that run
+template <typename F>
+static double gpuMilliseconds(int iterations, double &cpu, F &&draw) {
+    unsigned int query;
+    glGenQueries(1, &query);
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        auto start = std::chrono::steady_clock::now();
+        draw();
+        double submit = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        if (nanoseconds / 1e6 < best) {
+            best = nanoseconds / 1e6;
+            cpu = submit;
+        }
+    }
+    glDeleteQueries(1, &query);
+    return best;
+}
+
+// draws once into the cleared target and reads it back
+template <typename F>
+static std::vector<unsigned char> drawPixels(F &&draw) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    draw();
+    std::vector<unsigned char> pixels((size_t)TARGET_SIZE * TARGET_SIZE * 4);
+    glReadPixels(0, 0, TARGET_SIZE, TARGET_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    return pixels;
+}
+
+// pixels off by more than one step in a channel, rounding may differ between shaders
+static int differingPixels(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b) {
+    int differing = 0;
+    for (size_t i = 0; i < a.size(); i += 4) {
+        for (int c = 0; c < 4; c++) {
+            if (std::abs((int)a[i + c] - (int)b[i + c]) > 1) {
+                differing++;
+                break;
+            }
+        }
+    }
+    return differing;
+}
+
+// a uv ball with segments * segments quads at center, position and uv like shader.vert
+static MeshData makeBall(int segments, glm::vec3 center, float radius) {
+    const float pi = 3.14159265358979f;
+    MeshData mesh;
+    for (int y = 0; y <= segments; y++) {
+        float v = (float)y / segments;
+        for (int x = 0; x <= segments; x++) {
+            float u = (float)x / segments;
+            float ring = std::sin(v * pi);
+            glm::vec3 p = center + radius * glm::vec3(ring * std::cos(u * 2.0f * pi), std::cos(v * pi), ring * std::sin(u * 2.0f * pi));
+            mesh.vertices.insert(mesh.vertices.end(), { p.x, p.y, p.z, u, v });
+        }
+    }
+    for (int y = 0; y < segments; y++) {
+        for (int x = 0; x < segments; x++) {
+            unsigned int a = y * (segments + 1) + x;
+            unsigned int b = a + segments + 1;
+            mesh.indices.insert(mesh.indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+    }
+    return mesh;
+}
+
+int main(int argc, char **argv) {
+    int iterations = 20;
+    int meshCount = 5000;
+    bool textures = false;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--textures") == 0) {
+            textures = true;
+        } else if (positional++ == 0) {
+            iterations = std::max(1, atoi(argv[i]));
+        } else {
+            meshCount = std::max(1, atoi(argv[i]));
+        }
+    }
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(128, 128, "bench_pulling", NULL, NULL);
+    if (window == NULL) {
+        printf("failed to create a GL context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        printf("failed to load GL\n");
+        glfwTerminate();
+        return 1;
+    }
+    printf("%s, %s\n", (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+
+    // a hidden window's pixels may not be owned, so everything goes to a target of its own
+    unsigned int framebuffer, colorBuffer, depthBuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, TARGET_SIZE, TARGET_SIZE);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, TARGET_SIZE, TARGET_SIZE);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // balls of 3 to 10 segments on a grid, already in world space so every mesh
+    // shares the identity model and DrawMany can take them all at once
+    std::vector<MeshData> meshes;
+    size_t vertexTotal = 0, indexTotal = 0;
+    int side = (int)std::ceil(std::sqrt((double)meshCount));
+    for (int i = 0; i < meshCount; i++) {
+        glm::vec3 center(((float)(i % side) + 0.5f) / side * 2.0f - 1.0f, ((float)(i / side) + 0.5f) / side * 2.0f - 1.0f,
+                         -0.2f * (float)(i % 7));
+        meshes.push_back(makeBall(3 + i % 8, center, 0.8f / side));
+        vertexTotal += meshes.back().VertexCount();
+        indexTotal += meshes.back().IndexCount();
+    }
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f) *
+                               glm::lookAt(glm::vec3(0.0f, 0.0f, 2.6f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 model(1.0f);
+    printf("\n%d meshes, %zu vertices, %zu triangles\n", meshCount, vertexTotal, indexTotal / 3);
+
+    // the classic way, a vao with its own buffers per mesh
+    std::vector<unsigned int> vaos(meshes.size()), buffers(meshes.size() * 2);
+    glGenVertexArrays((GLsizei)vaos.size(), vaos.data());
+    glGenBuffers((GLsizei)buffers.size(), buffers.data());
+    for (size_t m = 0; m < meshes.size(); m++) {
+        glBindVertexArray(vaos[m]);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[m * 2]);
+        glBufferData(GL_ARRAY_BUFFER, meshes[m].vertices.size() * sizeof(float), meshes[m].vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[m * 2 + 1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshes[m].indices.size() * sizeof(unsigned int), meshes[m].indices.data(),
+                     GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+    }
+    // nearest filtered, so a texel shows exactly which uv reached the fragment
+    std::vector<unsigned char> gradient(64 * 64 * 4);
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            unsigned char *texel = &gradient[(y * 64 + x) * 4];
+            texel[0] = (unsigned char)(x * 4);
+            texel[1] = (unsigned char)(y * 4);
+            texel[2] = (unsigned char)((x ^ y) * 4);
+            texel[3] = 255;
+        }
+    }
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, gradient.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    auto setUniforms = [&](const Shader &shader) {
+        shader.setMat4("viewProjection", viewProjection);
+        shader.setMat4("model", model);
+        shader.setInt("texture1", 2);
+        shader.setInt("texture2", 2);
+        shader.setFloat("mixValue", 0.0f);
+    };
+    Shader classic("include/shader/shader.vert", "include/shader/shader.frag");
+    classic.use();
+    setUniforms(classic);
+    auto drawClassic = [&]() {
+        for (size_t m = 0; m < meshes.size(); m++) {
+            glBindVertexArray(vaos[m]);
+            glDrawElements(GL_TRIANGLES, (GLsizei)meshes[m].indices.size(), GL_UNSIGNED_INT, 0);
+        }
+    };
+    std::vector<unsigned char> reference = drawPixels(drawClassic);
+    std::vector<unsigned char> cleared((size_t)TARGET_SIZE * TARGET_SIZE * 4, 0);
+    for (size_t i = 3; i < cleared.size(); i += 4) {
+        cleared[i] = 255;
+    }
+    // an empty picture would match anything
+    printf("  %d of %d pixels covered\n", differingPixels(reference, cleared), TARGET_SIZE * TARGET_SIZE);
+    double classicCpu = 0.0;
+    double classicMs = gpuMilliseconds(iterations, classicCpu, drawClassic);
+    printf("  vao per mesh                %8.3f ms gpu %8.3f ms cpu\n", classicMs, classicCpu);
+
+    VertexPullBuffer pull(!textures);
+    std::vector<int> ids;
+    for (const MeshData &mesh : meshes) {
+        ids.push_back(pull.Add(mesh));
+    }
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    bool uploaded = pull.Upload();
+    printf("\nvertex pulling from %s, buffer textures hold up to %d texels, these meshes need %zu\n",
+           pull.UsesStorageBuffers() ? "storage buffers" : "buffer textures", maxTexels, std::max(vertexTotal * 2, indexTotal));
+    int failures = 0;
+    if (!uploaded) {
+        printf("  too big for buffer textures, a program falls back to the vaos above\n");
+    } else {
+        Shader pulled(pull.VertexShaderPath(), "include/shader/shader.frag");
+        pulled.use();
+        setUniforms(pulled);
+        pull.Bind(pulled, 0, 1);
+        auto drawEach = [&]() {
+            for (int id : ids) {
+                pull.Draw(id);
+            }
+        };
+        auto drawMany = [&]() {
+            pull.DrawMany(ids);
+        };
+        int eachDiffers = differingPixels(reference, drawPixels(drawEach));
+        int eachCalls = pull.Stats().drawCalls;
+        int manyDiffers = differingPixels(reference, drawPixels(drawMany));
+        int manyCalls = pull.Stats().drawCalls;
+        double eachCpu = 0.0, manyCpu = 0.0;
+        double eachMs = gpuMilliseconds(iterations, eachCpu, drawEach);
+        double manyMs = gpuMilliseconds(iterations, manyCpu, drawMany);
+        VertexPullStats stats = pull.Stats();
+        printf("  glDrawArrays per mesh       %8.3f ms gpu %8.3f ms cpu  %5d calls  %s\n", eachMs, eachCpu, eachCalls,
+               eachDiffers ? "PIXELS DIFFER" : "same pixels");
+        printf("  one glMultiDrawArrays       %8.3f ms gpu %8.3f ms cpu  %5d calls  %s\n", manyMs, manyCpu, manyCalls,
+               manyDiffers ? "PIXELS DIFFER" : "same pixels");
+        printf("  %zu bytes on the GPU\n", stats.gpuBytes);
+        if (eachDiffers || manyDiffers) {
+            printf("  %d and %d of %d pixels differ from the vaos\n", eachDiffers, manyDiffers, TARGET_SIZE * TARGET_SIZE);
+            failures++;
+        }
+        glDeleteProgram(pulled.ID);
+    }
+
+    pull.Release();
+    glDeleteVertexArrays((GLsizei)vaos.size(), vaos.data());
+    glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+    glDeleteProgram(classic.ID);
+    glDeleteTextures(1, &texture);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glfwTerminate();
+    return failures ? 1 : 0;
+}
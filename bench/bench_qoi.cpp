@@ -0,0 +1,117 @@
+// load time of qoi against png for the same images. every png is decoded with
+// stb_image, encoded to qoi in memory and both are timed decoding from memory.
+// the qoi pixels are checked against the png pixels.
+//
+// usage: bench_qoi [iterations] [file.png | directory ...]
+// directories are searched (not recursively) for .png files. without arguments
+// it uses include/images/awesomeface.png
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "images/stb_image.h"
+#include "images/qoi.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static std::vector<unsigned char> readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void addCorpus(const std::string &path, std::vector<std::string> &files) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    for (const auto &entry : std::filesystem::directory_iterator(path, error)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (entry.is_regular_file() && extension == ".png") {
+            found.push_back(entry.path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+template <typename F>
+static double secondsPerRun(int iterations, F &&run) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        run();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 50;
+    std::vector<std::string> files;
+    for (int i = 2; i < argc; i++) {
+        addCorpus(argv[i], files);
+    }
+    if (files.empty()) {
+        files.push_back("include/images/awesomeface.png");
+    }
+
+    bool allMatch = true;
+    double pngTotal = 0.0, qoiTotal = 0.0;
+    size_t pngBytes = 0, qoiBytes = 0;
+    for (const std::string &path : files) {
+        std::vector<unsigned char> png = readFile(path);
+        int w, h, n;
+        // qoi has no grey formats, compare both at the channel count qoi would use
+        if (!stbi_info_from_memory(png.data(), (int)png.size(), &w, &h, &n)) {
+            printf("%s: not an image\n", path.c_str());
+            allMatch = false;
+            continue;
+        }
+        int channels = n == 2 || n == 4 ? 4 : 3;
+        unsigned char *pixels = stbi_load_from_memory(png.data(), (int)png.size(), &w, &h, &n, channels);
+        std::vector<unsigned char> qoi;
+        if (!pixels || !qoiEncode(pixels, w, h, channels, qoi)) {
+            printf("%s: could not decode\n", path.c_str());
+            stbi_image_free(pixels);
+            allMatch = false;
+            continue;
+        }
+
+        QoiImage decoded;
+        bool identical = qoiDecode(qoi.data(), qoi.size(), decoded) &&
+                         memcmp(decoded.pixels.data(), pixels, decoded.pixels.size()) == 0;
+        stbi_image_free(pixels);
+        allMatch = allMatch && identical;
+
+        double pngSeconds = secondsPerRun(iterations, [&]() {
+            stbi_image_free(stbi_load_from_memory(png.data(), (int)png.size(), &w, &h, &n, channels));
+        });
+        double qoiSeconds = secondsPerRun(iterations, [&]() {
+            qoiDecode(qoi.data(), qoi.size(), decoded);
+        });
+        pngTotal += pngSeconds;
+        qoiTotal += qoiSeconds;
+        pngBytes += png.size();
+        qoiBytes += qoi.size();
+
+        double megabytes = (double)w * h * channels / 1e6;
+        printf("%s (%dx%d, %d channels)\n", path.c_str(), w, h, channels);
+        printf("  png %8.3f ms  %8.1f MB/s  %9zu bytes\n", pngSeconds * 1000.0, megabytes / pngSeconds, png.size());
+        printf("  qoi %8.3f ms  %8.1f MB/s  %9zu bytes  %5.2fx faster  %s\n", qoiSeconds * 1000.0, megabytes / qoiSeconds,
+               qoi.size(), pngSeconds / qoiSeconds, identical ? "identical" : "DIFFERENT");
+    }
+
+    if (qoiTotal > 0.0) {
+        printf("corpus of %zu files: png %.3f ms, qoi %.3f ms, %.2fx faster, %.1f%% of the png size\n", files.size(),
+               pngTotal * 1000.0, qoiTotal * 1000.0, pngTotal / qoiTotal, 100.0 * qoiBytes / std::max<size_t>(pngBytes, 1));
+    }
+    return allMatch ? 0 : 1;
+}
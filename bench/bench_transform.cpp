@@ -0,0 +1,268 @@
+// vertex transform cost: the old projection * view * model per vertex against the
+// cpu combined viewProjection (shader.vert) and mvp (mvp.vert) on a dense sphere,
+// then many small 96 vertex balls drawn one by one with a model uniform against one
+// instanced draw with per instance mvps (MvpInstanceBuffer). gpu times come from
+// timer queries with a trivial fragment shader on a small hidden window,
+// so the vertex shader dominates. run it from the repository root.
+//
+// usage: bench_transform [iterations] [sphere segments] [balls]
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "geometry/mvp_instances.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// what shader.vert did before the cpu combined the matrices
+static const char *tripleVertexSource =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 aPos;\n"
+    "layout (location = 1) in vec2 aTexCoord;\n"
+    "uniform mat4 model;\n"
+    "uniform mat4 view;\n"
+    "uniform mat4 projection;\n"
+    "out vec2 TexCoord;\n"
+    "void main() {\n"
+    "    gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+    "    TexCoord = aTexCoord;\n"
+    "}\n";
+
+static const char *flatFragmentSource =
+    "#version 330 core\n"
+    "in vec2 TexCoord;\n"
+    "out vec4 FragColor;\n"
+    "void main() {\n"
+    "    FragColor = vec4(TexCoord, 0.0, 1.0);\n"
+    "}\n";
+
+static std::string readFile(const char *path) {
+    std::ifstream file(path);
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+static unsigned int compile(GLenum type, const char *source) {
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint success = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("shader error: %s\n", log);
+    }
+    return shader;
+}
+
+static unsigned int buildProgram(const std::string &vertexSource) {
+    unsigned int vertex = compile(GL_VERTEX_SHADER, vertexSource.c_str());
+    unsigned int fragment = compile(GL_FRAGMENT_SHADER, flatFragmentSource);
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return program;
+}
+
+static void setMat4(unsigned int program, const char *name, const glm::mat4 &value) {
+    glUniformMatrix4fv(glGetUniformLocation(program, name), 1, GL_FALSE, glm::value_ptr(value));
+}
+
+// the fastest of iterations runs of draw in gpu milliseconds
+template <typename F>
+static double gpuMilliseconds(int iterations, F &&draw) {
+    unsigned int query;
+    glGenQueries(1, &query);
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        draw();
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        best = std::min(best, nanoseconds / 1e6);
+    }
+    glDeleteQueries(1, &query);
+    return best;
+}
+
+// a uv sphere with segments * segments quads, position and uv like shader.vert
+static void makeSphere(int segments, std::vector<float> &vertices, std::vector<unsigned int> &indices) {
+    const float pi = 3.14159265358979f;
+    for (int y = 0; y <= segments; y++) {
+        float v = (float)y / segments;
+        for (int x = 0; x <= segments; x++) {
+            float u = (float)x / segments;
+            float ring = std::sin(v * pi);
+            vertices.insert(vertices.end(), { ring * std::cos(u * 2.0f * pi), std::cos(v * pi), ring * std::sin(u * 2.0f * pi), u, v });
+        }
+    }
+    for (int y = 0; y < segments; y++) {
+        for (int x = 0; x < segments; x++) {
+            unsigned int a = y * (segments + 1) + x;
+            unsigned int b = a + segments + 1;
+            indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+    int segments = argc > 2 ? std::max(4, atoi(argv[2])) : 1024;
+    int balls = argc > 3 ? std::max(1, atoi(argv[3])) : 20000;
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(128, 128, "bench_transform", NULL, NULL);
+    if (window == NULL) {
+        printf("failed to create a GL context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        printf("failed to load GL\n");
+        glfwTerminate();
+        return 1;
+    }
+    glViewport(0, 0, 128, 128);
+    glDisable(GL_DEPTH_TEST);
+    printf("%s\n", (const char *)glGetString(GL_RENDERER));
+
+    unsigned int triple = buildProgram(tripleVertexSource);
+    unsigned int combined = buildProgram(readFile("include/shader/shader.vert"));
+    unsigned int single = buildProgram(readFile("include/shader/mvp.vert"));
+    unsigned int instanced = buildProgram(readFile("include/shader/mvp_instanced.vert"));
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = projection * view;
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(1.0f, 0.3f, 0.5f));
+
+    // the dense mesh, one draw per sample
+    std::vector<float> sphereVertices;
+    std::vector<unsigned int> sphereIndices;
+    makeSphere(segments, sphereVertices, sphereIndices);
+    unsigned int sphereVao, sphereBuffers[2];
+    glGenVertexArrays(1, &sphereVao);
+    glGenBuffers(2, sphereBuffers);
+    glBindVertexArray(sphereVao);
+    glBindBuffer(GL_ARRAY_BUFFER, sphereBuffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), sphereVertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereBuffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(unsigned int), sphereIndices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    GLsizei sphereIndexCount = (GLsizei)sphereIndices.size();
+    auto drawSphere = [&]() {
+        glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
+    };
+
+    printf("\nsphere: %zu vertices, %d triangles\n", sphereVertices.size() / 5, sphereIndexCount / 3);
+    glUseProgram(triple);
+    setMat4(triple, "projection", projection);
+    setMat4(triple, "view", view);
+    setMat4(triple, "model", model);
+    double tripleMs = gpuMilliseconds(iterations, drawSphere);
+    glUseProgram(combined);
+    setMat4(combined, "viewProjection", viewProjection);
+    setMat4(combined, "model", model);
+    double combinedMs = gpuMilliseconds(iterations, drawSphere);
+    glUseProgram(single);
+    setMat4(single, "mvp", viewProjection * model);
+    double singleMs = gpuMilliseconds(iterations, drawSphere);
+    printf("  projection * view * model   %8.3f ms\n", tripleMs);
+    printf("  viewProjection * model      %8.3f ms  %.2fx\n", combinedMs, tripleMs / combinedMs);
+    printf("  mvp                         %8.3f ms  %.2fx\n", singleMs, tripleMs / singleMs);
+
+    // the small mesh, many copies
+    std::vector<float> ballVertices;
+    std::vector<unsigned int> ballIndices;
+    makeSphere(4, ballVertices, ballIndices);
+    std::vector<float> ballTriangles;
+    for (unsigned int index : ballIndices) {
+        ballTriangles.insert(ballTriangles.end(), ballVertices.begin() + index * 5, ballVertices.begin() + index * 5 + 5);
+    }
+    int ballVertexCount = (int)ballIndices.size();
+    unsigned int ballVao, ballBuffer;
+    glGenVertexArrays(1, &ballVao);
+    glGenBuffers(1, &ballBuffer);
+    glBindVertexArray(ballVao);
+    glBindBuffer(GL_ARRAY_BUFFER, ballBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ballTriangles.size() * sizeof(float), ballTriangles.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    MvpInstanceBuffer mvps;
+    mvps.Attach(ballVao);
+
+    std::vector<glm::mat4> models;
+    for (int i = 0; i < balls; i++) {
+        glm::vec3 position((float)(i % 64) - 32.0f, (float)((i / 64) % 64) - 32.0f, -10.0f - (float)(i / 4096) * 2.0f);
+        models.push_back(glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.3f)));
+    }
+
+    printf("\n%d small meshes of %d vertices\n", balls, ballVertexCount);
+    glBindVertexArray(ballVao);
+    glUseProgram(combined);
+    setMat4(combined, "viewProjection", viewProjection);
+    GLint modelLocation = glGetUniformLocation(combined, "model");
+    double uniformCpu = 0.0;
+    double uniformMs = gpuMilliseconds(iterations, [&]() {
+        auto start = std::chrono::steady_clock::now();
+        for (const glm::mat4 &m : models) {
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(m));
+            glDrawArrays(GL_TRIANGLES, 0, ballVertexCount);
+        }
+        uniformCpu = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    });
+    glUseProgram(instanced);
+    double instancedCpu = 0.0;
+    double instancedMs = gpuMilliseconds(iterations, [&]() {
+        auto start = std::chrono::steady_clock::now();
+        mvps.Begin(viewProjection);
+        for (const glm::mat4 &m : models) {
+            mvps.Add(m);
+        }
+        mvps.Upload();
+        mvps.Draw(ballVertexCount);
+        instancedCpu = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    });
+    printf("  model uniform per draw      %8.3f ms gpu %8.3f ms cpu\n", uniformMs, uniformCpu);
+    printf("  instanced mvp               %8.3f ms gpu %8.3f ms cpu\n", instancedMs, instancedCpu);
+
+    mvps.Release();
+    glDeleteVertexArrays(1, &sphereVao);
+    glDeleteVertexArrays(1, &ballVao);
+    glDeleteBuffers(2, sphereBuffers);
+    glDeleteBuffers(1, &ballBuffer);
+    glDeleteProgram(triple);
+    glDeleteProgram(combined);
+    glDeleteProgram(single);
+    glDeleteProgram(instanced);
+    glfwTerminate();
+    return 0;
+}
@@ -4,6 +4,12 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "geometry/frustum.h"
+
+#include <cstdint>
 
 // defines several possible camera movements for abstraction.
 enum Camera_Movement {
@@ -16,6 +22,9 @@ const float PITCH = 0.0f;
 const float SPEED = 2.5f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
+const float ASPECT = 800.0f / 600.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 
 // camera class
 class Camera {
@@ -25,28 +34,76 @@ class Camera {
         glm::vec3 Front;
         glm::vec3 Up;
         glm::vec3 Right;
+        // change it with SetWorldUp
         glm::vec3 WorldUp;
-        // euler angles
+        // euler angles, in degrees. kept for recording, the turn itself is Orientation
         float Yaw;
         float Pitch;
+        // the camera's turn, Front, Right and Up are its axes
+        glm::quat Orientation;
         // camera options
         float MovementSpeed;
         float MouseSensitivity;
         float Zoom;
+        // projection settings, width / height of the viewport
+        float Aspect;
+        float NearPlane;
+        float FarPlane;
 
         // constructor with vectors
-        Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM) {
+        Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM), Aspect(ASPECT), NearPlane(NEAR_PLANE), FarPlane(FAR_PLANE), cacheVersion(0), cacheValid(false) {
             Position = position;
-            WorldUp = up;
             Yaw = yaw;
             Pitch = pitch;
-            updateCameraVectors();
+            SetWorldUp(up);
         }
         // TODO: constructor with scalar values
 
+        // the matrices and the frustum are cached and only rebuilt when Position,
+        // Front, Up, Zoom or the projection settings changed since the last call
+
         // returns the view matrix from the euler angles and lookat matrix
-        glm::mat4 GetViewMatrix() {
-            return glm::lookAt(Position, Position + Front, Up);
+        const glm::mat4& GetViewMatrix() const {
+            refresh();
+            return view;
+        }
+
+        const glm::mat4& GetProjectionMatrix() const {
+            refresh();
+            return projection;
+        }
+
+        // projection * view
+        const glm::mat4& GetViewProjectionMatrix() const {
+            refresh();
+            return viewProjection;
+        }
+
+        const glm::mat4& GetInverseViewMatrix() const {
+            refresh();
+            return inverseView;
+        }
+
+        const glm::mat4& GetInverseProjectionMatrix() const {
+            refresh();
+            return inverseProjection;
+        }
+
+        const glm::mat4& GetInverseViewProjectionMatrix() const {
+            refresh();
+            return inverseViewProjection;
+        }
+
+        const Frustum& GetFrustum() const {
+            refresh();
+            return frustum;
+        }
+
+        // goes up every time the matrices are rebuilt, so whatever was made from them
+        // (uniforms, culling results) can be kept while it's the same
+        uint64_t Version() const {
+            refresh();
+            return cacheVersion;
         }
         // processes input from keyboard
         void ProcessKeyboard(Camera_Movement direction, float deltaTime) {
@@ -65,11 +122,13 @@ class Camera {
             }
         }
 
-        // process input from a mouse
+        // process input from a mouse. it's cheap to call once with the sum of many
+        // cursor events, not so much for every one of them
         void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true) {
             xoffset *= MouseSensitivity;
             yoffset *= MouseSensitivity;
 
+            float lastPitch = Pitch;
             Yaw += xoffset;
             Pitch += yoffset;
 
@@ -83,9 +142,33 @@ class Camera {
                 }
             }
 
+            // only the turn since the last call goes into the quaternions, both
+            // turns are about fixed axes so they add up like the angles do
+            if (xoffset != 0.0f) {
+                yawTurn = renormalized(yawTurn * glm::angleAxis(glm::radians(-xoffset), glm::vec3(0.0f, 1.0f, 0.0f)));
+            }
+            if (Pitch != lastPitch) {
+                pitchTurn = renormalized(pitchTurn * glm::angleAxis(glm::radians(Pitch - lastPitch), glm::vec3(0.0f, 0.0f, 1.0f)));
+            }
+            updateCameraVectors();
+        }
+
+        // turns the camera to these euler angles, in degrees
+        void SetYawPitch(float yaw, float pitch) {
+            Yaw = yaw;
+            Pitch = pitch;
+            yawTurn = toWorld * glm::angleAxis(glm::radians(-Yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+            pitchTurn = glm::angleAxis(glm::radians(Pitch), glm::vec3(0.0f, 0.0f, 1.0f));
             updateCameraVectors();
         }
 
+        // the up axis yaw turns around, keeps the euler angles
+        void SetWorldUp(glm::vec3 up) {
+            WorldUp = up;
+            toWorld = glm::quat(glm::vec3(0.0f, 1.0f, 0.0f), glm::normalize(WorldUp));
+            SetYawPitch(Yaw, Pitch);
+        }
+
         // process input from scrolling
         void processMouseScroll(float yoffset) {
             Zoom -= (float)yoffset;
@@ -98,17 +181,68 @@ class Camera {
         }
 
     private:
+        // the inputs the cached matrices were built from
+        mutable glm::vec3 cachedPosition;
+        mutable glm::vec3 cachedFront;
+        mutable glm::vec3 cachedUp;
+        mutable glm::vec4 cachedProjection;
+        mutable glm::mat4 view;
+        mutable glm::mat4 projection;
+        mutable glm::mat4 viewProjection;
+        mutable glm::mat4 inverseView;
+        mutable glm::mat4 inverseProjection;
+        mutable glm::mat4 inverseViewProjection;
+        mutable Frustum frustum;
+        mutable uint64_t cacheVersion;
+        mutable bool cacheValid;
+        // y up to WorldUp, and the turns about world up and the camera's right axis.
+        // Orientation is yawTurn * pitchTurn
+        glm::quat toWorld;
+        glm::quat yawTurn;
+        glm::quat pitchTurn;
+
+        void refresh() const {
+            glm::vec4 projectionSettings(Zoom, Aspect, NearPlane, FarPlane);
+            bool viewChanged = !cacheValid || Position != cachedPosition || Front != cachedFront || Up != cachedUp;
+            bool projectionChanged = !cacheValid || projectionSettings != cachedProjection;
+            if (!viewChanged && !projectionChanged) {
+                return;
+            }
+            if (viewChanged) {
+                cachedPosition = Position;
+                cachedFront = Front;
+                cachedUp = Up;
+                view = glm::lookAt(Position, Position + Front, Up);
+                // a view matrix is only a rotation and a translation
+                inverseView = glm::affineInverse(view);
+            }
+            if (projectionChanged) {
+                cachedProjection = projectionSettings;
+                projection = glm::perspective(glm::radians(Zoom), Aspect, NearPlane, FarPlane);
+                inverseProjection = glm::inverse(projection);
+            }
+            viewProjection = projection * view;
+            inverseViewProjection = inverseView * inverseProjection;
+            frustum = Frustum(viewProjection);
+            cacheValid = true;
+            cacheVersion++;
+        }
+
+        // with yaw and pitch 0 the camera looks down x with z to its right
         void updateCameraVectors() {
-            // calculate the new Front vector
-            glm::vec3 front;
-            front.x = cos(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-            front.y = sin(glm::radians(Pitch));
-            front.z = sin(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-            Front = glm::normalize(front);
-
-            // also recalculate the right and up vectors
-            Right = glm::normalize(glm::cross(Front, WorldUp));
-            Up = glm::normalize(glm::cross(Right, Front));
+            Orientation = yawTurn * pitchTurn;
+
+            // the columns are the rotated unit axes, already normalized and perpendicular
+            glm::mat3 axes = glm::mat3_cast(Orientation);
+            Front = axes[0];
+            Up = axes[1];
+            Right = axes[2];
+        }
+
+        // one newton step towards length 1, enough for the rounding of one product
+        // and no square root
+        static glm::quat renormalized(const glm::quat &q) {
+            return q * ((3.0f - glm::dot(q, q)) * 0.5f);
         }
 };
 
@@ -0,0 +1,194 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "util/fixed_timestep.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// the camera, the clock and the animated scene values of one drawn frame
+struct CameraPathFrame {
+    // simulation time the frame showed, in ticks since the first step
+    Ticks time;
+    glm::vec3 position;
+    // euler angles and field of view, in degrees
+    float yaw;
+    float pitch;
+    float zoom;
+    // the texture mix and how far the cubes had turned, in seconds of spinning
+    float mixValue;
+    double spinTime;
+};
+
+// the frames of a flight through the scene, for replaying it exactly: a benchmark
+// drawn from the same path draws the same frames whatever the build or the frame
+// rate. the file is a header and 44 bytes per frame, little endian
+//
+//   record: path.Add(frame) every frame, path.Save(file) at the end
+//   replay: path.Load(file), then path.Apply(i, camera) for frame i
+class CameraPath {
+    public:
+        // 2 added the mix value and the spin time
+        static const uint32_t VERSION = 2;
+        static const size_t FRAME_BYTES = 44;
+
+        void Add(const CameraPathFrame &frame) {
+            frames.push_back(frame);
+        }
+
+        // moves and turns the camera to where it was in frame i
+        void Apply(size_t i, Camera &camera) const {
+            const CameraPathFrame &frame = frames[i];
+            camera.Position = frame.position;
+            camera.Zoom = frame.zoom;
+            camera.SetYawPitch(frame.yaw, frame.pitch);
+        }
+
+        const CameraPathFrame& Frame(size_t i) const {
+            return frames[i];
+        }
+
+        size_t Size() const {
+            return frames.size();
+        }
+
+        bool Empty() const {
+            return frames.empty();
+        }
+
+        void Clear() {
+            frames.clear();
+        }
+
+        bool Save(const std::string &path) const {
+            std::vector<unsigned char> data(HEADER_BYTES + frames.size() * FRAME_BYTES);
+            unsigned char *out = data.data();
+            memcpy(out, MAGIC, 4);
+            put32(out + 4, VERSION);
+            put32(out + 8, (uint32_t)frames.size());
+            out += HEADER_BYTES;
+            for (const CameraPathFrame &frame : frames) {
+                put64(out, (uint64_t)frame.time);
+                putFloat(out + 8, frame.position.x);
+                putFloat(out + 12, frame.position.y);
+                putFloat(out + 16, frame.position.z);
+                putFloat(out + 20, frame.yaw);
+                putFloat(out + 24, frame.pitch);
+                putFloat(out + 28, frame.zoom);
+                putFloat(out + 32, frame.mixValue);
+                putDouble(out + 36, frame.spinTime);
+                out += FRAME_BYTES;
+            }
+            FILE *file = fopen(path.c_str(), "wb");
+            if (!file) {
+                return false;
+            }
+            bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+            return fclose(file) == 0 && written;
+        }
+
+        // false leaves the path empty, for a missing, foreign, cut off or corrupt file
+        bool Load(const std::string &path) {
+            frames.clear();
+            FILE *file = fopen(path.c_str(), "rb");
+            if (!file) {
+                return false;
+            }
+            long fileSize = -1;
+            if (fseek(file, 0, SEEK_END) == 0) {
+                fileSize = ftell(file);
+                fseek(file, 0, SEEK_SET);
+            }
+            unsigned char header[HEADER_BYTES];
+            bool ok = fread(header, 1, HEADER_BYTES, file) == HEADER_BYTES && memcmp(header, MAGIC, 4) == 0 &&
+                      get32(header + 4) == VERSION;
+            std::vector<unsigned char> data;
+            // the frame count has to match the file before anything is allocated for it
+            if (ok) {
+                uint64_t bytes = (uint64_t)get32(header + 8) * FRAME_BYTES;
+                ok = fileSize >= (long)HEADER_BYTES && bytes == (uint64_t)(fileSize - (long)HEADER_BYTES);
+            }
+            if (ok) {
+                data.resize((size_t)get32(header + 8) * FRAME_BYTES);
+                ok = fread(data.data(), 1, data.size(), file) == data.size();
+            }
+            fclose(file);
+            if (!ok) {
+                return false;
+            }
+            frames.resize(data.size() / FRAME_BYTES);
+            const unsigned char *in = data.data();
+            for (CameraPathFrame &frame : frames) {
+                frame.time = (Ticks)get64(in);
+                frame.position = glm::vec3(getFloat(in + 8), getFloat(in + 12), getFloat(in + 16));
+                frame.yaw = getFloat(in + 20);
+                frame.pitch = getFloat(in + 24);
+                frame.zoom = getFloat(in + 28);
+                frame.mixValue = getFloat(in + 32);
+                frame.spinTime = getDouble(in + 36);
+                in += FRAME_BYTES;
+            }
+            return true;
+        }
+
+    private:
+        static const size_t HEADER_BYTES = 12;
+        static constexpr const char *MAGIC = "CPTH";
+
+        std::vector<CameraPathFrame> frames;
+
+        static void put32(unsigned char *out, uint32_t value) {
+            out[0] = (unsigned char)value;
+            out[1] = (unsigned char)(value >> 8);
+            out[2] = (unsigned char)(value >> 16);
+            out[3] = (unsigned char)(value >> 24);
+        }
+
+        static uint32_t get32(const unsigned char *in) {
+            return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+        }
+
+        static void put64(unsigned char *out, uint64_t value) {
+            put32(out, (uint32_t)(value & 0xffffffffu));
+            put32(out + 4, (uint32_t)(value >> 32));
+        }
+
+        static uint64_t get64(const unsigned char *in) {
+            return (uint64_t)get32(in) | (uint64_t)get32(in + 4) << 32;
+        }
+
+        // the exact bits, so a replay sees the same values that were recorded
+        static void putFloat(unsigned char *out, float value) {
+            uint32_t bits;
+            memcpy(&bits, &value, 4);
+            put32(out, bits);
+        }
+
+        static float getFloat(const unsigned char *in) {
+            uint32_t bits = get32(in);
+            float value;
+            memcpy(&value, &bits, 4);
+            return value;
+        }
+
+        static void putDouble(unsigned char *out, double value) {
+            uint64_t bits;
+            memcpy(&bits, &value, 8);
+            put64(out, bits);
+        }
+
+        static double getDouble(const unsigned char *in) {
+            uint64_t bits = get64(in);
+            double value;
+            memcpy(&value, &bits, 8);
+            return value;
+        }
+};
+
+#endif
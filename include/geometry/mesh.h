@@ -0,0 +1,25 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstddef>
+#include <vector>
+
+// triangles in the vertex layout of shader.vert: position (3 floats) then
+// texture coordinate (2 floats), interleaved
+struct MeshData {
+    static const int FLOATS_PER_VERTEX = 5;
+
+    std::vector<float> vertices;
+    // empty means every three vertices are a triangle
+    std::vector<unsigned int> indices;
+
+    size_t VertexCount() const {
+        return vertices.size() / FLOATS_PER_VERTEX;
+    }
+
+    size_t IndexCount() const {
+        return indices.empty() ? VertexCount() : indices.size();
+    }
+};
+
+#endif
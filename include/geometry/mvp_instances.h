@@ -0,0 +1,106 @@
+#ifndef MVP_INSTANCES_H
+#define MVP_INSTANCES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// binds a buffer of mat4 as a per instance attribute, one column per location
+// from location to location + 3
+inline void setupMat4InstanceAttribute(unsigned int buffer, unsigned int location) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column < 4; column++) {
+        glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(location + column);
+        glVertexAttribDivisor(location + column, 1);
+    }
+}
+
+// projection * view * model per instance, multiplied on the cpu and streamed every
+// frame (mvp_instanced.vert). the vertex shader is then one matrix * vector per
+// vertex, which pays off for meshes with few vertices and many instances: 64 bytes
+// and one matrix product per instance against a matrix * vector on every vertex.
+// dense meshes are better off with shader.vert's model and viewProjection uniforms
+//
+//   mvps.Attach(VAO); every frame: mvps.Begin(projection * view);
+//   per object mvps.Add(model); mvps.Upload(); glBindVertexArray(VAO); mvps.Draw(36)
+class MvpInstanceBuffer {
+    public:
+        MvpInstanceBuffer() : buffer(0), capacity(0), uploaded(0) {}
+
+        ~MvpInstanceBuffer() {
+            Release();
+        }
+
+        MvpInstanceBuffer(const MvpInstanceBuffer&) = delete;
+        MvpInstanceBuffer& operator=(const MvpInstanceBuffer&) = delete;
+
+        // adds the instance attribute to vao, which holds the mesh at locations 0 and
+        // 1 like shader.vert. needs the GL context
+        void Attach(unsigned int vao, unsigned int location = 2) {
+            if (buffer == 0) {
+                glGenBuffers(1, &buffer);
+            }
+            glBindVertexArray(vao);
+            setupMat4InstanceAttribute(buffer, location);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        // starts the instances of a frame
+        void Begin(const glm::mat4 &viewProjection) {
+            this->viewProjection = viewProjection;
+            mvps.clear();
+        }
+
+        void Add(const glm::mat4 &model) {
+            mvps.push_back(viewProjection * model);
+        }
+
+        // sends this frame's matrices into fresh storage so the GPU can keep reading
+        // the last frame's, the buffer only grows
+        void Upload() {
+            size_t size = mvps.size() * sizeof(glm::mat4);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            if (size > capacity) {
+                capacity = size;
+            }
+            glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+            if (size > 0) {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, size, mvps.data());
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            uploaded = (int)mvps.size();
+        }
+
+        // draws every uploaded instance with the attached vao bound
+        void Draw(int vertexCount, int firstVertex = 0) const {
+            if (uploaded > 0) {
+                glDrawArraysInstanced(GL_TRIANGLES, firstVertex, vertexCount, uploaded);
+            }
+        }
+
+        int Count() const {
+            return (int)mvps.size();
+        }
+
+        // deletes the buffer, call before the context goes away
+        void Release() {
+            if (buffer) {
+                glDeleteBuffers(1, &buffer);
+                buffer = 0;
+            }
+            capacity = 0;
+            uploaded = 0;
+        }
+
+    private:
+        unsigned int buffer;
+        size_t capacity;
+        int uploaded;
+        glm::mat4 viewProjection;
+        std::vector<glm::mat4> mvps;
+};
+
+#endif
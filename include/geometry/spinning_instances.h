@@ -0,0 +1,110 @@
+#ifndef SPINNING_INSTANCES_H
+#define SPINNING_INSTANCES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader/shader.h"
+
+#include <cstddef>
+#include <vector>
+
+// what spinning.vert needs to turn one object by itself, uploaded once
+struct SpinInstance {
+    glm::vec3 position;
+    // radians per second
+    float angularSpeed;
+    // unit length
+    glm::vec3 axis;
+    // angle at time 0, in radians
+    float phase;
+};
+
+// binds a buffer of SpinInstance as per instance attributes: position and speed at
+// location, axis and phase at location + 1
+inline void setupSpinInstanceAttributes(unsigned int buffer, unsigned int location) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(SpinInstance), (void*)offsetof(SpinInstance, position));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+    glVertexAttribPointer(location + 1, 4, GL_FLOAT, GL_FALSE, sizeof(SpinInstance), (void*)offsetof(SpinInstance, axis));
+    glEnableVertexAttribArray(location + 1);
+    glVertexAttribDivisor(location + 1, 1);
+}
+
+// objects that spin at a constant speed around a fixed axis, animated entirely in
+// the vertex shader: the instances are uploaded once and every frame only the
+// time uniform changes, so there is no per object work or upload on the cpu
+//
+//   cubes.Add(position, axis, speed); cubes.Upload(VAO);
+//   every frame: shader.use(); set viewProjection; cubes.Draw(shader, time, 36)
+class SpinningInstances {
+    public:
+        SpinningInstances() : buffer(0), uploaded(0) {}
+
+        ~SpinningInstances() {
+            Release();
+        }
+
+        SpinningInstances(const SpinningInstances&) = delete;
+        SpinningInstances& operator=(const SpinningInstances&) = delete;
+
+        // returns the instance id. the axis doesn't need to be normalized
+        int Add(const glm::vec3 &position, const glm::vec3 &axis, float radiansPerSecond, float phase = 0.0f) {
+            instances.push_back(SpinInstance{ position, radiansPerSecond, glm::normalize(axis), phase });
+            return (int)instances.size() - 1;
+        }
+
+        // uploads the instances and adds them to vao, which holds the mesh at
+        // locations 0 and 1 like shader.vert. needs the GL context
+        void Upload(unsigned int vao, unsigned int location = 2) {
+            if (buffer == 0) {
+                glGenBuffers(1, &buffer);
+            }
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(SpinInstance), instances.data(), GL_STATIC_DRAW);
+            setupSpinInstanceAttributes(buffer, location);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            uploaded = (int)instances.size();
+        }
+
+        // draws every instance with the vao given to Upload bound and the shader in use
+        void Draw(const Shader &shader, float time, int vertexCount) const {
+            shader.setFloat("time", time);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, uploaded);
+        }
+
+        // the model matrix the shader builds, for culling and picking on the cpu
+        glm::mat4 ModelMatrix(int id, float time) const {
+            const SpinInstance &instance = instances[id];
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), instance.position);
+            return glm::rotate(model, time * instance.angularSpeed + instance.phase, instance.axis);
+        }
+
+        int Count() const {
+            return (int)instances.size();
+        }
+
+        const SpinInstance& Instance(int id) const {
+            return instances[id];
+        }
+
+        // deletes the instance buffer, call before the context goes away
+        void Release() {
+            if (buffer) {
+                glDeleteBuffers(1, &buffer);
+                buffer = 0;
+            }
+            uploaded = 0;
+        }
+
+    private:
+        std::vector<SpinInstance> instances;
+        unsigned int buffer;
+        int uploaded;
+};
+
+#endif
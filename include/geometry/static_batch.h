@@ -0,0 +1,339 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "geometry/frustum.h"
+#include "geometry/mesh.h"
+#include "util/hash.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct StaticBatchStats {
+    int objects;
+    int batches;
+    // what the objects would cost drawn one by one, and what the last Draw took
+    int unbatchedDrawCalls;
+    int drawCalls;
+    // objects inside the batches the last Draw didn't cull
+    int drawnObjects;
+    int culledBatches;
+    int rebuiltBatches;
+    double rebuildMilliseconds;
+    size_t vertices;
+    size_t gpuBytes;
+};
+
+// merges objects that never move into a few large vertex and index buffers. every
+// object is transformed into world space once, and objects with the same material
+// whose bounds are centred in the same cubic chunk of space share one buffer and
+// one draw call, with the chunk's bounds for frustum culling. draw the batches with
+// an identity model matrix. Add and Remove only mark their batch, Rebuild then
+// rebuilds the marked batches and leaves the rest of the world alone
+class StaticBatcher {
+    public:
+        explicit StaticBatcher(float chunkSize = 32.0f)
+            : chunkSize(chunkSize), unbatchedDrawCalls(0), drawCalls(0), drawnObjects(0), culledBatches(0), rebuiltBatches(0),
+              rebuildMilliseconds(0.0) {}
+
+        ~StaticBatcher() {
+            Release();
+        }
+
+        StaticBatcher(const StaticBatcher&) = delete;
+        StaticBatcher& operator=(const StaticBatcher&) = delete;
+
+        // places mesh at model in world space, `material` is anything the caller uses to
+        // tell its textures and shaders apart. the mesh is shared, not copied. returns the object id
+        int Add(std::shared_ptr<const MeshData> mesh, const glm::mat4 &model, int material) {
+            if (!mesh || mesh->VertexCount() == 0) {
+                return -1;
+            }
+            Object object;
+            object.mesh = std::move(mesh);
+            object.model = model;
+            object.material = material;
+            object.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+            object.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+            const std::vector<float> &vertices = object.mesh->vertices;
+            for (size_t v = 0; v + MeshData::FLOATS_PER_VERTEX <= vertices.size(); v += MeshData::FLOATS_PER_VERTEX) {
+                glm::vec3 world = glm::vec3(model * glm::vec4(vertices[v], vertices[v + 1], vertices[v + 2], 1.0f));
+                object.boundsMin = glm::min(object.boundsMin, world);
+                object.boundsMax = glm::max(object.boundsMax, world);
+            }
+            glm::vec3 cell = glm::floor((object.boundsMin + object.boundsMax) * 0.5f / chunkSize);
+            object.key = BatchKey{ (int)cell.x, (int)cell.y, (int)cell.z, material };
+            object.alive = true;
+
+            int id;
+            if (!freeIds.empty()) {
+                id = freeIds.back();
+                freeIds.pop_back();
+                objects[id] = std::move(object);
+            } else {
+                id = (int)objects.size();
+                objects.push_back(std::move(object));
+            }
+            Batch &batch = batches[objects[id].key];
+            batch.objects.push_back(id);
+            batch.dirty = true;
+            return id;
+        }
+
+        bool Remove(int id) {
+            if (id < 0 || id >= (int)objects.size() || !objects[id].alive) {
+                return false;
+            }
+            Object &object = objects[id];
+            Batch &batch = batches[object.key];
+            batch.objects.erase(std::find(batch.objects.begin(), batch.objects.end(), id));
+            batch.dirty = true;
+            object = Object();
+            freeIds.push_back(id);
+            return true;
+        }
+
+        // rebuilds the batches changed since the last call, transforming on the pool.
+        // needs the GL context
+        void Rebuild(ThreadPool &pool = ThreadPool::Shared()) {
+            auto start = std::chrono::steady_clock::now();
+            rebuiltBatches = 0;
+            for (auto it = batches.begin(); it != batches.end(); ) {
+                Batch &batch = it->second;
+                if (!batch.dirty) {
+                    ++it;
+                    continue;
+                }
+                rebuiltBatches++;
+                if (batch.objects.empty()) {
+                    deleteBuffers(batch);
+                    it = batches.erase(it);
+                    continue;
+                }
+                build(batch, pool);
+                ++it;
+            }
+            rebuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // draws the batches inside the frustum, grouped by material. bindMaterial is
+        // called before the first batch of each material, the shader must be in use
+        // with an identity model matrix. returns the number of draw calls
+        int Draw(const glm::mat4 &viewProjection, const std::function<void(int material)> &bindMaterial) {
+            return Draw(Frustum(viewProjection), bindMaterial);
+        }
+
+        // the same with the planes already extracted, e.g. Camera::GetFrustum
+        int Draw(const Frustum &frustum, const std::function<void(int material)> &bindMaterial) {
+            std::vector<const Batch*> visible;
+            culledBatches = 0;
+            drawnObjects = 0;
+            for (const auto &entry : batches) {
+                const Batch &batch = entry.second;
+                if (batch.indexCount == 0) {
+                    continue;
+                }
+                if (!frustum.IntersectsBox(batch.boundsMin, batch.boundsMax)) {
+                    culledBatches++;
+                    continue;
+                }
+                visible.push_back(&batch);
+            }
+            std::sort(visible.begin(), visible.end(), [](const Batch *a, const Batch *b) {
+                return a->material < b->material;
+            });
+
+            drawCalls = 0;
+            int boundMaterial = 0;
+            for (const Batch *batch : visible) {
+                if (drawCalls == 0 || batch->material != boundMaterial) {
+                    boundMaterial = batch->material;
+                    if (bindMaterial) {
+                        bindMaterial(boundMaterial);
+                    }
+                }
+                glBindVertexArray(batch->vao);
+                glDrawElements(GL_TRIANGLES, batch->indexCount, GL_UNSIGNED_INT, (void *)0);
+                drawCalls++;
+                drawnObjects += batch->builtObjects;
+            }
+            glBindVertexArray(0);
+            unbatchedDrawCalls = (int)(objects.size() - freeIds.size());
+            return drawCalls;
+        }
+
+        StaticBatchStats Stats() const {
+            StaticBatchStats stats = {};
+            stats.objects = (int)(objects.size() - freeIds.size());
+            stats.batches = (int)batches.size();
+            stats.unbatchedDrawCalls = unbatchedDrawCalls;
+            stats.drawCalls = drawCalls;
+            stats.drawnObjects = drawnObjects;
+            stats.culledBatches = culledBatches;
+            stats.rebuiltBatches = rebuiltBatches;
+            stats.rebuildMilliseconds = rebuildMilliseconds;
+            for (const auto &entry : batches) {
+                stats.vertices += entry.second.vertexCount;
+                stats.gpuBytes += entry.second.vertexCount * MeshData::FLOATS_PER_VERTEX * sizeof(float)
+                                + (size_t)entry.second.indexCount * sizeof(unsigned int);
+            }
+            return stats;
+        }
+
+        // deletes the GL buffers, call before the context goes away
+        void Release() {
+            for (auto &entry : batches) {
+                deleteBuffers(entry.second);
+            }
+            batches.clear();
+            objects.clear();
+            freeIds.clear();
+        }
+
+    private:
+        struct BatchKey {
+            int x, y, z;
+            int material;
+
+            bool operator==(const BatchKey &other) const {
+                return x == other.x && y == other.y && z == other.z && material == other.material;
+            }
+        };
+
+        struct BatchKeyHash {
+            size_t operator()(const BatchKey &key) const {
+                return (size_t)hashBytes64(&key, sizeof(key));
+            }
+        };
+
+        struct Object {
+            std::shared_ptr<const MeshData> mesh;
+            glm::mat4 model;
+            int material = 0;
+            BatchKey key = BatchKey{ 0, 0, 0, 0 };
+            glm::vec3 boundsMin;
+            glm::vec3 boundsMax;
+            bool alive = false;
+        };
+
+        struct Batch {
+            std::vector<int> objects;
+            bool dirty = false;
+            int material = 0;
+            unsigned int vao = 0;
+            unsigned int vbo = 0;
+            unsigned int ebo = 0;
+            GLsizei indexCount = 0;
+            size_t vertexCount = 0;
+            int builtObjects = 0;
+            glm::vec3 boundsMin;
+            glm::vec3 boundsMax;
+        };
+
+        float chunkSize;
+        std::vector<Object> objects;
+        std::vector<int> freeIds;
+        std::unordered_map<BatchKey, Batch, BatchKeyHash> batches;
+
+        int unbatchedDrawCalls;
+        int drawCalls;
+        int drawnObjects;
+        int culledBatches;
+        int rebuiltBatches;
+        double rebuildMilliseconds;
+
+        void build(Batch &batch, ThreadPool &pool) {
+            // where every object's vertices and indices start in the merged buffers
+            const int count = (int)batch.objects.size();
+            std::vector<size_t> firstVertex(count + 1, 0);
+            std::vector<size_t> firstIndex(count + 1, 0);
+            batch.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+            batch.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+            for (int i = 0; i < count; i++) {
+                const Object &object = objects[batch.objects[i]];
+                firstVertex[i + 1] = firstVertex[i] + object.mesh->VertexCount();
+                firstIndex[i + 1] = firstIndex[i] + object.mesh->IndexCount();
+                batch.boundsMin = glm::min(batch.boundsMin, object.boundsMin);
+                batch.boundsMax = glm::max(batch.boundsMax, object.boundsMax);
+            }
+
+            std::vector<float> vertices(firstVertex[count] * MeshData::FLOATS_PER_VERTEX);
+            std::vector<unsigned int> indices(firstIndex[count]);
+            pool.ParallelFor(0, count, [&](int i) {
+                const Object &object = objects[batch.objects[i]];
+                const MeshData &mesh = *object.mesh;
+                float *dst = vertices.data() + firstVertex[i] * MeshData::FLOATS_PER_VERTEX;
+                for (size_t v = 0; v < mesh.VertexCount(); v++) {
+                    const float *src = mesh.vertices.data() + v * MeshData::FLOATS_PER_VERTEX;
+                    glm::vec4 world = object.model * glm::vec4(src[0], src[1], src[2], 1.0f);
+                    dst[0] = world.x;
+                    dst[1] = world.y;
+                    dst[2] = world.z;
+                    dst[3] = src[3];
+                    dst[4] = src[4];
+                    dst += MeshData::FLOATS_PER_VERTEX;
+                }
+                unsigned int base = (unsigned int)firstVertex[i];
+                unsigned int *out = indices.data() + firstIndex[i];
+                if (mesh.indices.empty()) {
+                    for (size_t k = 0; k < mesh.VertexCount(); k++) {
+                        out[k] = base + (unsigned int)k;
+                    }
+                } else {
+                    for (size_t k = 0; k < mesh.indices.size(); k++) {
+                        out[k] = base + mesh.indices[k];
+                    }
+                }
+            }, 16);
+
+            if (batch.vao == 0) {
+                glGenVertexArrays(1, &batch.vao);
+                glGenBuffers(1, &batch.vbo);
+                glGenBuffers(1, &batch.ebo);
+                glBindVertexArray(batch.vao);
+                glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ebo);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, MeshData::FLOATS_PER_VERTEX * sizeof(float), (void *)0);
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, MeshData::FLOATS_PER_VERTEX * sizeof(float), (void *)(3 * sizeof(float)));
+                glEnableVertexAttribArray(1);
+            } else {
+                glBindVertexArray(batch.vao);
+                glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+            }
+            // the element buffer binding is part of the vao state
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            batch.material = objects[batch.objects[0]].material;
+            batch.indexCount = (GLsizei)indices.size();
+            batch.vertexCount = firstVertex[count];
+            batch.builtObjects = count;
+            batch.dirty = false;
+        }
+
+        static void deleteBuffers(Batch &batch) {
+            if (batch.vao) {
+                glDeleteVertexArrays(1, &batch.vao);
+                glDeleteBuffers(1, &batch.vbo);
+                glDeleteBuffers(1, &batch.ebo);
+            }
+            batch.vao = batch.vbo = batch.ebo = 0;
+            batch.indexCount = 0;
+            batch.vertexCount = 0;
+        }
+};
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef VERTEX_PULLING_H
+#define VERTEX_PULLING_H
+
+#include <glad/glad.h>
+
+#include "geometry/mesh.h"
+#include "shader/shader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// the loader only knows 3.3, the storage buffer path needs these on 4.3 contexts
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+// where a mesh sits in the shared buffers, in vertices and indices
+struct PulledMesh {
+    int firstVertex;
+    int vertexCount;
+    int firstIndex;
+    int indexCount;
+};
+
+struct VertexPullStats {
+    int meshes;
+    size_t vertices;
+    size_t indices;
+    size_t gpuBytes;
+    // glDrawArrays calls and the meshes drawn by them since the last Stats
+    int drawCalls;
+    int drawnMeshes;
+};
+
+// vertex pulling: all meshes live in one vertex buffer and one index buffer that
+// the vertex shader reads itself, so there are no attribute formats, one empty
+// vao serves every mesh and switching meshes is only a different draw range.
+// on 3.3 the buffers are sampled as buffer textures (pulled.vert), with a 4.3
+// context as storage buffers (pulled_ssbo.vert). the index stream holds absolute
+// vertex numbers and gl_VertexID walks it from the draw's first index, so
+// meshes drawn with the same uniforms can be merged into one glMultiDrawArrays
+//
+//   int cube = pull.Add(mesh); pull.Upload();
+//   Shader shader(pull.VertexShaderPath(), "include/shader/shader.frag");
+//   pull.Bind(shader, 2, 3); per object: set model, pull.Draw(cube)
+class VertexPullBuffer {
+    public:
+        // a vertex is two vec4 texels: position and u, then v and padding
+        static const int FLOATS_PER_VERTEX = 8;
+
+        // allowStorageBuffers false keeps the 3.3 buffer texture path on newer contexts too
+        explicit VertexPullBuffer(bool allowStorageBuffers = true) : vao(0), vertexBuffer(0), indexBuffer(0), vertexTexture(0),
+                             indexTexture(0), vertexCapacity(0), indexCapacity(0), uploadedVertices(0), uploadedIndices(0),
+                             allowStorageBuffers(allowStorageBuffers), storageBuffers(false), checkedVersion(false), drawCalls(0),
+                             drawnMeshes(0) {}
+
+        ~VertexPullBuffer() {
+            Release();
+        }
+
+        VertexPullBuffer(const VertexPullBuffer&) = delete;
+        VertexPullBuffer& operator=(const VertexPullBuffer&) = delete;
+
+        // copies the mesh in, it reaches the GPU with the next Upload. returns the mesh id
+        int Add(const MeshData &mesh) {
+            PulledMesh placed;
+            placed.firstVertex = (int)(vertices.size() / FLOATS_PER_VERTEX);
+            placed.vertexCount = (int)mesh.VertexCount();
+            placed.firstIndex = (int)indices.size();
+            placed.indexCount = (int)mesh.IndexCount();
+            for (size_t v = 0; v < mesh.VertexCount(); v++) {
+                const float *src = mesh.vertices.data() + v * MeshData::FLOATS_PER_VERTEX;
+                vertices.insert(vertices.end(), { src[0], src[1], src[2], src[3], src[4], 0.0f, 0.0f, 0.0f });
+            }
+            for (size_t i = 0; i < mesh.IndexCount(); i++) {
+                unsigned int index = mesh.indices.empty() ? (unsigned int)i : mesh.indices[i];
+                indices.push_back((unsigned int)placed.firstVertex + index);
+            }
+            meshes.push_back(placed);
+            return (int)meshes.size() - 1;
+        }
+
+        // sends what was added since the last call, growing the buffers by doubling. needs the GL context
+        bool Upload() {
+            if (!checkedVersion) {
+                GLint major = 0, minor = 0;
+                glGetIntegerv(GL_MAJOR_VERSION, &major);
+                glGetIntegerv(GL_MINOR_VERSION, &minor);
+                storageBuffers = allowStorageBuffers && (major > 4 || (major == 4 && minor >= 3));
+                checkedVersion = true;
+            }
+            size_t vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+            if (!storageBuffers) {
+                // buffer textures are addressed in texels, 3.3 only promises 65536 of them
+                GLint maxTexels = 0;
+                glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+                if (vertexCount * 2 > (size_t)maxTexels || indices.size() > (size_t)maxTexels) {
+                    return false;
+                }
+            }
+            if (vao == 0) {
+                // core profile draws need a vao even without attributes
+                glGenVertexArrays(1, &vao);
+                glGenBuffers(1, &vertexBuffer);
+                glGenBuffers(1, &indexBuffer);
+                if (!storageBuffers) {
+                    glGenTextures(1, &vertexTexture);
+                    glGenTextures(1, &indexTexture);
+                }
+            }
+            grow(vertexBuffer, vertexCapacity, uploadedVertices * FLOATS_PER_VERTEX * sizeof(float),
+                 vertices.size() * sizeof(float), vertices.data());
+            grow(indexBuffer, indexCapacity, uploadedIndices * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+            uploadedVertices = vertexCount;
+            uploadedIndices = indices.size();
+            if (!storageBuffers) {
+                // the texture follows the buffer object, also after its storage was reallocated
+                glBindTexture(GL_TEXTURE_BUFFER, vertexTexture);
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, vertexBuffer);
+                glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+            }
+            return true;
+        }
+
+        // true once Upload found a 4.3 context, the shader must then be pulled_ssbo.vert
+        bool UsesStorageBuffers() const {
+            return storageBuffers;
+        }
+
+        // call after the first Upload
+        const char* VertexShaderPath() const {
+            return storageBuffers ? "include/shader/pulled_ssbo.vert" : "include/shader/pulled.vert";
+        }
+
+        const PulledMesh& Mesh(int id) const {
+            return meshes[id];
+        }
+
+        // binds the vao and the buffers. the texture units are only used on 3.3,
+        // the storage buffers take bindings 0 and 1
+        void Bind(const Shader &shader, int vertexUnit, int indexUnit) const {
+            glBindVertexArray(vao);
+            if (storageBuffers) {
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vertexBuffer);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, indexBuffer);
+                return;
+            }
+            glActiveTexture(GL_TEXTURE0 + vertexUnit);
+            glBindTexture(GL_TEXTURE_BUFFER, vertexTexture);
+            glActiveTexture(GL_TEXTURE0 + indexUnit);
+            glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+            shader.setInt("vpVertices", vertexUnit);
+            shader.setInt("vpIndices", indexUnit);
+        }
+
+        void Draw(int id) {
+            const PulledMesh &mesh = meshes[id];
+            glDrawArrays(GL_TRIANGLES, mesh.firstIndex, mesh.indexCount);
+            drawCalls++;
+            drawnMeshes++;
+        }
+
+        // draws meshes that share their uniforms with one call, ranges that touch are joined
+        void DrawMany(const std::vector<int> &ids) {
+            if (ids.empty()) {
+                return;
+            }
+            std::vector<int> order(ids);
+            std::sort(order.begin(), order.end(), [this](int a, int b) {
+                return meshes[a].firstIndex < meshes[b].firstIndex;
+            });
+            firsts.clear();
+            counts.clear();
+            for (int id : order) {
+                const PulledMesh &mesh = meshes[id];
+                if (!firsts.empty() && firsts.back() + counts.back() == mesh.firstIndex) {
+                    counts.back() += mesh.indexCount;
+                } else {
+                    firsts.push_back(mesh.firstIndex);
+                    counts.push_back(mesh.indexCount);
+                }
+            }
+            glMultiDrawArrays(GL_TRIANGLES, firsts.data(), counts.data(), (GLsizei)firsts.size());
+            drawCalls++;
+            drawnMeshes += (int)ids.size();
+        }
+
+        // resets the draw counters
+        VertexPullStats Stats() {
+            VertexPullStats stats = { (int)meshes.size(), uploadedVertices, uploadedIndices, vertexCapacity + indexCapacity,
+                                      drawCalls, drawnMeshes };
+            drawCalls = 0;
+            drawnMeshes = 0;
+            return stats;
+        }
+
+        // deletes the GL objects, call before the context goes away
+        void Release() {
+            if (vao) {
+                glDeleteVertexArrays(1, &vao);
+                glDeleteBuffers(1, &vertexBuffer);
+                glDeleteBuffers(1, &indexBuffer);
+            }
+            if (vertexTexture) {
+                glDeleteTextures(1, &vertexTexture);
+                glDeleteTextures(1, &indexTexture);
+            }
+            vao = vertexBuffer = indexBuffer = vertexTexture = indexTexture = 0;
+            vertexCapacity = indexCapacity = 0;
+            uploadedVertices = uploadedIndices = 0;
+        }
+
+    private:
+        unsigned int vao;
+        unsigned int vertexBuffer;
+        unsigned int indexBuffer;
+        unsigned int vertexTexture;
+        unsigned int indexTexture;
+        size_t vertexCapacity;
+        size_t indexCapacity;
+        size_t uploadedVertices;
+        size_t uploadedIndices;
+        bool allowStorageBuffers;
+        bool storageBuffers;
+        bool checkedVersion;
+        int drawCalls;
+        int drawnMeshes;
+
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<PulledMesh> meshes;
+        std::vector<GLint> firsts;
+        std::vector<GLsizei> counts;
+
+        // uploads bytes [uploaded, size) of data, or everything into a bigger buffer
+        static void grow(unsigned int buffer, size_t &capacity, size_t uploaded, size_t size, const void *data) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            if (size > capacity) {
+                capacity = std::max(size, capacity * 2);
+                glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+                uploaded = 0;
+            }
+            if (size > uploaded) {
+                glBufferSubData(GL_TEXTURE_BUFFER, uploaded, size - uploaded, (const unsigned char *)data + uploaded);
+            }
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+};
+
+#endif
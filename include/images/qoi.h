@@ -0,0 +1,326 @@
+#ifndef QOI_H
+#define QOI_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// QOI ("quite ok image") lossless codec, https://qoiformat.org/qoi-specification.pdf
+// decodes several times faster than png for ui and sprite textures at a similar
+// size, because every pixel is one byte oriented op instead of huffman + filters.
+// files are compatible with the reference encoder and decoder
+
+struct QoiImage {
+    int width = 0;
+    int height = 0;
+    // channels of `pixels`, 3 or 4
+    int channels = 0;
+    // channels stored in the file
+    int fileChannels = 0;
+    // 0 = sRGB with linear alpha, 1 = all channels linear. only informative
+    int colorspace = 0;
+    std::vector<unsigned char> pixels;
+};
+
+namespace qoi_detail {
+
+    const unsigned char OP_INDEX = 0x00;
+    const unsigned char OP_DIFF  = 0x40;
+    const unsigned char OP_LUMA  = 0x80;
+    const unsigned char OP_RUN   = 0xc0;
+    const unsigned char OP_RGB   = 0xfe;
+    const unsigned char OP_RGBA  = 0xff;
+    const unsigned char MASK_2   = 0xc0;
+
+    const int HEADER_SIZE = 14;
+    const unsigned char PADDING[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    // the spec limits images to 400 million pixels
+    const uint64_t PIXELS_MAX = 400000000;
+
+    // pixels are kept as r, g, b, a bytes in one word so copies are single moves
+    struct Rgba {
+        unsigned char r, g, b, a;
+    };
+
+    inline int hash(Rgba p) {
+        return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) & 63;
+    }
+
+    inline bool equal(Rgba x, Rgba y) {
+        uint32_t a, b;
+        memcpy(&a, &x, 4);
+        memcpy(&b, &y, 4);
+        return a == b;
+    }
+
+    inline uint32_t read32(const unsigned char *p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    inline void write32(std::vector<unsigned char> &out, uint32_t v) {
+        out.push_back((unsigned char)(v >> 24));
+        out.push_back((unsigned char)(v >> 16));
+        out.push_back((unsigned char)(v >> 8));
+        out.push_back((unsigned char)v);
+    }
+
+    inline void store(unsigned char *dst, Rgba p, int channels) {
+        if (channels == 4) {
+            memcpy(dst, &p, 4);
+        } else {
+            dst[0] = p.r;
+            dst[1] = p.g;
+            dst[2] = p.b;
+        }
+    }
+
+    // the decode loop with the channel count as a constant so the stores become
+    // plain 3 or 4 byte moves. `end` excludes the padding, so an op and its
+    // payload (at most 5 bytes) never read past the data
+    template <int CHANNELS>
+    bool decodePixels(const unsigned char *p, const unsigned char *end, unsigned char *out, size_t pixelCount, int rowStride,
+                      int rowBytes, int height, bool flip) {
+        Rgba index[64];
+        memset(index, 0, sizeof(index));
+        Rgba px = { 0, 0, 0, 255 };
+        int run = 0;
+        int y = 0;
+        unsigned char *row = out + (size_t)rowStride * (flip ? height - 1 : 0);
+        unsigned char *dst = row;
+        unsigned char *rowEnd = row + rowBytes;
+
+        for (size_t i = 0; i < pixelCount; ) {
+            if (run > 0) {
+                // runs are flat fills, do as many as fit in the row at once
+                size_t left = (size_t)(rowEnd - dst) / CHANNELS;
+                size_t n = (size_t)run < left ? (size_t)run : left;
+                if (CHANNELS == 4) {
+                    uint32_t word;
+                    memcpy(&word, &px, 4);
+                    for (size_t k = 0; k < n; k++) {
+                        memcpy(dst + k * 4, &word, 4);
+                    }
+                } else {
+                    for (size_t k = 0; k < n; k++) {
+                        store(dst + k * 3, px, 3);
+                    }
+                }
+                dst += n * CHANNELS;
+                run -= (int)n;
+                i += n;
+            } else {
+                if (p >= end) {
+                    return false;
+                }
+                int b1 = *p++;
+                if (b1 == OP_RGB) {
+                    px.r = p[0];
+                    px.g = p[1];
+                    px.b = p[2];
+                    p += 3;
+                } else if (b1 == OP_RGBA) {
+                    memcpy(&px, p, 4);
+                    p += 4;
+                } else if ((b1 & MASK_2) == OP_INDEX) {
+                    px = index[b1];
+                } else if ((b1 & MASK_2) == OP_DIFF) {
+                    px.r += ((b1 >> 4) & 0x03) - 2;
+                    px.g += ((b1 >> 2) & 0x03) - 2;
+                    px.b += (b1 & 0x03) - 2;
+                } else if ((b1 & MASK_2) == OP_LUMA) {
+                    int b2 = *p++;
+                    int vg = (b1 & 0x3f) - 32;
+                    px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                    px.g += vg;
+                    px.b += vg - 8 + (b2 & 0x0f);
+                } else {
+                    // OP_RUN, this pixel plus (b1 & 0x3f) repeats
+                    run = (b1 & 0x3f) + 1;
+                    index[hash(px)] = px;
+                    continue;
+                }
+                index[hash(px)] = px;
+                store(dst, px, CHANNELS);
+                dst += CHANNELS;
+                i++;
+            }
+
+            if (dst == rowEnd && ++y < height) {
+                row = out + (size_t)rowStride * (flip ? height - 1 - y : y);
+                dst = row;
+                rowEnd = row + rowBytes;
+            }
+        }
+        return true;
+    }
+
+}
+
+// reads width, height and channels from the header without decoding
+inline bool qoiInfo(const unsigned char *data, size_t size, int *width, int *height, int *channels) {
+    using namespace qoi_detail;
+    if (size < (size_t)HEADER_SIZE || memcmp(data, "qoif", 4) != 0) {
+        return false;
+    }
+    uint32_t w = read32(data + 4);
+    uint32_t h = read32(data + 8);
+    int c = data[12];
+    if (w == 0 || h == 0 || (c != 3 && c != 4) || data[13] > 1 || (uint64_t)w * h > PIXELS_MAX) {
+        return false;
+    }
+    *width = (int)w;
+    *height = (int)h;
+    *channels = c;
+    return true;
+}
+
+// decodes into caller memory, e.g. a mapped pixel buffer. desiredChannels 0 keeps
+// the file's channels. rowStride 0 means tightly packed rows
+inline bool qoiDecodeInto(const unsigned char *data, size_t size, unsigned char *out, size_t outSize, int rowStride,
+                          int desiredChannels, bool flipVertically = false) {
+    using namespace qoi_detail;
+    int width, height, fileChannels;
+    if (!qoiInfo(data, size, &width, &height, &fileChannels) || size < (size_t)HEADER_SIZE + sizeof(PADDING)) {
+        return false;
+    }
+    int channels = desiredChannels ? desiredChannels : fileChannels;
+    if (channels != 3 && channels != 4) {
+        return false;
+    }
+    int rowBytes = width * channels;
+    if (rowStride == 0) {
+        rowStride = rowBytes;
+    }
+    if (rowStride < rowBytes || (size_t)rowStride * (height - 1) + rowBytes > outSize) {
+        return false;
+    }
+    const unsigned char *begin = data + HEADER_SIZE;
+    const unsigned char *end = data + size - sizeof(PADDING);
+    size_t pixelCount = (size_t)width * height;
+    if (channels == 4) {
+        return decodePixels<4>(begin, end, out, pixelCount, rowStride, rowBytes, height, flipVertically);
+    }
+    return decodePixels<3>(begin, end, out, pixelCount, rowStride, rowBytes, height, flipVertically);
+}
+
+inline bool qoiDecode(const unsigned char *data, size_t size, QoiImage &image, int desiredChannels = 0, bool flipVertically = false) {
+    int width, height, fileChannels;
+    if (!qoiInfo(data, size, &width, &height, &fileChannels)) {
+        return false;
+    }
+    image.width = width;
+    image.height = height;
+    image.fileChannels = fileChannels;
+    image.channels = desiredChannels ? desiredChannels : fileChannels;
+    image.colorspace = data[13];
+    image.pixels.resize((size_t)width * height * image.channels);
+    return qoiDecodeInto(data, size, image.pixels.data(), image.pixels.size(), 0, image.channels, flipVertically);
+}
+
+// encodes 3 or 4 channel 8 bit pixels, rows top to bottom
+inline bool qoiEncode(const unsigned char *pixels, int width, int height, int channels, std::vector<unsigned char> &out,
+                      int colorspace = 0) {
+    using namespace qoi_detail;
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || (uint64_t)width * height > PIXELS_MAX) {
+        return false;
+    }
+    size_t pixelCount = (size_t)width * height;
+    out.clear();
+    // worst case is one 5 byte op per pixel
+    out.reserve(HEADER_SIZE + pixelCount * (channels + 1) + sizeof(PADDING));
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    write32(out, (uint32_t)width);
+    write32(out, (uint32_t)height);
+    out.push_back((unsigned char)channels);
+    out.push_back((unsigned char)colorspace);
+
+    Rgba index[64];
+    memset(index, 0, sizeof(index));
+    Rgba prev = { 0, 0, 0, 255 };
+    Rgba px = prev;
+    int run = 0;
+    const unsigned char *src = pixels;
+    for (size_t i = 0; i < pixelCount; i++, src += channels) {
+        px.r = src[0];
+        px.g = src[1];
+        px.b = src[2];
+        if (channels == 4) {
+            px.a = src[3];
+        }
+
+        if (equal(px, prev)) {
+            run++;
+            if (run == 62 || i == pixelCount - 1) {
+                out.push_back((unsigned char)(OP_RUN | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back((unsigned char)(OP_RUN | (run - 1)));
+            run = 0;
+        }
+
+        int slot = hash(px);
+        if (equal(index[slot], px)) {
+            out.push_back((unsigned char)(OP_INDEX | slot));
+        } else {
+            index[slot] = px;
+            if (px.a == prev.a) {
+                signed char vr = (signed char)(px.r - prev.r);
+                signed char vg = (signed char)(px.g - prev.g);
+                signed char vb = (signed char)(px.b - prev.b);
+                signed char vgr = (signed char)(vr - vg);
+                signed char vgb = (signed char)(vb - vg);
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    out.push_back((unsigned char)(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+                } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                    out.push_back((unsigned char)(OP_LUMA | (vg + 32)));
+                    out.push_back((unsigned char)((vgr + 8) << 4 | (vgb + 8)));
+                } else {
+                    out.insert(out.end(), { OP_RGB, px.r, px.g, px.b });
+                }
+            } else {
+                out.insert(out.end(), { OP_RGBA, px.r, px.g, px.b, px.a });
+            }
+        }
+        prev = px;
+    }
+    out.insert(out.end(), PADDING, PADDING + sizeof(PADDING));
+    return true;
+}
+
+inline bool qoiRead(const std::string &path, QoiImage &image, int desiredChannels = 0, bool flipVertically = false) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<unsigned char> data;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        if (size > 0) {
+            data.resize((size_t)size);
+            fseek(file, 0, SEEK_SET);
+            data.resize(fread(data.data(), 1, data.size(), file));
+        }
+    }
+    fclose(file);
+    return qoiDecode(data.data(), data.size(), image, desiredChannels, flipVertically);
+}
+
+inline bool qoiWrite(const std::string &path, const unsigned char *pixels, int width, int height, int channels, int colorspace = 0) {
+    std::vector<unsigned char> encoded;
+    if (!qoiEncode(pixels, width, height, channels, encoded, colorspace)) {
+        return false;
+    }
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    return fclose(file) == 0 && written;
+}
+
+#endif
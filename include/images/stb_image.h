@@ -270,6 +270,18 @@ RECENT REVISION HISTORY:
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On top of SSE2, the JPEG IDCT, YCbCr conversion and chroma upsampling
+// have AVX2 versions that are picked by a run-time CPUID test. They give
+// bit-identical results to the SSE2 and generic C versions. Define
+// STBI_NO_AVX2 to leave them out; stbi_set_simd_level() restricts the
+// kernels at run time.
+//
+// PNG rows with 8-bit RGB or RGBA pixels are unfiltered with SSE2 (and
+// AVX2 for the up and sub filters), and on little-endian targets zlib
+// inflate uses a 64-bit bit buffer that decodes two literals per table
+// lookup where it can; define STBI_NO_ZFAST_LOOP to leave that out.
+// STBI_SIMD_NONE turns both off and gives the original decoder.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
@@ -433,6 +445,16 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
 
+// decode into memory owned by the caller, e.g. a mapped pixel buffer object.
+// rows are out_stride bytes apart (0 = tightly packed) and out_size must hold
+// all of them; get the size first with stbi_info. returns 1 on success.
+// JPEG is written straight into `out`, other formats are decoded to a
+// temporary buffer first and copied row by row
+STBIDEF int      stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+#ifndef STBI_NO_STDIO
+STBIDEF int      stbi_load_into           (char const *filename, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -524,6 +546,19 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// limit the SIMD kernels the decoders may pick, for benchmarking and for checking
+// the kernels against each other. STBI_SIMD_AUTO (the default) uses the best the
+// cpu supports, asking for more than the cpu supports falls back to what it has
+enum
+{
+   STBI_SIMD_AUTO = 0,
+   STBI_SIMD_NONE = 1,
+   STBI_SIMD_SSE2 = 2,
+   STBI_SIMD_AVX2 = 3
+};
+
+STBIDEF void stbi_set_simd_level(int level);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -774,6 +809,39 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels sit on top of the SSE2 ones and are only used after a runtime
+// check, so the rest of the program does not need to be built with -mavx2.
+// gcc/clang compile the individual functions with a target attribute.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && \
+    (defined(_MSC_VER) && _MSC_VER >= 1700 || defined(__clang__) || \
+     (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,0);
+   if (info[0] < 7) return 0;
+   __cpuid(info,1);
+   // OSXSAVE and AVX, then make sure the OS saves the ymm registers
+   if ((info[2] & (3 << 27)) != (3 << 27)) return 0;
+   if ((_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return (info[1] >> 5) & 1;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   // also checks that the OS saves the ymm registers
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -817,6 +885,11 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // caller owned output for stbi_load_*_into, used by decoders that support it
+   stbi_uc *into;
+   size_t into_size;
+   int into_stride;
 } stbi__context;
 
 
@@ -828,6 +901,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->io.read = NULL;
    s->read_from_callbacks = 0;
    s->callback_already_read = 0;
+   s->into = NULL;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
 }
@@ -840,6 +914,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
+   s->into = NULL;
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
@@ -1111,6 +1186,16 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
+static int stbi__simd_level = STBI_SIMD_AUTO;
+
+STBIDEF void stbi_set_simd_level(int level)
+{
+   stbi__simd_level = level;
+}
+
+#define stbi__simd_allows_sse2()  (stbi__simd_level != STBI_SIMD_NONE)
+#define stbi__simd_allows_avx2()  (stbi__simd_level == STBI_SIMD_AUTO || stbi__simd_level == STBI_SIMD_AVX2)
+
 static int stbi__vertically_flip_on_load_global = 0;
 
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
@@ -1320,6 +1405,46 @@ static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, in
 }
 #endif
 
+static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp);
+
+// w, h and n come from stbi__info_main on a separate context over the same data
+static int stbi__load_into(stbi__context *s, stbi_uc *out, size_t out_size, int out_stride, int w, int h, int n,
+                           int *x, int *y, int *comp, int req_comp)
+{
+   stbi_uc *result;
+   int j, row_bytes, channels = req_comp ? req_comp : n;
+
+   if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   if (!stbi__mad2sizes_valid(w, channels, 0)) return stbi__err("too large", "Image too large to decode");
+   row_bytes = w * channels;
+   if (out_stride == 0) out_stride = row_bytes;
+   if (out_stride < row_bytes || (size_t) out_stride * (h - 1) + row_bytes > out_size)
+      return stbi__err("buffer too small", "Output buffer too small");
+
+   #ifndef STBI_NO_JPEG
+   if (stbi__jpeg_test(s)) {
+      stbi__result_info ri;
+      s->into = out;
+      s->into_size = out_size;
+      s->into_stride = out_stride;
+      result = (stbi_uc *) stbi__jpeg_load(s, x, y, comp, req_comp, &ri);
+      s->into = NULL;
+      return result != NULL;
+   }
+   #endif
+
+   result = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+   if (result == NULL) return 0;
+   if (*x != w || *y != h) {
+      STBI_FREE(result);
+      return stbi__err("size changed", "Corrupt image");
+   }
+   for (j=0; j < h; ++j)
+      memcpy(out + (size_t) out_stride * j, result + (size_t) row_bytes * j, row_bytes);
+   STBI_FREE(result);
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
 
 #if defined(_WIN32) && defined(STBI_WINDOWS_UTF8)
@@ -1409,6 +1534,23 @@ STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, i
    return result;
 }
 
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   int w, h, n, result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__info_main(&s,&w,&h,&n);
+   if (result) {
+      fseek(f,0,SEEK_SET);
+      stbi__start_file(&s,f);
+      result = stbi__load_into(&s,out,out_size,out_stride,w,h,n,x,y,comp,req_comp);
+   }
+   fclose(f);
+   return result;
+}
+
 
 #endif //!STBI_NO_STDIO
 
@@ -1440,6 +1582,16 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   int w, h, n;
+   stbi__start_mem(&s,buffer,len);
+   if (!stbi__info_main(&s,&w,&h,&n)) return 0;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into(&s,out,out_size,out_stride,w,h,n,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -2704,6 +2856,173 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT. same arithmetic as the sse2 version, so results are
+// bit-identical, but every 32-bit intermediate row lives in one ymm register
+// instead of a lo/hi pair of xmm registers, which halves the multiply-adds,
+// adds and shifts. the transposes stay 128-bit.
+STBI__AVX2_TARGET static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   // the x/y pairs of all 8 columns go in one register, in column order
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         /* packs works per lane: sum0-3 dif0-3 | sum4-7 dif4-7, put the qwords back in order */ \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -3643,6 +3962,82 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2_simd, 16 input pixels per iteration
+STBI__AVX2_TARGET static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   // as in the sse2 version the last pixel of the row is left to the scalar
+   // tail because of the filter boundary conditions
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical filtering pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // "prev"/"next" are the current row shifted by one pixel. alignr only
+      // shifts within 128-bit lanes, so feed it the neighbouring lane.
+      __m256i prvc = _mm256_permute2x128_si256(curr, curr, 0x08); // 0 | curr.lo
+      __m256i nxtc = _mm256_permute2x128_si256(curr, curr, 0x81); // curr.hi | 0
+      __m256i prv0 = _mm256_alignr_epi8(curr, prvc, 14);
+      __m256i nxt0 = _mm256_alignr_epi8(nxtc, curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal filter, polyphase implementation since it's convenient:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      // note the shared term.
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, then undo scaling. the per-lane
+      // unpacks and pack cancel out, so the bytes come out in order
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+
+      // pack and write output
+      __m256i outv = _mm256_packus_epi16(de0, de1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3817,6 +4212,122 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// same fixed-point math as stbi__YCbCr_to_RGB_simd on 16 pixels at a time.
+// unlike the sse2 version this also handles step == 3, which is what a
+// plain stbi_load(..., 0) of a colour jpeg uses
+STBI__AVX2_TARGET static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4 || step == 3) {
+      __m256i signflip  = _mm256_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi8((char) (unsigned char) 128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      // byte shuffles that interleave 16 r, g and b values into 48 bytes of rgb
+      __m128i rgb_r0 = _mm_setr_epi8( 0,-1,-1, 1,-1,-1, 2,-1,-1, 3,-1,-1, 4,-1,-1, 5);
+      __m128i rgb_g0 = _mm_setr_epi8(-1, 0,-1,-1, 1,-1,-1, 2,-1,-1, 3,-1,-1, 4,-1,-1);
+      __m128i rgb_b0 = _mm_setr_epi8(-1,-1, 0,-1,-1, 1,-1,-1, 2,-1,-1, 3,-1,-1, 4,-1);
+      __m128i rgb_r1 = _mm_setr_epi8(-1,-1, 6,-1,-1, 7,-1,-1, 8,-1,-1, 9,-1,-1,10,-1);
+      __m128i rgb_g1 = _mm_setr_epi8( 5,-1,-1, 6,-1,-1, 7,-1,-1, 8,-1,-1, 9,-1,-1,10);
+      __m128i rgb_b1 = _mm_setr_epi8(-1, 5,-1,-1, 6,-1,-1, 7,-1,-1, 8,-1,-1, 9,-1,-1);
+      __m128i rgb_r2 = _mm_setr_epi8(-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1,-1);
+      __m128i rgb_g2 = _mm_setr_epi8(-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1);
+      __m128i rgb_b2 = _mm_setr_epi8(10,-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15);
+
+      for (; i+15 < count; i += 16) {
+         // load 16 bytes each and put 8 in the low half of each 128-bit lane,
+         // so the per-lane unpacks see pixels 0-7 and 8-15
+         __m256i y_bytes  = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *) (y+i))), 0x10);
+         __m256i cr_bytes = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *) (pcr+i))), 0x10);
+         __m256i cb_bytes = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *) (pcb+i))), 0x10);
+         __m256i cr_biased = _mm256_xor_si256(cr_bytes, signflip); // -128
+         __m256i cb_biased = _mm256_xor_si256(cb_bytes, signflip); // -128
+
+         // unpack to short (and left-shift cr, cb by 8)
+         __m256i yw  = _mm256_unpacklo_epi8(y_bias, y_bytes);
+         __m256i crw = _mm256_unpacklo_epi8(_mm256_setzero_si256(), cr_biased);
+         __m256i cbw = _mm256_unpacklo_epi8(_mm256_setzero_si256(), cb_biased);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte: lane 0 holds r0-7 b0-7 / g0-7 x, lane 1 r8-15 b8-15 / g8-15 x
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         if (step == 4) {
+            // transpose to interleave channels, each lane gives 8 pixels
+            __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+            __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+            __m256i o0 = _mm256_unpacklo_epi16(t0, t1); // pixels 0-3 | 8-11
+            __m256i o1 = _mm256_unpackhi_epi16(t0, t1); // pixels 4-7 | 12-15
+
+            // store
+            _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+            _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+            out += 64;
+         } else {
+            // gather each channel into 16 contiguous bytes, then shuffle into rgb triples
+            __m256i rb = _mm256_permute4x64_epi64(brb, 0xd8); // r0-15 | b0-15
+            __m256i gx = _mm256_permute4x64_epi64(gxb, 0xd8); // g0-15 | x
+            __m128i r = _mm256_castsi256_si128(rb);
+            __m128i b = _mm256_extracti128_si256(rb, 1);
+            __m128i g = _mm256_castsi256_si128(gx);
+            __m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, rgb_r0), _mm_shuffle_epi8(g, rgb_g0)), _mm_shuffle_epi8(b, rgb_b0));
+            __m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, rgb_r1), _mm_shuffle_epi8(g, rgb_g1)), _mm_shuffle_epi8(b, rgb_b1));
+            __m128i o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, rgb_r2), _mm_shuffle_epi8(g, rgb_g2)), _mm_shuffle_epi8(b, rgb_b2));
+
+            // store
+            _mm_storeu_si128((__m128i *) (out + 0), o0);
+            _mm_storeu_si128((__m128i *) (out + 16), o1);
+            _mm_storeu_si128((__m128i *) (out + 32), o2);
+            out += 48;
+         }
+      }
+   }
+
+   for (; i < count; ++i) {
+      int y_fixed = (y[i] << 20) + (1<<19); // rounding
+      int r,g,b;
+      int cr = pcr[i] - 128;
+      int cb = pcb[i] - 128;
+      r = y_fixed + cr* stbi__float2fixed(1.40200f);
+      g = y_fixed + cr*-stbi__float2fixed(0.71414f) + ((cb*-stbi__float2fixed(0.34414f)) & 0xffff0000);
+      b = y_fixed                                   +   cb* stbi__float2fixed(1.77200f);
+      r >>= 20;
+      g >>= 20;
+      b >>= 20;
+      if ((unsigned) r > 255) { if (r < 0) r = 0; else r = 255; }
+      if ((unsigned) g > 255) { if (g < 0) g = 0; else g = 255; }
+      if ((unsigned) b > 255) { if (b < 0) b = 0; else b = 255; }
+      out[0] = (stbi_uc)r;
+      out[1] = (stbi_uc)g;
+      out[2] = (stbi_uc)b;
+      out[3] = 255;
+      out += step;
+   }
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3825,17 +4336,27 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
 #ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
+   if (stbi__simd_allows_sse2() && stbi__sse2_available()) {
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__simd_allows_avx2() && stbi__avx2_available()) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
-   j->idct_block_kernel = stbi__idct_simd;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+   if (stbi__simd_allows_sse2()) {
+      j->idct_block_kernel = stbi__idct_simd;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+   }
 #endif
 }
 
@@ -3893,6 +4414,8 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       unsigned int i,j;
       stbi_uc *output;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      int stride, flip = 0;
+      stbi_uc *rowbuf = NULL;
 
       stbi__resample res_comp[4];
 
@@ -3918,13 +4441,34 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      if (z->s->into) {
+         // rows go straight to the caller's buffer, flipped here instead of afterwards
+         stride = z->s->into_stride ? z->s->into_stride : n * (int) z->s->img_x;
+         if (stride < n * (int) z->s->img_x || (size_t) stride * (z->s->img_y - 1) + n * z->s->img_x > z->s->into_size) {
+            stbi__cleanup_jpeg(z);
+            return stbi__errpuc("buffer too small", "Output buffer too small");
+         }
+         output = z->s->into;
+         flip = stbi__vertically_flip_on_load;
+         // the 3 channel loops store a 4th byte after each pixel. rows where that
+         // byte is past the buffer or on a finished row are converted in rowbuf
+         if (n == 3) {
+            rowbuf = (stbi_uc *) stbi__malloc(n * z->s->img_x + 1);
+            if (!rowbuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         }
+      } else {
+         // can't error after this so, this is safe
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         stride = n * z->s->img_x;
+      }
 
       // now go ahead and resample
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         stbi_uc *dest = output + (size_t) stride * (flip ? z->s->img_y - 1 - j : j);
+         int via_rowbuf = rowbuf && ((size_t) (dest - output) + n * z->s->img_x >= z->s->into_size ||
+                                     (flip && stride == n * (int) z->s->img_x));
+         stbi_uc *out = via_rowbuf ? rowbuf : dest;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -4016,7 +4560,10 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
             }
          }
+         if (via_rowbuf)
+            memcpy(dest, rowbuf, n * z->s->img_x);
       }
+      STBI_FREE(rowbuf);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -4092,6 +4639,15 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// the wide inflate loop reads 8 input bytes at a time as one little-endian word
+#if !defined(STBI_NO_ZFAST_LOOP) && (defined(STBI__X64_TARGET) || defined(STBI__X86_TARGET) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__))
+#define STBI__ZFAST_LOOP
+#define STBI__ZMULTI_BITS  11 // literal pairs are looked up with this many bits
+#define STBI__ZMULTI_MASK  ((1 << STBI__ZMULTI_BITS) - 1)
+typedef unsigned long long stbi__uint64;
+#endif
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4187,6 +4743,11 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+#ifdef STBI__ZFAST_LOOP
+   // one lookup decodes one or two literals: bits 0-7 first literal, 8-15
+   // second literal, 16-19 bits used, 20-21 literal count. 0 = not literals
+   stbi__uint32 z_multi[1 << STBI__ZMULTI_BITS];
+#endif
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4306,9 +4867,165 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
-static int stbi__parse_huffman_block(stbi__zbuf *a)
+#ifdef STBI__ZFAST_LOOP
+// literal/length table that resolves up to two literals per lookup, built
+// from the 9-bit fast table whenever z_length changes
+static void stbi__zbuild_multi(stbi__zbuf *a)
+{
+   const stbi__uint16 *fast = a->z_length.fast;
+   int j;
+   for (j=0; j < (1 << STBI__ZMULTI_BITS); ++j) {
+      int e1 = fast[j & STBI__ZFAST_MASK];
+      int e2, s1, s2;
+      a->z_multi[j] = 0;
+      if (!e1 || (e1 & 511) >= 256) continue;
+      s1 = e1 >> 9;
+      // the bits after the first code only decide the second one if it fits
+      e2 = fast[(j >> s1) & STBI__ZFAST_MASK];
+      s2 = e2 >> 9;
+      if (e2 && (e2 & 511) < 256 && s1 + s2 <= STBI__ZMULTI_BITS)
+         a->z_multi[j] = (2u << 20) | ((stbi__uint32) (s1 + s2) << 16) | ((stbi__uint32) (e2 & 255) << 8) | (stbi__uint32) (e1 & 255);
+      else
+         a->z_multi[j] = (1u << 20) | ((stbi__uint32) s1 << 16) | (stbi__uint32) (e1 & 255);
+   }
+}
+
+// stbi__zhuffman_decode on the 64-bit buffer of the fast loop
+stbi_inline static int stbi__zhuffman_decode64(stbi__zhuffman *z, stbi__uint64 *bits, int *num_bits)
 {
+   int b,s,k;
+   b = z->fast[*bits & STBI__ZFAST_MASK];
+   if (b) {
+      s = b >> 9;
+      *bits >>= s;
+      *num_bits -= s;
+      return b & 511;
+   }
+   k = stbi__bit_reverse((int) (*bits & 0xffff), 16);
+   for (s=STBI__ZFAST_BITS+1; ; ++s)
+      if (k < z->maxcode[s])
+         break;
+   if (s >= 16) return -1; // invalid code!
+   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
+   if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
+   if (z->size[b] != s) return -1;
+   *bits >>= s;
+   *num_bits -= s;
+   return z->value[b];
+}
+
+// fast path of stbi__parse_huffman_block for expandable output buffers.
+// the bit buffer is 64 bits wide and refilled with one unaligned 8 byte load,
+// which always leaves at least 56 bits: enough for the longest length plus
+// distance code with their extra bits, so there is one refill per symbol.
+// literal pairs come from z_multi, matches are copied 8 bytes at a time.
+// stops when fewer than 8 input bytes remain and hands the rest to the
+// careful loop. returns 1 at the end of the block, 0 to continue in the
+// careful loop, -1 on error
+static int stbi__parse_huffman_fast(stbi__zbuf *a)
+{
+   stbi__uint64 bits = a->code_buffer;
+   int num_bits = a->num_bits;
+   stbi_uc *in = a->zbuffer;
    char *zout = a->zout;
+   int result = 0;
+
+   while (a->zbuffer_end - in >= 8) {
+      stbi__uint64 word;
+      stbi__uint32 m;
+      int z,len,dist,e;
+      stbi_uc *p;
+
+      // room for the longest match plus the copy overshoot
+      if (a->zout_end - zout < 258 + 8) {
+         if (!stbi__zexpand(a, zout, 258 + 8)) { result = -1; break; }
+         zout = a->zout;
+      }
+
+      memcpy(&word, in, 8);
+      bits |= word << num_bits;
+      in += (63 - num_bits) >> 3;
+      num_bits |= 56;
+
+      m = a->z_multi[bits & STBI__ZMULTI_MASK];
+      if (m) {
+         zout[0] = (char) (m & 255);
+         zout[1] = (char) ((m >> 8) & 255);
+         zout += m >> 20;
+         bits >>= (m >> 16) & 15;
+         num_bits -= (m >> 16) & 15;
+         continue;
+      }
+
+      z = stbi__zhuffman_decode64(&a->z_length, &bits, &num_bits);
+      if (z < 256) {
+         if (z < 0) { stbi__err("bad huffman code","Corrupt PNG"); result = -1; break; }
+         *zout++ = (char) z;
+         continue;
+      }
+      if (z == 256) { result = 1; break; }
+      if (z >= 286) { stbi__err("bad huffman code","Corrupt PNG"); result = -1; break; }
+      z -= 257;
+      len = stbi__zlength_base[z];
+      e = stbi__zlength_extra[z];
+      if (e) {
+         len += (int) (bits & ((1u << e) - 1));
+         bits >>= e;
+         num_bits -= e;
+      }
+      z = stbi__zhuffman_decode64(&a->z_distance, &bits, &num_bits);
+      if (z < 0 || z >= 30) { stbi__err("bad huffman code","Corrupt PNG"); result = -1; break; }
+      dist = stbi__zdist_base[z];
+      e = stbi__zdist_extra[z];
+      if (e) {
+         dist += (int) (bits & ((1u << e) - 1));
+         bits >>= e;
+         num_bits -= e;
+      }
+      if (zout - a->zout_start < dist) { stbi__err("bad dist","Corrupt PNG"); result = -1; break; }
+
+      p = (stbi_uc *) (zout - dist);
+      if (dist >= 8) {
+         // 8 byte chunks never overlap their own source, may write up to 7 bytes past len
+         char *end = zout + len;
+         do {
+            memcpy(zout, p, 8);
+            zout += 8;
+            p += 8;
+         } while (zout < end);
+         zout = end;
+      } else if (dist == 1) { // run of one byte; common in images.
+         memset(zout, *p, len);
+         zout += len;
+      } else {
+         do *zout++ = *p++; while (--len);
+      }
+   }
+
+   // back to the 32-bit state of the careful loop: return the whole bytes that
+   // don't fit. they are the most recently read ones, at the top of the buffer
+   while (num_bits > 32) {
+      num_bits -= 8;
+      --in;
+   }
+   a->code_buffer = (stbi__uint32) (bits & ((((stbi__uint64) 1) << num_bits) - 1));
+   a->num_bits = num_bits;
+   a->zbuffer = in;
+   a->zout = zout;
+   return result;
+}
+#endif
+
+static int stbi__parse_huffman_block(stbi__zbuf *a)
+{
+   char *zout;
+#ifdef STBI__ZFAST_LOOP
+   if (a->z_expandable && !a->hit_zeof_once && stbi__simd_allows_sse2()) {
+      int r = stbi__parse_huffman_fast(a);
+      if (r != 0) return r > 0;
+   }
+#endif
+   zout = a->zout;
    for(;;) {
       int z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
@@ -4501,6 +5218,9 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
+#ifdef STBI__ZFAST_LOOP
+         stbi__zbuild_multi(a);
+#endif
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
@@ -4669,6 +5389,192 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// SIMD versions of the 8-bit RGB/RGBA filters. sub is done as a prefix sum over
+// the pixels of one register, avg and paeth depend on the pixel just decoded so
+// they go one pixel at a time with all channels in parallel. all of them give
+// exactly the same bytes as the scalar loops. these always do the whole row,
+// stbi__unfilter_row_simd returns 0 for pixels that aren't 3 or 4 bytes and the
+// scalar loops take those rows. bpp is a constant 3 or 4 at every call so the
+// pixel copies inline
+stbi_inline static void stbi__unfilter_avg_simd(stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int nk, int bpp)
+{
+   __m128i one = _mm_set1_epi8(1);
+   __m128i a;
+   stbi__uint32 left = 0;
+   int k;
+   for (k = 0; k < bpp; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
+   memcpy(&left, cur, bpp);
+   a = _mm_cvtsi32_si128((int) left);
+   for (k = bpp; k < nk; k += bpp) {
+      stbi__uint32 rb = 0, bb = 0, out;
+      __m128i b, avg;
+      // whole 4 byte words where the row has room, the 4th channel of a 3 byte
+      // pixel is junk that stays in its own lane and is overwritten by the next store
+      int wide = bpp == 4 || k+4 <= nk;
+      if (wide) { memcpy(&rb, raw + k, 4); memcpy(&bb, prior + k, 4); }
+      else      { memcpy(&rb, raw + k, 3); memcpy(&bb, prior + k, 3); }
+      b = _mm_cvtsi32_si128((int) bb);
+      // pavgb rounds up, subtract the lost low bit to get (a+b)>>1
+      avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(avg, _mm_cvtsi32_si128((int) rb));
+      out = (stbi__uint32) _mm_cvtsi128_si32(a);
+      if (wide) memcpy(cur + k, &out, 4);
+      else      memcpy(cur + k, &out, 3);
+   }
+}
+
+stbi_inline static void stbi__unfilter_paeth_simd(stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i mask = _mm_set1_epi16(0xff);
+   __m128i a, c;
+   stbi__uint32 left = 0;
+   int k;
+   for (k = 0; k < bpp; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+   memcpy(&left, cur, bpp);
+   a = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) left), zero);
+   memcpy(&left, prior, bpp);
+   c = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) left), zero);
+   for (k = bpp; k < nk; k += bpp) {
+      stbi__uint32 rb = 0, bb = 0, out;
+      __m128i b, c3, ab, lo, hi, thresh, t0, pred, t;
+      // whole 4 byte words where the row has room, the 4th channel of a 3 byte
+      // pixel is junk that stays in its own lane and is overwritten by the next store
+      int wide = bpp == 4 || k+4 <= nk;
+      if (wide) { memcpy(&rb, raw + k, 4); memcpy(&bb, prior + k, 4); }
+      else      { memcpy(&rb, raw + k, 3); memcpy(&bb, prior + k, 3); }
+      b = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) bb), zero);
+      // same branch free formulation as stbi__paeth, in 16 bits. only the
+      // adds, min/max and compares wait for a
+      c3 = _mm_add_epi16(c, _mm_add_epi16(c, c));
+      ab = _mm_add_epi16(a, b);
+      lo = _mm_min_epi16(a, b);
+      hi = _mm_max_epi16(a, b);
+      thresh = _mm_sub_epi16(c3, ab);
+      t0 = _mm_cmpgt_epi16(hi, thresh); // hi > thresh picks c
+      t0 = _mm_or_si128(_mm_and_si128(t0, c), _mm_andnot_si128(t0, lo));
+      t = _mm_cmpgt_epi16(thresh, lo);  // thresh > lo keeps t0
+      pred = _mm_or_si128(_mm_and_si128(t, t0), _mm_andnot_si128(t, hi));
+      // add mod 256 without leaving 16 bits, a is needed again right away
+      a = _mm_and_si128(_mm_add_epi16(pred, _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) rb), zero)), mask);
+      out = (stbi__uint32) _mm_cvtsi128_si32(_mm_packus_epi16(a, a));
+      if (wide) memcpy(cur + k, &out, 4);
+      else      memcpy(cur + k, &out, 3);
+      c = b;
+   }
+}
+
+static int stbi__unfilter_row_simd(int filter, stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int nk, int filter_bytes)
+{
+   int k = filter_bytes;
+   stbi__uint32 left = 0;
+
+   if (filter_bytes != 3 && filter_bytes != 4) return 0;
+
+   switch (filter) {
+   case STBI__F_sub:
+      memcpy(cur, raw, filter_bytes);
+      memcpy(&left, cur, filter_bytes);
+      if (filter_bytes == 4) {
+         __m128i last = _mm_shuffle_epi32(_mm_cvtsi32_si128((int) left), 0x00);
+         for (; k+16 <= nk; k += 16) {
+            __m128i x = _mm_loadu_si128((__m128i *) (raw + k));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi8(x, last);
+            _mm_storeu_si128((__m128i *) (cur + k), x);
+            last = _mm_shuffle_epi32(x, 0xff);
+         }
+      } else {
+         // 4 pixels per step. the last one is moved to bytes 0..2 and repeated
+         // to form the carry for the next step
+         __m128i last = _mm_cvtsi32_si128((int) left);
+         last = _mm_or_si128(last, _mm_slli_si128(last, 3));
+         last = _mm_or_si128(last, _mm_slli_si128(last, 6));
+         for (; k+16 <= nk; k += 12) {
+            __m128i x = _mm_loadu_si128((__m128i *) (raw + k));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+            x = _mm_add_epi8(x, last);
+            _mm_storeu_si128((__m128i *) (cur + k), x);
+            last = _mm_srli_si128(_mm_slli_si128(x, 4), 13);
+            last = _mm_or_si128(last, _mm_slli_si128(last, 3));
+            last = _mm_or_si128(last, _mm_slli_si128(last, 6));
+         }
+      }
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
+      return 1;
+
+   case STBI__F_up:
+      for (k = 0; k+16 <= nk; k += 16) {
+         __m128i x = _mm_loadu_si128((__m128i *) (raw + k));
+         __m128i b = _mm_loadu_si128((__m128i *) (prior + k));
+         _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(x, b));
+      }
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+
+   case STBI__F_avg:
+      if (filter_bytes == 4) stbi__unfilter_avg_simd(cur, prior, raw, nk, 4);
+      else                   stbi__unfilter_avg_simd(cur, prior, raw, nk, 3);
+      return 1;
+
+   case STBI__F_paeth:
+      if (filter_bytes == 4) stbi__unfilter_paeth_simd(cur, prior, raw, nk, 4);
+      else                   stbi__unfilter_paeth_simd(cur, prior, raw, nk, 3);
+      return 1;
+   }
+   return 0;
+}
+#endif
+
+#ifdef STBI_AVX2
+// 32 byte versions of up and 4 channel sub. sub adds the prefix sums of the two
+// 128-bit lanes separately, then carries the last pixel of the low lane over
+STBI__AVX2_TARGET static int stbi__unfilter_row_avx2(int filter, stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int nk, int filter_bytes)
+{
+   int k;
+   if (filter == STBI__F_up) {
+      for (k = 0; k+32 <= nk; k += 32) {
+         __m256i x = _mm256_loadu_si256((__m256i *) (raw + k));
+         __m256i b = _mm256_loadu_si256((__m256i *) (prior + k));
+         _mm256_storeu_si256((__m256i *) (cur + k), _mm256_add_epi8(x, b));
+      }
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+   if (filter == STBI__F_sub && filter_bytes == 4) {
+      __m256i seven = _mm256_set1_epi32(7);
+      stbi__uint32 left;
+      __m256i last;
+      memcpy(cur, raw, 4);
+      memcpy(&left, cur, 4);
+      last = _mm256_set1_epi32((int) left);
+      for (k = 4; k+32 <= nk; k += 32) {
+         __m256i x = _mm256_loadu_si256((__m256i *) (raw + k));
+         __m256i carry;
+         x = _mm256_add_epi8(x, _mm256_slli_si256(x, 4));
+         x = _mm256_add_epi8(x, _mm256_slli_si256(x, 8));
+         carry = _mm256_shuffle_epi32(x, 0xff);
+         x = _mm256_add_epi8(x, _mm256_permute2x128_si256(carry, carry, 0x08));
+         x = _mm256_add_epi8(x, last);
+         _mm256_storeu_si256((__m256i *) (cur + k), x);
+         last = _mm256_permutevar8x32_epi32(x, seven);
+      }
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + cur[k-4]);
+      return 1;
+   }
+   return 0;
+}
+#endif
+
 // adds an extra all-255 alpha channel
 // dest == src is legal
 // img_n must be 1 or 3
@@ -4741,6 +5647,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       stbi_uc *dest = a->out + stride*j;
       int nk = width * filter_bytes;
       int filter = *raw++;
+      int done = 0;
 
       // check filter type
       if (filter > 4) {
@@ -4751,8 +5658,18 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
+      // 8-bit RGB and RGBA rows have SIMD paths
+#ifdef STBI_AVX2
+      if (depth == 8 && stbi__simd_allows_avx2() && stbi__avx2_available())
+         done = stbi__unfilter_row_avx2(filter, cur, prior, raw, nk, filter_bytes);
+#endif
+#ifdef STBI_SSE2
+      if (!done && depth == 8 && stbi__simd_allows_sse2() && stbi__sse2_available())
+         done = stbi__unfilter_row_simd(filter, cur, prior, raw, nk, filter_bytes);
+#endif
+
       // perform actual filtering
-      switch (filter) {
+      if (!done) switch (filter) {
       case STBI__F_none:
          memcpy(cur, raw, nk);
          break;
@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// per instance, see setupInstanceTextureAttributes
+layout (location = 2) in vec4 aUvRect;
+layout (location = 3) in float aLayer;
+layout (location = 4) in mat4 aModel;
+
+// projection * view, multiplied once per frame on the cpu
+uniform mat4 viewProjection;
+
+out vec3 TexCoord;
+
+void main() {
+    gl_Position = viewProjection * (aModel * vec4(aPos, 1.0));
+    // map the mesh uvs into the rectangle this instance's image occupies in the layer
+    TexCoord = vec3(aUvRect.xy + aTexCoord * aUvRect.zw, aLayer);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// per instance projection * view * model, see MvpInstanceBuffer
+layout (location = 2) in mat4 aMvp;
+
+out vec2 TexCoord;
+
+void main() {
+    gl_Position = aMvp * vec4(aPos, 1.0);
+    TexCoord = aTexCoord;
+}
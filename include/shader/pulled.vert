@@ -0,0 +1,20 @@
+#version 330 core
+// vertex pulling, see geometry/vertex_pulling.h. there are no vertex attributes:
+// gl_VertexID walks the index stream and the vertex is read from the buffer textures
+uniform samplerBuffer vpVertices;
+uniform usamplerBuffer vpIndices;
+
+uniform mat4 model;
+// projection * view, multiplied once per frame on the cpu
+uniform mat4 viewProjection;
+
+out vec2 TexCoord;
+
+void main() {
+    int index = int(texelFetch(vpIndices, gl_VertexID).r);
+    // position and u, then v
+    vec4 a = texelFetch(vpVertices, index * 2);
+    vec4 b = texelFetch(vpVertices, index * 2 + 1);
+    gl_Position = viewProjection * (model * vec4(a.xyz, 1.0));
+    TexCoord = vec2(a.w, b.x);
+}
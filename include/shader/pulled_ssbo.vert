@@ -0,0 +1,22 @@
+#version 430 core
+// pulled.vert reading storage buffers instead of buffer textures, for 4.3 contexts
+layout (std430, binding = 0) readonly buffer PulledVertices {
+    vec4 vpVertices[];
+};
+layout (std430, binding = 1) readonly buffer PulledIndices {
+    uint vpIndices[];
+};
+
+uniform mat4 model;
+// projection * view, multiplied once per frame on the cpu
+uniform mat4 viewProjection;
+
+out vec2 TexCoord;
+
+void main() {
+    int index = int(vpIndices[gl_VertexID]);
+    vec4 a = vpVertices[index * 2];
+    vec4 b = vpVertices[index * 2 + 1];
+    gl_Position = viewProjection * (model * vec4(a.xyz, 1.0));
+    TexCoord = vec2(a.w, b.x);
+}
@@ -3,14 +3,13 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-uniform mat4 transform;
+// projection * view, multiplied once per frame on the cpu
+uniform mat4 viewProjection;
 
 out vec2 TexCoord;
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    // two matrix * vector products, the matrices are never multiplied per vertex
+    gl_Position = viewProjection * (model * vec4(aPos, 1.0));
     TexCoord = vec2(aTexCoord.x, aTexCoord.y);
-}
\ No newline at end of file
+}
@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// per instance, see setupSpinInstanceAttributes
+layout (location = 2) in vec4 aPositionSpeed;
+layout (location = 3) in vec4 aAxisPhase;
+
+uniform float time;
+// projection * view
+uniform mat4 viewProjection;
+
+out vec2 TexCoord;
+
+// the rotation part of glm::rotate around a unit axis
+mat3 rotation(vec3 axis, float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 t = (1.0 - c) * axis;
+    return mat3(t.x * axis + vec3(c, s * axis.z, -s * axis.y),
+                t.y * axis + vec3(-s * axis.z, c, s * axis.x),
+                t.z * axis + vec3(s * axis.y, -s * axis.x, c));
+}
+
+void main() {
+    float angle = time * aPositionSpeed.w + aAxisPhase.w;
+    vec3 world = aPositionSpeed.xyz + rotation(aAxisPhase.xyz, angle) * aPos;
+    gl_Position = viewProjection * vec4(world, 1.0);
+    TexCoord = aTexCoord;
+}
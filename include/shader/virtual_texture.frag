@@ -0,0 +1,46 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform float mixValue;
+uniform sampler2D texture2;
+
+// set by VirtualTexture::Bind
+uniform sampler2D vtPageTable;
+uniform sampler2D vtCache;
+// pages per side of level 0, coarsest level, page size and border in texels
+uniform vec4 vtParams;
+uniform float vtCacheSize;
+// the part of the virtual texture the image covers
+uniform vec2 vtUvScale;
+uniform float vtLodBias;
+
+// the mip level the hardware would pick, from the derivatives in virtual texels
+float vtLevel(vec2 uv) {
+    vec2 texels = uv * vtParams.x * vtParams.z;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias;
+    return clamp(floor(lod), 0.0, vtParams.y);
+}
+
+vec4 vtSample(vec2 uv) {
+    uv = clamp(uv, 0.0, 1.0) * vtUvScale;
+    int level = int(vtLevel(uv));
+    int pages = int(vtParams.x) >> level;
+    ivec2 page = min(ivec2(uv * float(pages)), ivec2(pages - 1));
+    vec4 entry = floor(texelFetch(vtPageTable, page, level) * 255.0 + 0.5);
+
+    // the entry may point at a coarser ancestor when the page isn't loaded yet
+    int mappedLevel = int(entry.z);
+    ivec2 mappedPage = page >> (mappedLevel - level);
+    vec2 inPage = uv * float(int(vtParams.x) >> mappedLevel) - vec2(mappedPage);
+    vec2 texel = entry.xy * (vtParams.z + 2.0 * vtParams.w) + vtParams.w + inPage * vtParams.z;
+    // borders make bilinear filtering inside the page safe, there are no mips in the cache
+    return textureLod(vtCache, texel / vtCacheSize, 0.0);
+}
+
+void main() {
+    FragColor = mix(vtSample(TexCoord), texture(texture2, TexCoord), mixValue);
+}
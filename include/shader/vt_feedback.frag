@@ -0,0 +1,26 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+// set by VirtualTexture::BindFeedback, same meaning as in virtual_texture.frag
+uniform vec4 vtParams;
+uniform vec2 vtUvScale;
+uniform float vtLodBias;
+
+float vtLevel(vec2 uv) {
+    vec2 texels = uv * vtParams.x * vtParams.z;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias;
+    return clamp(floor(lod), 0.0, vtParams.y);
+}
+
+// writes the page this pixel samples as (x, y, level), read back by VirtualTexture
+void main() {
+    vec2 uv = clamp(TexCoord, 0.0, 1.0) * vtUvScale;
+    int level = int(vtLevel(uv));
+    int pages = int(vtParams.x) >> level;
+    ivec2 page = min(ivec2(uv * float(pages)), ivec2(pages - 1));
+    FragColor = vec4(vec3(page, level) / 255.0, 1.0);
+}
@@ -0,0 +1,526 @@
+#ifndef HDR_TEXTURE_H
+#define HDR_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "texture/mipmap.h"
+#include "util/cpu_features.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// float images (stbi_loadf, .hdr/.exr style data) packed into compact GL formats.
+// RGB9_E5 and R11F_G11F_B10F store a texel in 4 bytes, a quarter of RGBA32F;
+// half float is the fallback for data the unsigned formats can't hold, negative
+// values, alpha, or colours whose channels are too far apart for a shared exponent
+
+enum HdrFormat {
+    // picked per image by chooseHdrFormat
+    HDR_FORMAT_AUTO,
+    HDR_FORMAT_RGB9_E5,
+    HDR_FORMAT_R11F_G11F_B10F,
+    HDR_FORMAT_RGB16F,
+    HDR_FORMAT_RGBA16F
+};
+
+struct HdrSettings {
+    HdrFormat format = HDR_FORMAT_AUTO;
+    bool mipmaps = true;
+    // box keeps a bright sun from ringing into negative texels around it
+    MipFilter filter = MIP_FILTER_BOX;
+    // sample across the edges, e.g. the horizontal seam of an equirect map
+    bool wrap = false;
+    // 0 generates the full chain down to 1x1
+    int maxLevels = 0;
+    // mean relative error per channel above which AUTO gives up on the 4 byte formats
+    float maxRelativeError = 0.01f;
+};
+
+// levels hold the packed texels in the format's GL layout, ready for glTexImage2D
+struct HdrChain {
+    HdrFormat format = HDR_FORMAT_RGB9_E5;
+    std::vector<MipLevel> levels;
+
+    size_t TotalBytes() const {
+        size_t bytes = 0;
+        for (const MipLevel &level : levels) {
+            bytes += level.pixels.size();
+        }
+        return bytes;
+    }
+};
+
+namespace hdr_detail {
+
+    // largest values the formats hold, bigger ones and +inf are clamped to these
+    const float RGB9E5_MAX = 65408.0f;
+    const float UFLOAT11_MAX = 65024.0f;
+    const float UFLOAT10_MAX = 64512.0f;
+
+    inline uint32_t floatBits(float v) {
+        uint32_t bits;
+        memcpy(&bits, &v, 4);
+        return bits;
+    }
+
+    inline float bitsFloat(uint32_t bits) {
+        float v;
+        memcpy(&v, &bits, 4);
+        return v;
+    }
+
+    // [0, limit], NaN becomes 0. written like maxps/minps so the SIMD paths agree
+    inline float clampUnsigned(float v, float limit) {
+        v = v > 0.0f ? v : 0.0f;
+        return v < limit ? v : limit;
+    }
+
+    // the scalar kernels are the reference, the SIMD ones produce the same bits.
+    // rounding is to nearest even like the cvtps instructions in the default mode
+
+    // shared exponent as in the EXT_texture_shared_exponent spec, bias 15, 9 bit mantissas
+    inline uint32_t packRgb9e5(float r, float g, float b) {
+        r = clampUnsigned(r, RGB9E5_MAX);
+        g = clampUnsigned(g, RGB9E5_MAX);
+        b = clampUnsigned(b, RGB9E5_MAX);
+        float maxc = std::max(r, std::max(g, b));
+        // floor(log2(maxc)) straight from the exponent bits, zero and denormals land on -16
+        int exponent = std::max(-16, (int)(floatBits(maxc) >> 23) - 127) + 16;
+        float scale = bitsFloat((uint32_t)(127 + 24 - exponent) << 23);
+        if ((int)(maxc * scale + 0.5f) == 512) {
+            exponent++;
+            scale *= 0.5f;
+        }
+        uint32_t rm = (uint32_t)(int)(r * scale + 0.5f);
+        uint32_t gm = (uint32_t)(int)(g * scale + 0.5f);
+        uint32_t bm = (uint32_t)(int)(b * scale + 0.5f);
+        return rm | gm << 9 | bm << 18 | (uint32_t)exponent << 27;
+    }
+
+    // unsigned float with 5 exponent bits and M mantissa bits, 6 for red and green, 5 for blue
+    template <int M>
+    inline uint32_t packUfloat(float v) {
+        v = clampUnsigned(v, M == 6 ? UFLOAT11_MAX : UFLOAT10_MAX);
+        if (v < 1.0f / 16384.0f) {
+            // denormal range, steps of 2^-(14+M)
+            return (uint32_t)(int)std::nearbyint(v * (float)(1 << (14 + M)));
+        }
+        uint32_t bits = floatBits(v);
+        bits += ((1u << (22 - M)) - 1) + ((bits >> (23 - M)) & 1);
+        return (bits >> (23 - M)) - ((127 - 15) << M);
+    }
+
+    inline uint32_t packR11G11B10(float r, float g, float b) {
+        return packUfloat<6>(r) | packUfloat<6>(g) << 11 | packUfloat<5>(b) << 22;
+    }
+
+    // IEEE half with the sign, NaNs stay (quiet) NaNs the way F16C converts them
+    inline uint16_t packHalf(float v) {
+        uint32_t bits = floatBits(v);
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t magnitude = bits & 0x7fffffff;
+        uint32_t half;
+        if (magnitude > 0x7f800000) {
+            half = 0x7e00 | ((magnitude >> 13) & 0x3ff);
+        } else if (magnitude >= 0x477ff000) {
+            // 65520 and up round to infinity
+            half = 0x7c00;
+        } else if (magnitude < 0x38800000) {
+            half = (uint32_t)(int)std::nearbyint(bitsFloat(magnitude) * 16777216.0f);
+        } else {
+            magnitude += 0xfff + ((magnitude >> 13) & 1);
+            half = (magnitude >> 13) - ((127 - 15) << 10);
+        }
+        return (uint16_t)(half | sign);
+    }
+
+    inline void decodeRgb9e5(uint32_t texel, float *rgb) {
+        float scale = std::ldexp(1.0f, (int)(texel >> 27) - 24);
+        rgb[0] = (float)(texel & 0x1ff) * scale;
+        rgb[1] = (float)((texel >> 9) & 0x1ff) * scale;
+        rgb[2] = (float)((texel >> 18) & 0x1ff) * scale;
+    }
+
+    inline float decodeUfloat(uint32_t bits, int mantissaBits) {
+        uint32_t mantissa = bits & ((1u << mantissaBits) - 1);
+        int exponent = (int)(bits >> mantissaBits);
+        if (exponent == 0) {
+            return std::ldexp((float)mantissa, -14 - mantissaBits);
+        }
+        return std::ldexp(1.0f + (float)mantissa / (float)(1 << mantissaBits), exponent - 15);
+    }
+
+    inline void decodeR11G11B10(uint32_t texel, float *rgb) {
+        rgb[0] = decodeUfloat(texel & 0x7ff, 6);
+        rgb[1] = decodeUfloat((texel >> 11) & 0x7ff, 6);
+        rgb[2] = decodeUfloat(texel >> 22, 5);
+    }
+
+    // row kernels over `count` texels of 4 floats, alpha ignored by the 4 byte formats
+    inline void packRgb9e5RowScalar(uint32_t *dst, const float *src, int count) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = packRgb9e5(src[i * 4], src[i * 4 + 1], src[i * 4 + 2]);
+        }
+    }
+
+    inline void packR11G11B10RowScalar(uint32_t *dst, const float *src, int count) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = packR11G11B10(src[i * 4], src[i * 4 + 1], src[i * 4 + 2]);
+        }
+    }
+
+    // `count` floats, not texels
+    inline void packHalfRowScalar(uint16_t *dst, const float *src, int count) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = packHalf(src[i]);
+        }
+    }
+
+#if defined(CPU_SSE2)
+    // SSE2 has no 32 bit max or blend
+    inline __m128i selectSse(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    // maxps returns the second operand for NaN, so NaN -> 0 like clampUnsigned
+    inline __m128 clampUnsignedSse(__m128 v, __m128 limit) {
+        return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), limit);
+    }
+
+    inline __m128i roundHalfUpSse(__m128 v, __m128 scale) {
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), _mm_set1_ps(0.5f)));
+    }
+
+    // four texels per iteration, transposed to one register per channel
+    inline void packRgb9e5RowSse(uint32_t *dst, const float *src, int count) {
+        const __m128 limit = _mm_set1_ps(RGB9E5_MAX);
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 r = _mm_loadu_ps(src + i * 4);
+            __m128 g = _mm_loadu_ps(src + i * 4 + 4);
+            __m128 b = _mm_loadu_ps(src + i * 4 + 8);
+            __m128 a = _mm_loadu_ps(src + i * 4 + 12);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            r = clampUnsignedSse(r, limit);
+            g = clampUnsignedSse(g, limit);
+            b = clampUnsignedSse(b, limit);
+            __m128 maxc = _mm_max_ps(r, _mm_max_ps(g, b));
+
+            __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(maxc), 23), _mm_set1_epi32(127));
+            __m128i lowest = _mm_set1_epi32(-16);
+            exponent = _mm_add_epi32(selectSse(_mm_cmplt_epi32(exponent, lowest), lowest, exponent), _mm_set1_epi32(16));
+            __m128i scaleBits = _mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127 + 24), exponent), 23);
+
+            __m128i overflow = _mm_cmpeq_epi32(roundHalfUpSse(maxc, _mm_castsi128_ps(scaleBits)), _mm_set1_epi32(512));
+            exponent = _mm_sub_epi32(exponent, overflow);
+            // halving the scale is one off its exponent field
+            scaleBits = _mm_sub_epi32(scaleBits, _mm_and_si128(overflow, _mm_set1_epi32(1 << 23)));
+            __m128 scale = _mm_castsi128_ps(scaleBits);
+
+            __m128i texel = roundHalfUpSse(r, scale);
+            texel = _mm_or_si128(texel, _mm_slli_epi32(roundHalfUpSse(g, scale), 9));
+            texel = _mm_or_si128(texel, _mm_slli_epi32(roundHalfUpSse(b, scale), 18));
+            texel = _mm_or_si128(texel, _mm_slli_epi32(exponent, 27));
+            _mm_storeu_si128((__m128i *)(dst + i), texel);
+        }
+        packRgb9e5RowScalar(dst + i, src + i * 4, count - i);
+    }
+
+    template <int M>
+    inline __m128i packUfloatSse(__m128 v) {
+        v = clampUnsignedSse(v, _mm_set1_ps(M == 6 ? UFLOAT11_MAX : UFLOAT10_MAX));
+        __m128i denormal = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps((float)(1 << (14 + M)))));
+        __m128i bits = _mm_castps_si128(v);
+        __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 23 - M), _mm_set1_epi32(1));
+        bits = _mm_add_epi32(bits, _mm_add_epi32(_mm_set1_epi32((1 << (22 - M)) - 1), odd));
+        __m128i normal = _mm_sub_epi32(_mm_srli_epi32(bits, 23 - M), _mm_set1_epi32((127 - 15) << M));
+        __m128i isDenormal = _mm_castps_si128(_mm_cmplt_ps(v, _mm_set1_ps(1.0f / 16384.0f)));
+        return selectSse(isDenormal, denormal, normal);
+    }
+
+    inline void packR11G11B10RowSse(uint32_t *dst, const float *src, int count) {
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 r = _mm_loadu_ps(src + i * 4);
+            __m128 g = _mm_loadu_ps(src + i * 4 + 4);
+            __m128 b = _mm_loadu_ps(src + i * 4 + 8);
+            __m128 a = _mm_loadu_ps(src + i * 4 + 12);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            __m128i texel = packUfloatSse<6>(r);
+            texel = _mm_or_si128(texel, _mm_slli_epi32(packUfloatSse<6>(g), 11));
+            texel = _mm_or_si128(texel, _mm_slli_epi32(packUfloatSse<5>(b), 22));
+            _mm_storeu_si128((__m128i *)(dst + i), texel);
+        }
+        packR11G11B10RowScalar(dst + i, src + i * 4, count - i);
+    }
+
+    // four halves in the low 16 bits of each lane
+    inline __m128i packHalfSse(__m128 v) {
+        __m128i bits = _mm_castps_si128(v);
+        __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000));
+        __m128i magnitude = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+
+        __m128i odd = _mm_and_si128(_mm_srli_epi32(magnitude, 13), _mm_set1_epi32(1));
+        __m128i rounded = _mm_add_epi32(magnitude, _mm_add_epi32(_mm_set1_epi32(0xfff), odd));
+        __m128i half = _mm_sub_epi32(_mm_srli_epi32(rounded, 13), _mm_set1_epi32((127 - 15) << 10));
+
+        __m128i denormal = _mm_cvtps_epi32(_mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_set1_ps(16777216.0f)));
+        half = selectSse(_mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x38800000)), denormal, half);
+        half = selectSse(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x477fefff)), _mm_set1_epi32(0x7c00), half);
+        __m128i nan = _mm_or_si128(_mm_set1_epi32(0x7e00), _mm_and_si128(_mm_srli_epi32(magnitude, 13), _mm_set1_epi32(0x3ff)));
+        half = selectSse(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7f800000)), nan, half);
+        return _mm_or_si128(half, sign);
+    }
+
+    inline void packHalfRowSse(uint16_t *dst, const float *src, int count) {
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i low = packHalfSse(_mm_loadu_ps(src + i));
+            __m128i high = packHalfSse(_mm_loadu_ps(src + i + 4));
+            // sign extend so the saturating pack keeps all 16 bits
+            low = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+            high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(low, high));
+        }
+        packHalfRowScalar(dst + i, src + i, count - i);
+    }
+#endif
+
+#if defined(CPU_AVX2)
+    TARGET_AVX2_F16C inline void packHalfRowF16c(uint16_t *dst, const float *src, int count) {
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            _mm_storeu_si128((__m128i *)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+        }
+        packHalfRowScalar(dst + i, src + i, count - i);
+    }
+#endif
+
+    typedef void (*PackWordRowFn)(uint32_t*, const float*, int);
+    typedef void (*PackHalfRowFn)(uint16_t*, const float*, int);
+
+    inline PackWordRowFn selectPackRow(HdrFormat format) {
+#if defined(CPU_SSE2)
+        return format == HDR_FORMAT_RGB9_E5 ? packRgb9e5RowSse : packR11G11B10RowSse;
+#else
+        return format == HDR_FORMAT_RGB9_E5 ? packRgb9e5RowScalar : packR11G11B10RowScalar;
+#endif
+    }
+
+    inline PackHalfRowFn selectPackHalfRow() {
+#if defined(CPU_AVX2)
+        if (cpuHasF16c()) {
+            return packHalfRowF16c;
+        }
+#endif
+#if defined(CPU_SSE2)
+        return packHalfRowSse;
+#else
+        return packHalfRowScalar;
+#endif
+    }
+
+    // relative error of one channel, values below `black` count as black
+    inline double relativeError(float original, float decoded) {
+        const float black = 1.0f / 1024.0f;
+        return std::fabs((double)decoded - original) / std::max(original, black);
+    }
+
+    inline bool hasAlpha(const float *pixels, size_t count, int channels) {
+        if (channels != 4) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (pixels[i * 4 + 3] != 1.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+// picks the cheapest format that holds the image within maxRelativeError, from
+// a sample of at most 64k texels. the shared exponent loses the dim channels of
+// saturated colours, 11/11/10 loses a little on every channel, so which one wins
+// depends on the image. negative values and real alpha need half floats
+inline HdrFormat chooseHdrFormat(const float *pixels, int width, int height, int channels, float maxRelativeError = 0.01f) {
+    using namespace hdr_detail;
+    size_t count = (size_t)width * height;
+    if (hasAlpha(pixels, count, channels)) {
+        return HDR_FORMAT_RGBA16F;
+    }
+    size_t step = std::max((size_t)1, count / 65536);
+    double errorE5 = 0.0;
+    double error111110 = 0.0;
+    size_t samples = 0;
+    for (size_t i = 0; i < count; i += step) {
+        const float *texel = pixels + i * channels;
+        if (texel[0] < 0.0f || texel[1] < 0.0f || texel[2] < 0.0f) {
+            return HDR_FORMAT_RGB16F;
+        }
+        float e5[3];
+        float f111110[3];
+        decodeRgb9e5(packRgb9e5(texel[0], texel[1], texel[2]), e5);
+        decodeR11G11B10(packR11G11B10(texel[0], texel[1], texel[2]), f111110);
+        for (int c = 0; c < 3; c++) {
+            errorE5 += relativeError(texel[c], e5[c]);
+            error111110 += relativeError(texel[c], f111110[c]);
+        }
+        samples += 3;
+    }
+    errorE5 /= std::max((size_t)1, samples);
+    error111110 /= std::max((size_t)1, samples);
+    if (std::min(errorE5, error111110) > maxRelativeError) {
+        return HDR_FORMAT_RGB16F;
+    }
+    return errorE5 <= error111110 ? HDR_FORMAT_RGB9_E5 : HDR_FORMAT_R11F_G11F_B10F;
+}
+
+inline GLenum hdrInternalFormat(HdrFormat format) {
+    switch (format) {
+        case HDR_FORMAT_R11F_G11F_B10F: return GL_R11F_G11F_B10F;
+        case HDR_FORMAT_RGB16F: return GL_RGB16F;
+        case HDR_FORMAT_RGBA16F: return GL_RGBA16F;
+        default: return GL_RGB9_E5;
+    }
+}
+
+// converts 3 or 4 channel float pixels, rows as stbi_loadf returns them, into the
+// packed mip chain. filtering runs in float on the calling thread plus the pool,
+// like generateMipChain. safe to call from any thread, touches no GL state
+inline HdrChain packHdrImage(const float *pixels, int width, int height, int channels,
+                             const HdrSettings &settings = HdrSettings(),
+                             ThreadPool &pool = ThreadPool::Shared()) {
+    using namespace hdr_detail;
+    using mipmap_detail::FloatImage;
+
+    HdrChain chain;
+    if (!pixels || width <= 0 || height <= 0 || (channels != 3 && channels != 4)) {
+        return chain;
+    }
+    chain.format = settings.format == HDR_FORMAT_AUTO
+        ? chooseHdrFormat(pixels, width, height, channels, settings.maxRelativeError) : settings.format;
+    const bool half = chain.format == HDR_FORMAT_RGB16F || chain.format == HDR_FORMAT_RGBA16F;
+    const int halfChannels = chain.format == HDR_FORMAT_RGBA16F ? 4 : 3;
+    const size_t texelBytes = half ? halfChannels * 2 : 4;
+
+    int levelCount = 1;
+    if (settings.mipmaps) {
+        for (int w = width, h = height; w > 1 || h > 1; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+            levelCount++;
+        }
+        if (settings.maxLevels > 0) {
+            levelCount = std::min(levelCount, settings.maxLevels);
+        }
+    }
+    chain.levels.resize(levelCount);
+
+    const PackWordRowFn packRow = selectPackRow(chain.format);
+    const PackHalfRowFn packHalfRow = selectPackHalfRow();
+    const mipmap_detail::FilterRowFn filterRow = mipmap_detail::selectFilterRow();
+    const mipmap_detail::SumRowsFn sumRows = mipmap_detail::selectSumRows();
+
+    auto pack = [&](const FloatImage &image, MipLevel &out) {
+        out.width = image.width;
+        out.height = image.height;
+        out.pixels.resize((size_t)image.width * image.height * texelBytes);
+        const int rowGrain = std::max(1, 16384 / (image.width * 4));
+        pool.ParallelFor(0, image.height, [&](int y) {
+            unsigned char *dst = out.pixels.data() + (size_t)y * image.width * texelBytes;
+            if (!half) {
+                packRow((uint32_t *)dst, image.row(y), image.width);
+                return;
+            }
+            if (halfChannels == 4) {
+                packHalfRow((uint16_t *)dst, image.row(y), image.width * 4);
+                return;
+            }
+            // converts the padded texels, then drops the alpha halves
+            std::vector<uint16_t> padded((size_t)image.width * 4);
+            packHalfRow(padded.data(), image.row(y), image.width * 4);
+            uint16_t *rgb = (uint16_t *)dst;
+            for (int x = 0; x < image.width; x++) {
+                memcpy(rgb + x * 3, &padded[(size_t)x * 4], 6);
+            }
+        }, rowGrain);
+    };
+
+    // every level goes through the 4 float working layout the mip filters use
+    FloatImage current;
+    current.resize(width, height);
+    pool.ParallelFor(0, height, [&](int y) {
+        const float *in = pixels + (size_t)y * width * channels;
+        float *out = current.row(y);
+        for (int x = 0; x < width; x++) {
+            out[x * 4 + 0] = in[x * channels + 0];
+            out[x * 4 + 1] = in[x * channels + 1];
+            out[x * 4 + 2] = in[x * channels + 2];
+            out[x * 4 + 3] = channels == 4 ? in[x * channels + 3] : 1.0f;
+        }
+    }, 8);
+    pack(current, chain.levels[0]);
+
+    FloatImage horizontal;
+    FloatImage next;
+    for (int level = 1; level < levelCount; level++) {
+        const int dstWidth = std::max(1, current.width / 2);
+        const int dstHeight = std::max(1, current.height / 2);
+        const mipmap_detail::AxisTaps tapsX = mipmap_detail::buildTaps(current.width, dstWidth, settings.filter, settings.wrap);
+        const mipmap_detail::AxisTaps tapsY = mipmap_detail::buildTaps(current.height, dstHeight, settings.filter, settings.wrap);
+        const int rowGrain = std::max(1, 16384 / (dstWidth * 4));
+
+        horizontal.resize(dstWidth, current.height);
+        pool.ParallelFor(0, current.height, [&](int y) {
+            filterRow(horizontal.row(y), current.row(y), tapsX, dstWidth);
+        }, rowGrain);
+
+        // no clamp to [0,1] here, the packers clamp to what the format holds
+        next.resize(dstWidth, dstHeight);
+        pool.ParallelFor(0, dstHeight, [&](int y) {
+            std::vector<const float*> rows(tapsY.taps);
+            for (int k = 0; k < tapsY.taps; k++) {
+                rows[k] = horizontal.row(tapsY.index[(size_t)y * tapsY.taps + k]);
+            }
+            sumRows(next.row(y), rows.data(), &tapsY.weight[(size_t)y * tapsY.taps], tapsY.taps, dstWidth * 4);
+        }, rowGrain);
+
+        pack(next, chain.levels[level]);
+        std::swap(current, next);
+    }
+    return chain;
+}
+
+// uploads every level to the texture bound to target and limits sampling to them
+inline void uploadHdrChain(GLenum target, const HdrChain &chain) {
+    if (chain.levels.empty()) {
+        return;
+    }
+    GLenum format = chain.format == HDR_FORMAT_RGBA16F ? GL_RGBA : GL_RGB;
+    GLenum type;
+    switch (chain.format) {
+        case HDR_FORMAT_R11F_G11F_B10F: type = GL_UNSIGNED_INT_10F_11F_11F_REV; break;
+        case HDR_FORMAT_RGB16F:
+        case HDR_FORMAT_RGBA16F: type = GL_HALF_FLOAT; break;
+        default: type = GL_UNSIGNED_INT_5_9_9_9_REV; break;
+    }
+
+    // RGB16F rows are 6 bytes a texel
+    GLint previousAlignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < chain.levels.size(); i++) {
+        const MipLevel &level = chain.levels[i];
+        glTexImage2D(target, (GLint)i, hdrInternalFormat(chain.format), level.width, level.height, 0, format, type,
+                     level.pixels.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)chain.levels.size() - 1);
+}
+
+#endif
@@ -0,0 +1,505 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <glad/glad.h>
+
+#include "texture/texture_format.h"
+#include "util/cpu_features.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// CPU mip chain generation. replaces glGenerateMipmap so that the filter is the
+// same on every driver, sRGB data is averaged in linear space and the work can
+// run on a loader thread instead of the GL thread
+
+enum MipFilter {
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER,
+    MIP_FILTER_LANCZOS
+};
+
+struct MipSettings {
+    MipFilter filter = MIP_FILTER_KAISER;
+    // colour channels are sRGB encoded and get filtered in linear space
+    bool srgb = true;
+    // when > 0 each level keeps the fraction of texels passing an alpha test
+    // against this reference value, so cutout textures don't fade out with distance
+    float alphaCutoff = 0.0f;
+    // sample across the edges for tileable textures instead of clamping
+    bool wrap = false;
+    // 0 generates the full chain down to 1x1
+    int maxLevels = 0;
+};
+
+struct MipLevel {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+struct MipChain {
+    int channels = 0;
+    std::vector<MipLevel> levels;
+
+    size_t TotalBytes() const {
+        size_t bytes = 0;
+        for (const MipLevel &level : levels) {
+            bytes += level.pixels.size();
+        }
+        return bytes;
+    }
+};
+
+namespace mipmap_detail {
+
+    // working image: always 4 floats per texel, colour in linear space
+    struct FloatImage {
+        int width = 0;
+        int height = 0;
+        std::vector<float> data;
+
+        void resize(int w, int h) {
+            width = w;
+            height = h;
+            data.assign((size_t)w * h * 4, 0.0f);
+        }
+        float* row(int y) { return data.data() + (size_t)y * width * 4; }
+        const float* row(int y) const { return data.data() + (size_t)y * width * 4; }
+    };
+
+    // filter taps for one axis: for every destination texel `taps` source indices and weights
+    struct AxisTaps {
+        int taps = 0;
+        std::vector<int> index;
+        std::vector<float> weight;
+    };
+
+    inline float sinc(float x) {
+        if (std::fabs(x) < 1e-5f) {
+            return 1.0f;
+        }
+        float px = 3.14159265358979f * x;
+        return std::sin(px) / px;
+    }
+
+    // zeroth order modified bessel function of the first kind, for the kaiser window
+    inline float besselI0(float x) {
+        float sum = 1.0f;
+        float term = 1.0f;
+        float halfX = x * 0.5f;
+        for (int k = 1; k < 32; k++) {
+            term *= (halfX / k) * (halfX / k);
+            sum += term;
+            if (term < sum * 1e-8f) {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    inline float filterSupport(MipFilter filter) {
+        return filter == MIP_FILTER_BOX ? 0.5f : 3.0f;
+    }
+
+    // x is the distance in destination texels
+    inline float filterWeight(MipFilter filter, float x) {
+        const float support = filterSupport(filter);
+        if (std::fabs(x) > support) {
+            return 0.0f;
+        }
+        switch (filter) {
+            case MIP_FILTER_BOX:
+                return 1.0f;
+            case MIP_FILTER_LANCZOS:
+                return sinc(x) * sinc(x / support);
+            case MIP_FILTER_KAISER: {
+                const float alpha = 4.0f;
+                float t = x / support;
+                return sinc(x) * besselI0(alpha * std::sqrt(std::max(0.0f, 1.0f - t * t))) / besselI0(alpha);
+            }
+        }
+        return 0.0f;
+    }
+
+    inline AxisTaps buildTaps(int srcSize, int dstSize, MipFilter filter, bool wrap) {
+        AxisTaps result;
+        const float scale = (float)srcSize / (float)dstSize;
+        const float radius = filterSupport(filter) * scale;
+        result.taps = (int)std::ceil(radius * 2.0f) + 2;
+        result.index.assign((size_t)dstSize * result.taps, 0);
+        result.weight.assign((size_t)dstSize * result.taps, 0.0f);
+
+        for (int i = 0; i < dstSize; i++) {
+            float center = (i + 0.5f) * scale;
+            int first = (int)std::floor(center - radius);
+            float total = 0.0f;
+            int *index = &result.index[(size_t)i * result.taps];
+            float *weight = &result.weight[(size_t)i * result.taps];
+            for (int k = 0; k < result.taps; k++) {
+                int s = first + k;
+                float w = filterWeight(filter, (s + 0.5f - center) / scale);
+                if (wrap) {
+                    s = ((s % srcSize) + srcSize) % srcSize;
+                } else {
+                    s = std::min(std::max(s, 0), srcSize - 1);
+                }
+                index[k] = s;
+                weight[k] = w;
+                total += w;
+            }
+            if (total != 0.0f) {
+                for (int k = 0; k < result.taps; k++) {
+                    weight[k] /= total;
+                }
+            }
+        }
+        return result;
+    }
+
+    // horizontal pass: one destination row from one source row, texel = 4 floats
+    inline void filterRowScalar(float *dst, const float *src, const AxisTaps &taps, int dstWidth) {
+        for (int x = 0; x < dstWidth; x++) {
+            const int *index = &taps.index[(size_t)x * taps.taps];
+            const float *weight = &taps.weight[(size_t)x * taps.taps];
+            float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int k = 0; k < taps.taps; k++) {
+                const float *texel = src + index[k] * 4;
+                for (int c = 0; c < 4; c++) {
+                    acc[c] += weight[k] * texel[c];
+                }
+            }
+            std::memcpy(dst + x * 4, acc, sizeof(acc));
+        }
+    }
+
+    // vertical pass: a weighted sum of whole rows, contiguous so it vectorizes over x
+    inline void sumRowsScalar(float *dst, const float *const *rows, const float *weight, int taps, int count) {
+        for (int i = 0; i < count; i++) {
+            float acc = 0.0f;
+            for (int k = 0; k < taps; k++) {
+                acc += weight[k] * rows[k][i];
+            }
+            dst[i] = acc;
+        }
+    }
+
+#if defined(CPU_SSE2)
+    inline void filterRowSse(float *dst, const float *src, const AxisTaps &taps, int dstWidth) {
+        for (int x = 0; x < dstWidth; x++) {
+            const int *index = &taps.index[(size_t)x * taps.taps];
+            const float *weight = &taps.weight[(size_t)x * taps.taps];
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < taps.taps; k++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_loadu_ps(src + index[k] * 4)));
+            }
+            _mm_storeu_ps(dst + x * 4, acc);
+        }
+    }
+
+    inline void sumRowsSse(float *dst, const float *const *rows, const float *weight, int taps, int count) {
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < taps; k++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_loadu_ps(rows[k] + i)));
+            }
+            _mm_storeu_ps(dst + i, acc);
+        }
+        for (; i < count; i++) {
+            float acc = 0.0f;
+            for (int k = 0; k < taps; k++) {
+                acc += weight[k] * rows[k][i];
+            }
+            dst[i] = acc;
+        }
+    }
+#endif
+
+#if defined(CPU_AVX2)
+    // two destination texels per iteration, one in each 128 bit lane
+    TARGET_AVX2 inline void filterRowAvx2(float *dst, const float *src, const AxisTaps &taps, int dstWidth) {
+        int x = 0;
+        for (; x + 2 <= dstWidth; x += 2) {
+            const int *index0 = &taps.index[(size_t)x * taps.taps];
+            const int *index1 = index0 + taps.taps;
+            const float *weight0 = &taps.weight[(size_t)x * taps.taps];
+            const float *weight1 = weight0 + taps.taps;
+            __m256 acc = _mm256_setzero_ps();
+            for (int k = 0; k < taps.taps; k++) {
+                __m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + index0[k] * 4)),
+                                                     _mm_loadu_ps(src + index1[k] * 4), 1);
+                __m256 w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weight0[k])),
+                                                _mm_set1_ps(weight1[k]), 1);
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(w, texels));
+            }
+            _mm256_storeu_ps(dst + x * 4, acc);
+        }
+        for (; x < dstWidth; x++) {
+            const int *index = &taps.index[(size_t)x * taps.taps];
+            const float *weight = &taps.weight[(size_t)x * taps.taps];
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < taps.taps; k++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_loadu_ps(src + index[k] * 4)));
+            }
+            _mm_storeu_ps(dst + x * 4, acc);
+        }
+    }
+
+    TARGET_AVX2 inline void sumRowsAvx2(float *dst, const float *const *rows, const float *weight, int taps, int count) {
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 acc = _mm256_setzero_ps();
+            for (int k = 0; k < taps; k++) {
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(weight[k]), _mm256_loadu_ps(rows[k] + i)));
+            }
+            _mm256_storeu_ps(dst + i, acc);
+        }
+        for (; i < count; i++) {
+            float acc = 0.0f;
+            for (int k = 0; k < taps; k++) {
+                acc += weight[k] * rows[k][i];
+            }
+            dst[i] = acc;
+        }
+    }
+#endif
+
+    typedef void (*FilterRowFn)(float*, const float*, const AxisTaps&, int);
+    typedef void (*SumRowsFn)(float*, const float *const*, const float*, int, int);
+
+    inline FilterRowFn selectFilterRow() {
+#if defined(CPU_AVX2)
+        if (cpuHasAvx2()) {
+            return filterRowAvx2;
+        }
+#endif
+#if defined(CPU_SSE2)
+        return filterRowSse;
+#else
+        return filterRowScalar;
+#endif
+    }
+
+    inline SumRowsFn selectSumRows() {
+#if defined(CPU_AVX2)
+        if (cpuHasAvx2()) {
+            return sumRowsAvx2;
+        }
+#endif
+#if defined(CPU_SSE2)
+        return sumRowsSse;
+#else
+        return sumRowsScalar;
+#endif
+    }
+
+    inline const float* srgbToLinearTable() {
+        static const std::vector<float> table = [] {
+            std::vector<float> t(256);
+            for (int i = 0; i < 256; i++) {
+                float c = i / 255.0f;
+                t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    // linear [0,1] quantized to 16 bits -> 8 bit sRGB. fine enough that the error
+    // stays well under half an 8 bit step even in the steep dark end of the curve
+    inline const unsigned char* linearToSrgbTable() {
+        static const std::vector<unsigned char> table = [] {
+            std::vector<unsigned char> t(65536);
+            for (int i = 0; i < 65536; i++) {
+                float l = i / 65535.0f;
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                t[i] = (unsigned char)std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f));
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    inline bool isAlphaChannel(int channels, int c) {
+        return (channels == 2 && c == 1) || (channels == 4 && c == 3);
+    }
+
+    // source channel -> slot in the 4 float working texel
+    inline int slotOf(int channels, int c) {
+        return isAlphaChannel(channels, c) ? 3 : c;
+    }
+
+    inline float clamp01(float v) {
+        return std::min(1.0f, std::max(0.0f, v));
+    }
+
+    // fraction of texels whose scaled alpha passes the alpha test
+    inline float alphaCoverage(const FloatImage &image, float cutoff, float scale) {
+        size_t passed = 0;
+        size_t count = (size_t)image.width * image.height;
+        for (size_t i = 0; i < count; i++) {
+            if (image.data[i * 4 + 3] * scale > cutoff) {
+                passed++;
+            }
+        }
+        return count ? (float)passed / (float)count : 0.0f;
+    }
+
+    // binary search for the alpha scale that restores the coverage of the top level
+    inline float coverageScale(const FloatImage &image, float cutoff, float targetCoverage) {
+        float low = 0.0f;
+        float high = 4.0f;
+        float scale = 1.0f;
+        for (int i = 0; i < 10; i++) {
+            float coverage = alphaCoverage(image, cutoff, scale);
+            if (std::fabs(coverage - targetCoverage) < 0.001f) {
+                break;
+            }
+            if (coverage < targetCoverage) {
+                low = scale;
+            } else {
+                high = scale;
+            }
+            scale = (low + high) * 0.5f;
+        }
+        return scale;
+    }
+}
+
+// builds every level of the mip chain on the calling thread plus the pool.
+// level 0 is a copy of the input. safe to call from any thread, touches no GL state
+inline MipChain generateMipChain(const unsigned char *pixels, int width, int height, int channels,
+                                 const MipSettings &settings = MipSettings(),
+                                 ThreadPool &pool = ThreadPool::Shared()) {
+    using namespace mipmap_detail;
+
+    MipChain chain;
+    chain.channels = channels;
+    if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+        return chain;
+    }
+
+    int levelCount = 1;
+    for (int w = width, h = height; w > 1 || h > 1; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        levelCount++;
+    }
+    if (settings.maxLevels > 0) {
+        levelCount = std::min(levelCount, settings.maxLevels);
+    }
+
+    chain.levels.resize(levelCount);
+    chain.levels[0].width = width;
+    chain.levels[0].height = height;
+    chain.levels[0].pixels.assign(pixels, pixels + (size_t)width * height * channels);
+    if (levelCount == 1) {
+        return chain;
+    }
+
+    const float *toLinear = srgbToLinearTable();
+    const unsigned char *toSrgb = linearToSrgbTable();
+    const FilterRowFn filterRow = selectFilterRow();
+    const SumRowsFn sumRows = selectSumRows();
+    const bool keepCoverage = settings.alphaCutoff > 0.0f && (channels == 2 || channels == 4);
+
+    // decode level 0 into linear float
+    FloatImage current;
+    current.resize(width, height);
+    pool.ParallelFor(0, height, [&](int y) {
+        const unsigned char *in = pixels + (size_t)y * width * channels;
+        float *out = current.row(y);
+        for (int x = 0; x < width; x++) {
+            out[x * 4 + 3] = 1.0f;
+            for (int c = 0; c < channels; c++) {
+                unsigned char v = in[x * channels + c];
+                bool alpha = isAlphaChannel(channels, c);
+                out[x * 4 + slotOf(channels, c)] = (settings.srgb && !alpha) ? toLinear[v] : v / 255.0f;
+            }
+        }
+    }, 8);
+
+    const float targetCoverage = keepCoverage ? alphaCoverage(current, settings.alphaCutoff, 1.0f) : 0.0f;
+
+    FloatImage horizontal;
+    FloatImage next;
+    for (int level = 1; level < levelCount; level++) {
+        const int dstWidth = std::max(1, current.width / 2);
+        const int dstHeight = std::max(1, current.height / 2);
+        const AxisTaps tapsX = buildTaps(current.width, dstWidth, settings.filter, settings.wrap);
+        const AxisTaps tapsY = buildTaps(current.height, dstHeight, settings.filter, settings.wrap);
+        const int rowGrain = std::max(1, 16384 / (dstWidth * 4));
+
+        // horizontal pass over every source row
+        horizontal.resize(dstWidth, current.height);
+        pool.ParallelFor(0, current.height, [&](int y) {
+            filterRow(horizontal.row(y), current.row(y), tapsX, dstWidth);
+        }, rowGrain);
+
+        // vertical pass, clamped so ringing from the windowed sinc filters doesn't compound
+        next.resize(dstWidth, dstHeight);
+        pool.ParallelFor(0, dstHeight, [&](int y) {
+            std::vector<const float*> rows(tapsY.taps);
+            for (int k = 0; k < tapsY.taps; k++) {
+                rows[k] = horizontal.row(tapsY.index[(size_t)y * tapsY.taps + k]);
+            }
+            float *out = next.row(y);
+            sumRows(out, rows.data(), &tapsY.weight[(size_t)y * tapsY.taps], tapsY.taps, dstWidth * 4);
+            for (int i = 0; i < dstWidth * 4; i++) {
+                out[i] = clamp01(out[i]);
+            }
+        }, rowGrain);
+
+        // the alpha scale only affects the stored level, the next level filters the real alpha
+        const float alphaScale = keepCoverage ? coverageScale(next, settings.alphaCutoff, targetCoverage) : 1.0f;
+
+        MipLevel &out = chain.levels[level];
+        out.width = dstWidth;
+        out.height = dstHeight;
+        out.pixels.resize((size_t)dstWidth * dstHeight * channels);
+        pool.ParallelFor(0, dstHeight, [&](int y) {
+            const float *in = next.row(y);
+            unsigned char *dst = out.pixels.data() + (size_t)y * dstWidth * channels;
+            for (int x = 0; x < dstWidth; x++) {
+                for (int c = 0; c < channels; c++) {
+                    float v = in[x * 4 + slotOf(channels, c)];
+                    if (isAlphaChannel(channels, c)) {
+                        dst[x * channels + c] = (unsigned char)(clamp01(v * alphaScale) * 255.0f + 0.5f);
+                    } else if (settings.srgb) {
+                        dst[x * channels + c] = toSrgb[(int)(v * 65535.0f + 0.5f)];
+                    } else {
+                        dst[x * channels + c] = (unsigned char)(v * 255.0f + 0.5f);
+                    }
+                }
+            }
+        }, rowGrain);
+
+        std::swap(current, next);
+    }
+    return chain;
+}
+
+// uploads every level to the texture bound to target and limits sampling to them
+inline void uploadMipChain(GLenum target, const MipChain &chain, GLenum internalFormat) {
+    if (chain.levels.empty()) {
+        return;
+    }
+    GLenum format = pixelFormatForChannels(chain.channels);
+
+    // small levels of RGB data have rows that aren't 4 byte aligned
+    GLint previousAlignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < chain.levels.size(); i++) {
+        const MipLevel &level = chain.levels[i];
+        glTexImage2D(target, (GLint)i, internalFormat, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, level.pixels.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)chain.levels.size() - 1);
+}
+
+#endif
@@ -0,0 +1,633 @@
+#ifndef PROCEDURAL_TEXTURE_H
+#define PROCEDURAL_TEXTURE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/noise.hpp>
+
+#include "images/qoi.h"
+#include "texture/texture_registry.h"
+#include "util/cpu_features.h"
+#include "util/hash.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// procedural material textures. the noise is the same simplex noise as
+// glm::simplex (Gustavson's), evaluated four texels at a time with SSE2 and
+// rows spread over the thread pool, plus Worley (cellular) noise on the same
+// hash. results are cached on disk by a hash of the settings, so a material
+// is only generated the first time the program sees it
+
+enum NoiseType {
+    // fractional brownian motion over simplex noise, octaves = 1 is plain simplex
+    NOISE_SIMPLEX_FBM,
+    // distance to the nearest feature point, summed over octaves like fbm
+    NOISE_WORLEY
+};
+
+struct NoiseSettings {
+    NoiseType type = NOISE_SIMPLEX_FBM;
+    int width = 512;
+    int height = 512;
+    // features across the longer side at the first octave. tileable textures round
+    // it to whole features per side so the edges line up
+    float frequency = 8.0f;
+    int octaves = 5;
+    // frequency factor per octave, rounded for tileable textures
+    float lacunarity = 2.0f;
+    // amplitude factor per octave
+    float gain = 0.5f;
+    uint32_t seed = 0;
+    // wraps seamlessly in both directions: simplex is sampled on a 4D torus, the
+    // worley cells repeat
+    bool tileable = true;
+    // worley: how far the feature points may move inside their cell, 0 to 1
+    float jitter = 0.9f;
+    // worley: second minus first distance, which draws the cell edges
+    bool worleyEdges = false;
+    // the noise value (0 to 1) blends between these sRGB colours
+    glm::vec3 low = glm::vec3(0.0f);
+    glm::vec3 high = glm::vec3(1.0f);
+};
+
+namespace noise_detail {
+
+    // bumped whenever the output for the same settings changes, so old cache files are ignored
+    const uint32_t VERSION = 1;
+    const float TWO_PI = 6.28318530717958647f;
+
+    // glm's helpers, spelled out so the SIMD versions can follow them op for op
+    inline float mod289(float x) {
+        return x - std::floor(x * 1.0f / 289.0f) * 289.0f;
+    }
+
+    inline float permute(float x) {
+        return mod289((x * 34.0f + 1.0f) * x);
+    }
+
+    inline float modf(float x, float y) {
+        return x - y * std::floor(x / y);
+    }
+
+    inline float fract(float x) {
+        return x - std::floor(x);
+    }
+
+    // distance to the nearest (and second nearest) feature point in the 3x3 cells
+    // around p, cells repeat every `period` cells when period > 0. the feature
+    // point hash is the one of Gustavson's cellular noise
+    inline float worley(float px, float py, float period, float seed, float jitter, bool edges) {
+        const float K = 1.0f / 7.0f;
+        const float Ko = 3.0f / 7.0f;
+        float cellX = std::floor(px);
+        float cellY = std::floor(py);
+        float fx = px - cellX;
+        float fy = py - cellY;
+        float f1 = 8.0f;
+        float f2 = 8.0f;
+        for (int j = -1; j <= 1; j++) {
+            for (int i = -1; i <= 1; i++) {
+                float cx = cellX + (float)i;
+                float cy = cellY + (float)j;
+                if (period > 0.0f) {
+                    cx = modf(cx, period);
+                    cy = modf(cy, period);
+                }
+                float p = permute(mod289(permute(mod289(cx + seed)) + mod289(cy)));
+                float ox = fract(p * K) - Ko;
+                float oy = modf(std::floor(p * K), 7.0f) * K - Ko;
+                float dx = fx - ((float)i + 0.5f + jitter * ox);
+                float dy = fy - ((float)j + 0.5f + jitter * oy);
+                float d = dx * dx + dy * dy;
+                f2 = std::max(f1, std::min(f2, d));
+                f1 = std::min(f1, d);
+            }
+        }
+        return edges ? std::sqrt(f2) - std::sqrt(f1) : std::sqrt(f1);
+    }
+
+    // everything the row kernels need for one octave
+    struct Octave {
+        // simplex: scale of the plane, or radius of the torus circles
+        float scaleX;
+        float scaleY;
+        // worley: cells per side when tileable
+        float period;
+        float amplitude;
+    };
+
+    struct NoisePlan {
+        NoiseType type;
+        bool tileable;
+        bool edges;
+        float jitter;
+        // domain offset picked by the seed
+        float offset[4];
+        float seed;
+        std::vector<Octave> octaves;
+        float amplitudeSum;
+        // texel centre of every column and row in [0,1), and the torus angles for them
+        std::vector<float> u, v;
+        std::vector<float> cosU, sinU, cosV, sinV;
+    };
+
+    inline NoisePlan makePlan(const NoiseSettings &settings) {
+        NoisePlan plan;
+        plan.type = settings.type;
+        plan.tileable = settings.tileable;
+        plan.edges = settings.worleyEdges;
+        plan.jitter = std::min(1.0f, std::max(0.0f, settings.jitter));
+        // shifts of whole 289 periods would give the same noise, spread the seeds inside one
+        uint64_t h = hashCombine(0x6e6f697365ULL, settings.seed);
+        for (int i = 0; i < 4; i++) {
+            plan.offset[i] = (float)((h >> (i * 16)) & 0xffff) / 65536.0f * 289.0f;
+        }
+        plan.seed = (float)(settings.seed % 289);
+
+        const int longest = std::max(settings.width, settings.height);
+        float frequency = std::max(settings.frequency, 1e-3f);
+        float lacunarity = settings.tileable ? std::max(1.0f, std::round(settings.lacunarity)) : settings.lacunarity;
+        float amplitude = 1.0f;
+        plan.amplitudeSum = 0.0f;
+        for (int i = 0; i < std::max(1, settings.octaves); i++) {
+            Octave octave;
+            float fx = frequency * settings.width / longest;
+            float fy = frequency * settings.height / longest;
+            if (settings.tileable) {
+                fx = std::max(1.0f, std::round(fx));
+                fy = std::max(1.0f, std::round(fy));
+            }
+            bool torus = settings.tileable && settings.type == NOISE_SIMPLEX_FBM;
+            // a circle of circumference f crosses f features, like f units of the plane
+            octave.scaleX = torus ? fx / TWO_PI : fx;
+            octave.scaleY = torus ? fy / TWO_PI : fy;
+            octave.period = settings.tileable ? fx : 0.0f;
+            octave.amplitude = amplitude;
+            plan.amplitudeSum += amplitude;
+            plan.octaves.push_back(octave);
+            frequency *= lacunarity;
+            amplitude *= settings.gain;
+        }
+        // worley tiling needs square cells, so the period is per side only when the image is square
+        if (settings.tileable && settings.type == NOISE_WORLEY && settings.width != settings.height) {
+            plan.tileable = false;
+            for (Octave &octave : plan.octaves) {
+                octave.period = 0.0f;
+            }
+        }
+
+        plan.u.resize(settings.width);
+        plan.cosU.resize(settings.width);
+        plan.sinU.resize(settings.width);
+        for (int x = 0; x < settings.width; x++) {
+            plan.u[x] = (x + 0.5f) / settings.width;
+            plan.cosU[x] = std::cos(plan.u[x] * TWO_PI);
+            plan.sinU[x] = std::sin(plan.u[x] * TWO_PI);
+        }
+        plan.v.resize(settings.height);
+        plan.cosV.resize(settings.height);
+        plan.sinV.resize(settings.height);
+        for (int y = 0; y < settings.height; y++) {
+            plan.v[y] = (y + 0.5f) / settings.height;
+            plan.cosV[y] = std::cos(plan.v[y] * TWO_PI);
+            plan.sinV[y] = std::sin(plan.v[y] * TWO_PI);
+        }
+        return plan;
+    }
+
+    // reference for one texel, also the path for builds without SSE2
+    inline float noiseTexel(const NoisePlan &plan, int x, int y) {
+        float sum = 0.0f;
+        for (const Octave &octave : plan.octaves) {
+            float n;
+            if (plan.type == NOISE_WORLEY) {
+                n = worley(plan.u[x] * octave.scaleX, plan.v[y] * octave.scaleY, octave.period, plan.seed, plan.jitter, plan.edges);
+            } else if (plan.tileable) {
+                n = glm::simplex(glm::vec4(plan.cosU[x] * octave.scaleX + plan.offset[0], plan.sinU[x] * octave.scaleX + plan.offset[1],
+                                           plan.cosV[y] * octave.scaleY + plan.offset[2], plan.sinV[y] * octave.scaleY + plan.offset[3]));
+            } else {
+                n = glm::simplex(glm::vec2(plan.u[x] * octave.scaleX + plan.offset[0], plan.v[y] * octave.scaleY + plan.offset[1]));
+            }
+            sum += octave.amplitude * n;
+        }
+        float value = sum / plan.amplitudeSum;
+        // simplex is about [-1, 1], worley distances start at 0
+        return plan.type == NOISE_WORLEY ? value : value * 0.5f + 0.5f;
+    }
+
+    inline void noiseRowScalar(const NoisePlan &plan, int y, float *out, int width) {
+        for (int x = 0; x < width; x++) {
+            out[x] = noiseTexel(plan, x, y);
+        }
+    }
+
+#if defined(CPU_SSE2)
+    // SSE2 has no round instructions, this is floor for |x| < 2^31
+    inline __m128 floorSse(__m128 x) {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+    }
+
+    inline __m128 fractSse(__m128 x) {
+        return _mm_sub_ps(x, floorSse(x));
+    }
+
+    inline __m128 mod289Sse(__m128 x) {
+        return _mm_sub_ps(x, _mm_mul_ps(floorSse(_mm_div_ps(x, _mm_set1_ps(289.0f))), _mm_set1_ps(289.0f)));
+    }
+
+    inline __m128 permuteSse(__m128 x) {
+        return mod289Sse(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(34.0f)), _mm_set1_ps(1.0f)), x));
+    }
+
+    // glm::mod, x - y * floor(x / y)
+    inline __m128 modSse(__m128 x, __m128 y) {
+        return _mm_sub_ps(x, _mm_mul_ps(y, floorSse(_mm_div_ps(x, y))));
+    }
+
+    inline __m128 absSse(__m128 x) {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    }
+
+    inline __m128 selectSse(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline __m128 taylorInvSqrtSse(__m128 r) {
+        return _mm_sub_ps(_mm_set1_ps(1.79284291400159f), _mm_mul_ps(_mm_set1_ps(0.85373472095314f), r));
+    }
+
+    // glm::simplex(vec2) for four points, lane for lane the same operations
+    inline __m128 simplex2Sse(__m128 vx, __m128 vy) {
+        const __m128 C0 = _mm_set1_ps(0.211324865405187f);
+        const __m128 C1 = _mm_set1_ps(0.366025403784439f);
+        const __m128 C2 = _mm_set1_ps(-0.577350269189626f);
+        const __m128 C3 = _mm_set1_ps(0.024390243902439f);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        // first corner
+        __m128 s = _mm_add_ps(_mm_mul_ps(vx, C1), _mm_mul_ps(vy, C1));
+        __m128 ix = floorSse(_mm_add_ps(vx, s));
+        __m128 iy = floorSse(_mm_add_ps(vy, s));
+        __m128 t = _mm_add_ps(_mm_mul_ps(ix, C0), _mm_mul_ps(iy, C0));
+        __m128 x0x = _mm_add_ps(_mm_sub_ps(vx, ix), t);
+        __m128 x0y = _mm_add_ps(_mm_sub_ps(vy, iy), t);
+
+        // other corners
+        __m128 i1x = _mm_and_ps(_mm_cmpgt_ps(x0x, x0y), one);
+        __m128 i1y = _mm_sub_ps(one, i1x);
+        __m128 x1x = _mm_sub_ps(_mm_add_ps(x0x, C0), i1x);
+        __m128 x1y = _mm_sub_ps(_mm_add_ps(x0y, C0), i1y);
+        __m128 x2x = _mm_add_ps(x0x, C2);
+        __m128 x2y = _mm_add_ps(x0y, C2);
+
+        // permutations
+        const __m128 ring = _mm_set1_ps(289.0f);
+        ix = modSse(ix, ring);
+        iy = modSse(iy, ring);
+        __m128 p0 = permuteSse(_mm_add_ps(permuteSse(iy), ix));
+        __m128 p1 = permuteSse(_mm_add_ps(_mm_add_ps(permuteSse(_mm_add_ps(iy, i1y)), ix), i1x));
+        __m128 p2 = permuteSse(_mm_add_ps(_mm_add_ps(permuteSse(_mm_add_ps(iy, one)), ix), one));
+
+        const __m128 zero = _mm_setzero_ps();
+        __m128 m0 = _mm_max_ps(_mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(x0x, x0x), _mm_mul_ps(x0y, x0y))), zero);
+        __m128 m1 = _mm_max_ps(_mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(x1x, x1x), _mm_mul_ps(x1y, x1y))), zero);
+        __m128 m2 = _mm_max_ps(_mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(x2x, x2x), _mm_mul_ps(x2y, x2y))), zero);
+        m0 = _mm_mul_ps(m0, m0);
+        m1 = _mm_mul_ps(m1, m1);
+        m2 = _mm_mul_ps(m2, m2);
+        m0 = _mm_mul_ps(m0, m0);
+        m1 = _mm_mul_ps(m1, m1);
+        m2 = _mm_mul_ps(m2, m2);
+
+        // gradients: 41 points on a line mapped onto a diamond
+        __m128 g[3];
+        __m128 *m[3] = { &m0, &m1, &m2 };
+        const __m128 p[3] = { p0, p1, p2 };
+        const __m128 px[3] = { x0x, x1x, x2x };
+        const __m128 py[3] = { x0y, x1y, x2y };
+        for (int k = 0; k < 3; k++) {
+            __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), fractSse(_mm_mul_ps(p[k], C3))), one);
+            __m128 h = _mm_sub_ps(absSse(x), half);
+            __m128 ox = floorSse(_mm_add_ps(x, half));
+            __m128 a0 = _mm_sub_ps(x, ox);
+            *m[k] = _mm_mul_ps(*m[k], taylorInvSqrtSse(_mm_add_ps(_mm_mul_ps(a0, a0), _mm_mul_ps(h, h))));
+            g[k] = _mm_add_ps(_mm_mul_ps(a0, px[k]), _mm_mul_ps(h, py[k]));
+        }
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, g[0]), _mm_mul_ps(m1, g[1])), _mm_mul_ps(m2, g[2]));
+        return _mm_mul_ps(_mm_set1_ps(130.0f), dot);
+    }
+
+    struct Vec4Sse {
+        __m128 x, y, z, w;
+    };
+
+    inline __m128 dot4Sse(const Vec4Sse &a, const Vec4Sse &b) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)),
+                          _mm_add_ps(_mm_mul_ps(a.z, b.z), _mm_mul_ps(a.w, b.w)));
+    }
+
+    // glm::gtc::grad4
+    inline Vec4Sse grad4Sse(__m128 j) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 seven = _mm_set1_ps(7.0f);
+        const __m128 ip0 = _mm_set1_ps(1.0f / 294.0f);
+        const __m128 ip1 = _mm_set1_ps(1.0f / 49.0f);
+        const __m128 ip2 = _mm_set1_ps(1.0f / 7.0f);
+        Vec4Sse p;
+        p.x = _mm_sub_ps(_mm_mul_ps(floorSse(_mm_mul_ps(fractSse(_mm_mul_ps(j, ip0)), seven)), ip2), one);
+        p.y = _mm_sub_ps(_mm_mul_ps(floorSse(_mm_mul_ps(fractSse(_mm_mul_ps(j, ip1)), seven)), ip2), one);
+        p.z = _mm_sub_ps(_mm_mul_ps(floorSse(_mm_mul_ps(fractSse(_mm_mul_ps(j, ip2)), seven)), ip2), one);
+        p.w = _mm_sub_ps(_mm_set1_ps(1.5f), _mm_add_ps(_mm_add_ps(absSse(p.x), absSse(p.y)), absSse(p.z)));
+        const __m128 zero = _mm_setzero_ps();
+        __m128 sw = _mm_and_ps(_mm_cmplt_ps(p.w, zero), one);
+        p.x = _mm_add_ps(p.x, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_and_ps(_mm_cmplt_ps(p.x, zero), one), _mm_set1_ps(2.0f)), one), sw));
+        p.y = _mm_add_ps(p.y, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_and_ps(_mm_cmplt_ps(p.y, zero), one), _mm_set1_ps(2.0f)), one), sw));
+        p.z = _mm_add_ps(p.z, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_and_ps(_mm_cmplt_ps(p.z, zero), one), _mm_set1_ps(2.0f)), one), sw));
+        return p;
+    }
+
+    // glm::simplex(vec4) for four points
+    inline __m128 simplex4Sse(const Vec4Sse &v) {
+        const __m128 F4 = _mm_set1_ps(0.309016994374947451f);
+        const __m128 Cx = _mm_set1_ps(0.138196601125011f);
+        const __m128 Cy = _mm_set1_ps(0.276393202250021f);
+        const __m128 Cz = _mm_set1_ps(0.414589803375032f);
+        const __m128 Cw = _mm_set1_ps(-0.447213595499958f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        // first corner
+        __m128 s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v.x, F4), _mm_mul_ps(v.y, F4)), _mm_add_ps(_mm_mul_ps(v.z, F4), _mm_mul_ps(v.w, F4)));
+        Vec4Sse i = { floorSse(_mm_add_ps(v.x, s)), floorSse(_mm_add_ps(v.y, s)), floorSse(_mm_add_ps(v.z, s)), floorSse(_mm_add_ps(v.w, s)) };
+        __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(i.x, Cx), _mm_mul_ps(i.y, Cx)), _mm_add_ps(_mm_mul_ps(i.z, Cx), _mm_mul_ps(i.w, Cx)));
+        Vec4Sse x0 = { _mm_add_ps(_mm_sub_ps(v.x, i.x), t), _mm_add_ps(_mm_sub_ps(v.y, i.y), t),
+                       _mm_add_ps(_mm_sub_ps(v.z, i.z), t), _mm_add_ps(_mm_sub_ps(v.w, i.w), t) };
+
+        // rank sorting, step(edge, x) is x >= edge
+        __m128 isXx = _mm_and_ps(_mm_cmpge_ps(x0.x, x0.y), one);
+        __m128 isXy = _mm_and_ps(_mm_cmpge_ps(x0.x, x0.z), one);
+        __m128 isXz = _mm_and_ps(_mm_cmpge_ps(x0.x, x0.w), one);
+        __m128 isYZx = _mm_and_ps(_mm_cmpge_ps(x0.y, x0.z), one);
+        __m128 isYZy = _mm_and_ps(_mm_cmpge_ps(x0.y, x0.w), one);
+        __m128 isYZz = _mm_and_ps(_mm_cmpge_ps(x0.z, x0.w), one);
+        Vec4Sse i0;
+        i0.x = _mm_add_ps(_mm_add_ps(isXx, isXy), isXz);
+        i0.y = _mm_add_ps(_mm_sub_ps(one, isXx), _mm_add_ps(isYZx, isYZy));
+        i0.z = _mm_add_ps(_mm_add_ps(_mm_sub_ps(one, isXy), _mm_sub_ps(one, isYZx)), isYZz);
+        i0.w = _mm_add_ps(_mm_add_ps(_mm_sub_ps(one, isXz), _mm_sub_ps(one, isYZy)), _mm_sub_ps(one, isYZz));
+
+        // i0 holds 0, 1, 2 and 3 once each
+        auto clamp01 = [&](__m128 a) { return _mm_min_ps(_mm_max_ps(a, zero), one); };
+        const __m128 two = _mm_set1_ps(2.0f);
+        Vec4Sse i3 = { clamp01(i0.x), clamp01(i0.y), clamp01(i0.z), clamp01(i0.w) };
+        Vec4Sse i2 = { clamp01(_mm_sub_ps(i0.x, one)), clamp01(_mm_sub_ps(i0.y, one)), clamp01(_mm_sub_ps(i0.z, one)), clamp01(_mm_sub_ps(i0.w, one)) };
+        Vec4Sse i1 = { clamp01(_mm_sub_ps(i0.x, two)), clamp01(_mm_sub_ps(i0.y, two)), clamp01(_mm_sub_ps(i0.z, two)), clamp01(_mm_sub_ps(i0.w, two)) };
+
+        Vec4Sse x1 = { _mm_add_ps(_mm_sub_ps(x0.x, i1.x), Cx), _mm_add_ps(_mm_sub_ps(x0.y, i1.y), Cx),
+                       _mm_add_ps(_mm_sub_ps(x0.z, i1.z), Cx), _mm_add_ps(_mm_sub_ps(x0.w, i1.w), Cx) };
+        Vec4Sse x2 = { _mm_add_ps(_mm_sub_ps(x0.x, i2.x), Cy), _mm_add_ps(_mm_sub_ps(x0.y, i2.y), Cy),
+                       _mm_add_ps(_mm_sub_ps(x0.z, i2.z), Cy), _mm_add_ps(_mm_sub_ps(x0.w, i2.w), Cy) };
+        Vec4Sse x3 = { _mm_add_ps(_mm_sub_ps(x0.x, i3.x), Cz), _mm_add_ps(_mm_sub_ps(x0.y, i3.y), Cz),
+                       _mm_add_ps(_mm_sub_ps(x0.z, i3.z), Cz), _mm_add_ps(_mm_sub_ps(x0.w, i3.w), Cz) };
+        Vec4Sse x4 = { _mm_add_ps(x0.x, Cw), _mm_add_ps(x0.y, Cw), _mm_add_ps(x0.z, Cw), _mm_add_ps(x0.w, Cw) };
+
+        // permutations
+        const __m128 ring = _mm_set1_ps(289.0f);
+        i.x = modSse(i.x, ring);
+        i.y = modSse(i.y, ring);
+        i.z = modSse(i.z, ring);
+        i.w = modSse(i.w, ring);
+        __m128 j0 = permuteSse(_mm_add_ps(permuteSse(_mm_add_ps(permuteSse(_mm_add_ps(permuteSse(i.w), i.z)), i.y)), i.x));
+        auto corner = [&](__m128 ox, __m128 oy, __m128 oz, __m128 ow) {
+            __m128 a = permuteSse(_mm_add_ps(i.w, ow));
+            a = permuteSse(_mm_add_ps(_mm_add_ps(a, i.z), oz));
+            a = permuteSse(_mm_add_ps(_mm_add_ps(a, i.y), oy));
+            return permuteSse(_mm_add_ps(_mm_add_ps(a, i.x), ox));
+        };
+        __m128 j1x = corner(i1.x, i1.y, i1.z, i1.w);
+        __m128 j1y = corner(i2.x, i2.y, i2.z, i2.w);
+        __m128 j1z = corner(i3.x, i3.y, i3.z, i3.w);
+        __m128 j1w = corner(one, one, one, one);
+
+        // gradients on a 4-cross polytope, normalised
+        Vec4Sse p[5] = { grad4Sse(j0), grad4Sse(j1x), grad4Sse(j1y), grad4Sse(j1z), grad4Sse(j1w) };
+        for (int k = 0; k < 5; k++) {
+            __m128 norm = taylorInvSqrtSse(dot4Sse(p[k], p[k]));
+            p[k].x = _mm_mul_ps(p[k].x, norm);
+            p[k].y = _mm_mul_ps(p[k].y, norm);
+            p[k].z = _mm_mul_ps(p[k].z, norm);
+            p[k].w = _mm_mul_ps(p[k].w, norm);
+        }
+
+        // contributions of the five corners
+        const __m128 limit = _mm_set1_ps(0.6f);
+        const Vec4Sse *x[5] = { &x0, &x1, &x2, &x3, &x4 };
+        __m128 weighted[5];
+        for (int k = 0; k < 5; k++) {
+            __m128 m = _mm_max_ps(_mm_sub_ps(limit, dot4Sse(*x[k], *x[k])), zero);
+            m = _mm_mul_ps(m, m);
+            weighted[k] = _mm_mul_ps(_mm_mul_ps(m, m), dot4Sse(p[k], *x[k]));
+        }
+        __m128 first = _mm_add_ps(_mm_add_ps(weighted[0], weighted[1]), weighted[2]);
+        __m128 second = _mm_add_ps(weighted[3], weighted[4]);
+        return _mm_mul_ps(_mm_set1_ps(49.0f), _mm_add_ps(first, second));
+    }
+
+    // worley() for four points
+    inline __m128 worleySse(__m128 px, __m128 py, float period, float seed, float jitter, bool edges) {
+        const __m128 K = _mm_set1_ps(1.0f / 7.0f);
+        const __m128 Ko = _mm_set1_ps(3.0f / 7.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 jitterV = _mm_set1_ps(jitter);
+        const __m128 periodV = _mm_set1_ps(period);
+        const __m128 seedV = _mm_set1_ps(seed);
+        __m128 cellX = floorSse(px);
+        __m128 cellY = floorSse(py);
+        __m128 fx = _mm_sub_ps(px, cellX);
+        __m128 fy = _mm_sub_ps(py, cellY);
+        __m128 f1 = _mm_set1_ps(8.0f);
+        __m128 f2 = f1;
+        for (int j = -1; j <= 1; j++) {
+            for (int i = -1; i <= 1; i++) {
+                __m128 cx = _mm_add_ps(cellX, _mm_set1_ps((float)i));
+                __m128 cy = _mm_add_ps(cellY, _mm_set1_ps((float)j));
+                if (period > 0.0f) {
+                    cx = modSse(cx, periodV);
+                    cy = modSse(cy, periodV);
+                }
+                __m128 p = permuteSse(_mm_add_ps(mod289Sse(permuteSse(mod289Sse(_mm_add_ps(cx, seedV)))), mod289Sse(cy)));
+                __m128 ox = _mm_sub_ps(fractSse(_mm_mul_ps(p, K)), Ko);
+                __m128 oy = _mm_sub_ps(_mm_mul_ps(modSse(floorSse(_mm_mul_ps(p, K)), _mm_set1_ps(7.0f)), K), Ko);
+                __m128 dx = _mm_sub_ps(fx, _mm_add_ps(_mm_add_ps(_mm_set1_ps((float)i), half), _mm_mul_ps(jitterV, ox)));
+                __m128 dy = _mm_sub_ps(fy, _mm_add_ps(_mm_add_ps(_mm_set1_ps((float)j), half), _mm_mul_ps(jitterV, oy)));
+                __m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                f2 = _mm_max_ps(f1, _mm_min_ps(f2, d));
+                f1 = _mm_min_ps(f1, d);
+            }
+        }
+        return edges ? _mm_sub_ps(_mm_sqrt_ps(f2), _mm_sqrt_ps(f1)) : _mm_sqrt_ps(f1);
+    }
+
+    inline void noiseRowSse(const NoisePlan &plan, int y, float *out, int width) {
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            __m128 sum = _mm_setzero_ps();
+            __m128 u = _mm_loadu_ps(&plan.u[x]);
+            __m128 v = _mm_set1_ps(plan.v[y]);
+            for (const Octave &octave : plan.octaves) {
+                __m128 n;
+                if (plan.type == NOISE_WORLEY) {
+                    n = worleySse(_mm_mul_ps(u, _mm_set1_ps(octave.scaleX)), _mm_mul_ps(v, _mm_set1_ps(octave.scaleY)),
+                                  octave.period, plan.seed, plan.jitter, plan.edges);
+                } else if (plan.tileable) {
+                    __m128 sx = _mm_set1_ps(octave.scaleX);
+                    Vec4Sse p;
+                    p.x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&plan.cosU[x]), sx), _mm_set1_ps(plan.offset[0]));
+                    p.y = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&plan.sinU[x]), sx), _mm_set1_ps(plan.offset[1]));
+                    p.z = _mm_set1_ps(plan.cosV[y] * octave.scaleY + plan.offset[2]);
+                    p.w = _mm_set1_ps(plan.sinV[y] * octave.scaleY + plan.offset[3]);
+                    n = simplex4Sse(p);
+                } else {
+                    n = simplex2Sse(_mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(octave.scaleX)), _mm_set1_ps(plan.offset[0])),
+                                    _mm_set1_ps(plan.v[y] * octave.scaleY + plan.offset[1]));
+                }
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(octave.amplitude), n));
+            }
+            __m128 value = _mm_div_ps(sum, _mm_set1_ps(plan.amplitudeSum));
+            if (plan.type != NOISE_WORLEY) {
+                value = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(0.5f)), _mm_set1_ps(0.5f));
+            }
+            _mm_storeu_ps(out + x, value);
+        }
+        for (; x < width; x++) {
+            out[x] = noiseTexel(plan, x, y);
+        }
+    }
+#endif
+
+    typedef void (*NoiseRowFn)(const NoisePlan&, int, float*, int);
+
+    inline NoiseRowFn selectNoiseRow() {
+#if defined(CPU_SSE2)
+        return noiseRowSse;
+#else
+        return noiseRowScalar;
+#endif
+    }
+}
+
+// noise values, usually in [0, 1], row by row on the pool
+inline std::vector<float> generateNoise(const NoiseSettings &settings, ThreadPool &pool = ThreadPool::Shared()) {
+    using namespace noise_detail;
+    std::vector<float> values;
+    if (settings.width <= 0 || settings.height <= 0) {
+        return values;
+    }
+    const NoisePlan plan = makePlan(settings);
+    const NoiseRowFn noiseRow = selectNoiseRow();
+    values.resize((size_t)settings.width * settings.height);
+    pool.ParallelFor(0, settings.height, [&](int y) {
+        noiseRow(plan, y, values.data() + (size_t)y * settings.width, settings.width);
+    }, std::max(1, 4096 / settings.width));
+    return values;
+}
+
+// the noise blended between the two colours, 8 bit RGB
+inline std::vector<unsigned char> generateNoiseTexture(const NoiseSettings &settings, ThreadPool &pool = ThreadPool::Shared()) {
+    std::vector<float> values = generateNoise(settings, pool);
+    std::vector<unsigned char> pixels(values.size() * 3);
+    pool.ParallelFor(0, settings.height, [&](int y) {
+        for (int x = 0; x < settings.width; x++) {
+            size_t i = (size_t)y * settings.width + x;
+            float t = std::min(1.0f, std::max(0.0f, values[i]));
+            glm::vec3 colour = glm::mix(settings.low, settings.high, t);
+            for (int c = 0; c < 3; c++) {
+                pixels[i * 3 + c] = (unsigned char)(std::min(1.0f, std::max(0.0f, colour[c])) * 255.0f + 0.5f);
+            }
+        }
+    }, std::max(1, 4096 / std::max(1, settings.width)));
+    return pixels;
+}
+
+// everything that changes the pixels, hashed
+inline uint64_t noiseSettingsKey(const NoiseSettings &settings) {
+    const float fields[] = {
+        (float)noise_detail::VERSION, (float)settings.type, (float)settings.width, (float)settings.height, settings.frequency,
+        (float)settings.octaves, settings.lacunarity, settings.gain, (float)settings.tileable, settings.jitter,
+        (float)settings.worleyEdges, settings.low.r, settings.low.g, settings.low.b, settings.high.r, settings.high.g, settings.high.b
+    };
+    return hashCombine(hashBytes64(fields, sizeof(fields)), settings.seed);
+}
+
+// generated textures stored as qoi files named after noiseSettingsKey. Get may
+// be called from several threads, two threads generating the same texture at
+// once both write it, the rename makes that harmless
+class NoiseTextureCache {
+    public:
+        explicit NoiseTextureCache(const std::string &directory = "cache/noise") : directory(directory), hits(0), misses(0) {}
+
+        // the pixels for these settings, 8 bit RGB rows top to bottom
+        std::vector<unsigned char> Get(const NoiseSettings &settings, ThreadPool &pool = ThreadPool::Shared()) {
+            std::string path = Path(settings);
+            QoiImage cached;
+            if (qoiRead(path, cached, 3) && cached.width == settings.width && cached.height == settings.height) {
+                hits++;
+                return std::move(cached.pixels);
+            }
+            misses++;
+            std::vector<unsigned char> pixels = generateNoiseTexture(settings, pool);
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            std::string temporary = path + ".tmp" + std::to_string(hashCombine(noiseSettingsKey(settings), misses.load()) & 0xffff);
+            if (qoiWrite(temporary, pixels.data(), settings.width, settings.height, 3)) {
+                std::filesystem::rename(temporary, path, error);
+            }
+            if (error) {
+                std::filesystem::remove(temporary, error);
+            }
+            return pixels;
+        }
+
+        std::string Path(const NoiseSettings &settings) const {
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.qoi", (unsigned long long)noiseSettingsKey(settings));
+            return (std::filesystem::path(directory) / name).string();
+        }
+
+        size_t Hits() const {
+            return hits;
+        }
+
+        size_t Misses() const {
+            return misses;
+        }
+
+    private:
+        std::string directory;
+        std::atomic<size_t> hits;
+        std::atomic<size_t> misses;
+};
+
+// a mipmapped registry texture for the settings, from the cache when possible.
+// tileable noise gets wrapping mip filters so the seams stay invisible. needs the GL context
+inline TextureHandle acquireNoiseTexture(TextureRegistry &registry, NoiseTextureCache &cache, const NoiseSettings &settings,
+                                         TextureDesc desc = TextureDesc()) {
+    std::vector<unsigned char> pixels = cache.Get(settings);
+    if (pixels.empty()) {
+        return TextureHandle();
+    }
+    desc.internalFormat = GL_RGB;
+    desc.mipSettings.wrap = settings.tileable;
+    return registry.Acquire(pixels.data(), settings.width, settings.height, 3, desc, cache.Path(settings));
+}
+
+#endif
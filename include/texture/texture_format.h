@@ -0,0 +1,67 @@
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+
+// pixel transfer format for 8 bit data with the given number of channels
+inline GLenum pixelFormatForChannels(int channels) {
+    switch (channels) {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 3: return GL_RGB;
+        default: return GL_RGBA;
+    }
+}
+
+// estimated bytes per texel the driver stores for an internal format.
+// 3 component 8 bit formats are padded to 4 bytes by every driver we know of
+inline size_t bytesPerTexel(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_R8:
+        case GL_RED:
+            return 1;
+        case GL_RG8:
+        case GL_RG:
+        case GL_R16F:
+            return 2;
+        case GL_RGB:
+        case GL_RGB8:
+        case GL_SRGB8:
+        case GL_RGBA:
+        case GL_RGBA8:
+        case GL_SRGB8_ALPHA8:
+        case GL_RGB9_E5:
+        case GL_R11F_G11F_B10F:
+        case GL_R32F:
+            return 4;
+        case GL_RGB16F:
+        case GL_RGBA16F:
+            return 8;
+        case GL_RGB32F:
+        case GL_RGBA32F:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+// bytes of one mip level
+inline size_t mipLevelBytes(int width, int height, int level, GLenum internalFormat) {
+    size_t w = (size_t)std::max(1, width >> level);
+    size_t h = (size_t)std::max(1, height >> level);
+    return w * h * bytesPerTexel(internalFormat);
+}
+
+// bytes of levels [firstLevel, levelCount)
+inline size_t mipChainBytes(int width, int height, int firstLevel, int levelCount, GLenum internalFormat) {
+    size_t bytes = 0;
+    for (int level = firstLevel; level < levelCount; level++) {
+        bytes += mipLevelBytes(width, height, level, internalFormat);
+    }
+    return bytes;
+}
+
+#endif
@@ -0,0 +1,398 @@
+#ifndef TEXTURE_PACKER_H
+#define TEXTURE_PACKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "texture/mipmap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+// skyline bottom-left rectangle packer used to lay out atlas pages
+class SkylinePacker {
+    public:
+        SkylinePacker(int width = 0, int height = 0) {
+            Reset(width, height);
+        }
+
+        void Reset(int width, int height) {
+            Width = width;
+            Height = height;
+            skyline.assign(1, Node{ 0, 0, width });
+        }
+
+        // finds the lowest position the rectangle fits at, returns false when the page is full
+        bool Pack(int w, int h, int &outX, int &outY) {
+            int bestIndex = -1;
+            int bestTop = INT_MAX;
+            int bestWidth = INT_MAX;
+            for (size_t i = 0; i < skyline.size(); i++) {
+                int y;
+                if (!fits(i, w, h, y)) {
+                    continue;
+                }
+                if (y + h < bestTop || (y + h == bestTop && skyline[i].width < bestWidth)) {
+                    bestIndex = (int)i;
+                    bestTop = y + h;
+                    bestWidth = skyline[i].width;
+                    outX = skyline[i].x;
+                    outY = y;
+                }
+            }
+            if (bestIndex < 0) {
+                return false;
+            }
+            insert(bestIndex, outX, outY + h, w);
+            return true;
+        }
+
+        int Width;
+        int Height;
+
+    private:
+        struct Node {
+            int x;
+            int y;
+            int width;
+        };
+        std::vector<Node> skyline;
+
+        // the rectangle rests on the highest node it spans starting at node i
+        bool fits(size_t i, int w, int h, int &y) const {
+            if (skyline[i].x + w > Width) {
+                return false;
+            }
+            y = 0;
+            int remaining = w;
+            for (size_t j = i; remaining > 0; j++) {
+                if (j == skyline.size()) {
+                    return false;
+                }
+                y = std::max(y, skyline[j].y);
+                if (y + h > Height) {
+                    return false;
+                }
+                remaining -= skyline[j].width;
+            }
+            return true;
+        }
+
+        void insert(int index, int x, int y, int w) {
+            skyline.insert(skyline.begin() + index, Node{ x, y, w });
+            // trim or drop the nodes now hidden under the new one
+            for (size_t i = index + 1; i < skyline.size(); ) {
+                Node &previous = skyline[i - 1];
+                int overlap = previous.x + previous.width - skyline[i].x;
+                if (overlap <= 0) {
+                    break;
+                }
+                skyline[i].x += overlap;
+                skyline[i].width -= overlap;
+                if (skyline[i].width > 0) {
+                    break;
+                }
+                skyline.erase(skyline.begin() + i);
+            }
+            // merge neighbours at the same height
+            for (size_t i = 0; i + 1 < skyline.size(); ) {
+                if (skyline[i].y == skyline[i + 1].y) {
+                    skyline[i].width += skyline[i + 1].width;
+                    skyline.erase(skyline.begin() + i + 1);
+                } else {
+                    i++;
+                }
+            }
+        }
+};
+
+// where a packed image ended up: which array texture, which layer and the
+// sub rectangle of that layer as (offset.x, offset.y, scale.x, scale.y) in uv space
+struct TextureSlot {
+    int array;
+    int layer;
+    glm::vec4 uvRect;
+};
+
+// per instance attributes for the batched shader
+struct InstanceTexture {
+    glm::vec4 uvRect;
+    float layer;
+};
+
+// instances that can go in one draw because they all sample the same array texture
+struct TextureBatch {
+    int array;
+    std::vector<int> instances;
+    std::vector<InstanceTexture> data;
+};
+
+// groups textures into GL_TEXTURE_2D_ARRAY objects so objects with different
+// materials can share a draw call. images of the same size that show up more
+// than once (or are too big for the atlas) become whole layers of an array,
+// everything else is packed into atlas pages that are layers of one more array.
+// all layers are stored as RGBA8
+class TexturePacker {
+    public:
+        TexturePacker(int atlasSize = 2048, int maxAtlasImage = 512, int padding = 4)
+            : atlasSize(atlasSize), maxAtlasImage(maxAtlasImage), padding(padding) {}
+
+        ~TexturePacker() {
+            Release();
+        }
+
+        TexturePacker(const TexturePacker&) = delete;
+        TexturePacker& operator=(const TexturePacker&) = delete;
+
+        // pixels must stay valid until Upload has run. returns the image id
+        int Add(const unsigned char *pixels, int width, int height, int channels) {
+            images.push_back(Image{ pixels, width, height, channels });
+            return (int)images.size() - 1;
+        }
+
+        // decides array, layer and rectangle for every image added so far
+        void Pack() {
+            arrays.clear();
+            slots.assign(images.size(), TextureSlot{ -1, 0, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) });
+
+            std::map<std::pair<int, int>, std::vector<int>> bySize;
+            for (size_t i = 0; i < images.size(); i++) {
+                bySize[{ images[i].width, images[i].height }].push_back((int)i);
+            }
+
+            const int atlasLimit = std::min(maxAtlasImage, atlasSize - padding * 2);
+            std::vector<int> atlasImages;
+            for (auto &group : bySize) {
+                const std::vector<int> &members = group.second;
+                bool tooBig = group.first.first > atlasLimit || group.first.second > atlasLimit;
+                if (members.size() < 2 && !tooBig) {
+                    atlasImages.push_back(members[0]);
+                    continue;
+                }
+                ArrayPlan plan;
+                plan.width = group.first.first;
+                plan.height = group.first.second;
+                plan.layers = (int)members.size();
+                plan.levels = 0;
+                for (size_t layer = 0; layer < members.size(); layer++) {
+                    plan.placements.push_back(Placement{ members[layer], (int)layer, 0, 0 });
+                    slots[members[layer]] = TextureSlot{ (int)arrays.size(), (int)layer, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) };
+                }
+                arrays.push_back(plan);
+            }
+
+            if (!atlasImages.empty()) {
+                packAtlas(atlasImages);
+            }
+        }
+
+        // creates the array textures, builds their mips and uploads every layer
+        void Upload(const MipSettings &settings = MipSettings()) {
+            if (!textures.empty()) {
+                glDeleteTextures((GLsizei)textures.size(), textures.data());
+            }
+            textures.assign(arrays.size(), 0);
+            glGenTextures((GLsizei)textures.size(), textures.data());
+
+            GLint previousAlignment;
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (size_t a = 0; a < arrays.size(); a++) {
+                const ArrayPlan &plan = arrays[a];
+                glBindTexture(GL_TEXTURE_2D_ARRAY, textures[a]);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, plan.atlas ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, plan.atlas ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+                MipSettings layerSettings = settings;
+                layerSettings.maxLevels = plan.levels;
+                bool allocated = false;
+                for (int layer = 0; layer < plan.layers; layer++) {
+                    std::vector<unsigned char> pixels = composeLayer(plan, layer);
+                    MipChain mips = generateMipChain(pixels.data(), plan.width, plan.height, 4, layerSettings);
+                    if (!allocated) {
+                        for (size_t level = 0; level < mips.levels.size(); level++) {
+                            glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, GL_RGBA8, mips.levels[level].width, mips.levels[level].height,
+                                         plan.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                        }
+                        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)mips.levels.size() - 1);
+                        allocated = true;
+                    }
+                    for (size_t level = 0; level < mips.levels.size(); level++) {
+                        const MipLevel &mip = mips.levels[level];
+                        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, layer, mip.width, mip.height, 1,
+                                        GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels.data());
+                    }
+                }
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+        }
+
+        const TextureSlot& Slot(int image) const {
+            return slots[image];
+        }
+
+        int ArrayCount() const {
+            return (int)arrays.size();
+        }
+
+        unsigned int ArrayTexture(int array) const {
+            return textures[array];
+        }
+
+        // deletes the array textures, call before the context goes away
+        void Release() {
+            if (!textures.empty()) {
+                glDeleteTextures((GLsizei)textures.size(), textures.data());
+                textures.clear();
+            }
+        }
+
+        // splits a list of per instance image ids into one batch per array texture.
+        // empty when images were added since the last Pack, instances with an image
+        // id that wasn't added or wasn't placed are left out
+        std::vector<TextureBatch> BuildBatches(const std::vector<int> &instanceImages) const {
+            if (slots.size() != images.size()) {
+                return std::vector<TextureBatch>();
+            }
+            std::vector<TextureBatch> batches(arrays.size());
+            for (size_t a = 0; a < arrays.size(); a++) {
+                batches[a].array = (int)a;
+            }
+            for (size_t i = 0; i < instanceImages.size(); i++) {
+                int image = instanceImages[i];
+                if (image < 0 || image >= (int)slots.size()) {
+                    continue;
+                }
+                const TextureSlot &slot = slots[image];
+                if (slot.array < 0 || slot.array >= (int)batches.size()) {
+                    continue;
+                }
+                batches[slot.array].instances.push_back((int)i);
+                batches[slot.array].data.push_back(InstanceTexture{ slot.uvRect, (float)slot.layer });
+            }
+            batches.erase(std::remove_if(batches.begin(), batches.end(),
+                                         [](const TextureBatch &b) { return b.instances.empty(); }), batches.end());
+            return batches;
+        }
+
+    private:
+        struct Image {
+            const unsigned char *pixels;
+            int width;
+            int height;
+            int channels;
+        };
+        struct Placement {
+            int image;
+            int layer;
+            int x;
+            int y;
+        };
+        struct ArrayPlan {
+            int width;
+            int height;
+            int layers;
+            int levels;
+            bool atlas = false;
+            std::vector<Placement> placements;
+        };
+
+        int atlasSize;
+        int maxAtlasImage;
+        int padding;
+        std::vector<Image> images;
+        std::vector<TextureSlot> slots;
+        std::vector<ArrayPlan> arrays;
+        std::vector<GLuint> textures;
+
+        void packAtlas(std::vector<int> &members) {
+            // tallest first packs noticeably tighter with a skyline
+            std::sort(members.begin(), members.end(), [this](int a, int b) {
+                return images[a].height > images[b].height;
+            });
+
+            ArrayPlan plan;
+            plan.width = atlasSize;
+            plan.height = atlasSize;
+            plan.layers = 1;
+            plan.atlas = true;
+            // only keep the levels where the padding still separates neighbours
+            plan.levels = 1;
+            for (int p = padding; p > 1; p /= 2) {
+                plan.levels++;
+            }
+
+            const int arrayIndex = (int)arrays.size();
+            SkylinePacker packer(atlasSize, atlasSize);
+            for (int image : members) {
+                int w = images[image].width + padding * 2;
+                int h = images[image].height + padding * 2;
+                int x = 0, y = 0;
+                if (!packer.Pack(w, h, x, y)) {
+                    packer.Reset(atlasSize, atlasSize);
+                    plan.layers++;
+                    // Pack only sends images up to atlasLimit here, with their padding
+                    // they always fit an empty layer
+                    bool placed = packer.Pack(w, h, x, y);
+                    assert(placed);
+                    if (!placed) {
+                        continue;
+                    }
+                }
+                int layer = plan.layers - 1;
+                plan.placements.push_back(Placement{ image, layer, x + padding, y + padding });
+                slots[image] = TextureSlot{ arrayIndex, layer, glm::vec4(
+                    (float)(x + padding) / atlasSize, (float)(y + padding) / atlasSize,
+                    (float)images[image].width / atlasSize, (float)images[image].height / atlasSize) };
+            }
+            arrays.push_back(plan);
+        }
+
+        // RGBA pixels of one layer, atlas entries get their edges extruded into the padding
+        std::vector<unsigned char> composeLayer(const ArrayPlan &plan, int layer) const {
+            std::vector<unsigned char> pixels((size_t)plan.width * plan.height * 4, 0);
+            const int border = plan.atlas ? padding : 0;
+            for (const Placement &placement : plan.placements) {
+                if (placement.layer != layer) {
+                    continue;
+                }
+                const Image &image = images[placement.image];
+                for (int y = -border; y < image.height + border; y++) {
+                    int sy = std::min(std::max(y, 0), image.height - 1);
+                    unsigned char *dst = &pixels[((size_t)(placement.y + y) * plan.width + placement.x - border) * 4];
+                    for (int x = -border; x < image.width + border; x++, dst += 4) {
+                        int sx = std::min(std::max(x, 0), image.width - 1);
+                        const unsigned char *src = image.pixels + ((size_t)sy * image.width + sx) * image.channels;
+                        switch (image.channels) {
+                            case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+                            case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+                            case 3: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+                            default: std::memcpy(dst, src, 4); break;
+                        }
+                    }
+                }
+            }
+            return pixels;
+        }
+};
+
+// binds a buffer of InstanceTexture as per instance attributes: uvRect at location, layer at location + 1
+inline void setupInstanceTextureAttributes(unsigned int buffer, unsigned int location) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTexture), (void*)offsetof(InstanceTexture, uvRect));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+    glVertexAttribPointer(location + 1, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceTexture), (void*)offsetof(InstanceTexture, layer));
+    glEnableVertexAttribArray(location + 1);
+    glVertexAttribDivisor(location + 1, 1);
+}
+
+#endif
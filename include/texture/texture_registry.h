@@ -0,0 +1,302 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include "texture/mipmap.h"
+#include "texture/texture_format.h"
+#include "util/hash.h"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// how a texture is created from decoded pixels. part of the dedup key, the same
+// pixels with different settings are different textures
+struct TextureDesc {
+    GLenum internalFormat = GL_RGBA;
+    bool mipmaps = true;
+    MipSettings mipSettings;
+    GLenum wrap = GL_REPEAT;
+    GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+};
+
+// one GL texture owned by the registry, for the dashboards
+struct TextureRecord {
+    unsigned int texture;
+    std::string label;
+    int width;
+    int height;
+    int channels;
+    int levels;
+    GLenum internalFormat;
+    // estimate of what the driver stores, all levels in the internal format
+    size_t gpuBytes;
+    int references;
+};
+
+struct TextureMemoryStats {
+    int textures;
+    int references;
+    size_t gpuBytes;
+    // reported by TrackExternal, e.g. streamed textures and atlases
+    size_t externalBytes;
+    // acquires that found an identical texture, and the bytes they didn't upload
+    size_t dedupHits;
+    size_t dedupBytesSaved;
+};
+
+class TextureRegistry;
+
+// reference counted share of a registry texture. copies add a reference, the
+// texture is deleted when the last handle goes away. must not outlive the registry
+class TextureHandle {
+    public:
+        TextureHandle() : registry(nullptr), id(-1) {}
+
+        TextureHandle(const TextureHandle &other) : registry(other.registry), id(other.id) {
+            retain();
+        }
+
+        TextureHandle(TextureHandle &&other) : registry(other.registry), id(other.id) {
+            other.registry = nullptr;
+            other.id = -1;
+        }
+
+        TextureHandle& operator=(TextureHandle other) {
+            std::swap(registry, other.registry);
+            std::swap(id, other.id);
+            return *this;
+        }
+
+        ~TextureHandle() {
+            Reset();
+        }
+
+        void Reset();
+
+        bool Valid() const {
+            return registry != nullptr;
+        }
+
+        unsigned int Texture() const;
+
+    private:
+        friend class TextureRegistry;
+
+        TextureRegistry *registry;
+        int id;
+
+        TextureHandle(TextureRegistry *registry, int id) : registry(registry), id(id) {}
+
+        void retain();
+};
+
+// creates GL textures from decoded images and hands out shared handles. the
+// pixels are hashed with xxHash64 together with the size and TextureDesc, so
+// loading the same image twice, from the same file or not, gives the same texture.
+// also keeps an estimate of the GPU memory of everything it owns
+class TextureRegistry {
+    public:
+        TextureRegistry() : dedupHits(0), dedupBytesSaved(0) {}
+
+        ~TextureRegistry() {
+            Release();
+        }
+
+        TextureRegistry(const TextureRegistry&) = delete;
+        TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+        // returns the texture for these pixels, creating it on first use. needs the GL context
+        TextureHandle Acquire(const unsigned char *pixels, int width, int height, int channels,
+                              const TextureDesc &desc = TextureDesc(), const std::string &label = "") {
+            uint64_t key = contentKey(pixels, width, height, channels, desc);
+            auto found = lookup.find(key);
+            if (found != lookup.end()) {
+                Entry &entry = entries[found->second];
+                entry.references++;
+                dedupHits++;
+                dedupBytesSaved += entry.gpuBytes;
+                return TextureHandle(this, found->second);
+            }
+
+            Entry entry;
+            entry.key = key;
+            entry.label = label;
+            entry.width = width;
+            entry.height = height;
+            entry.channels = channels;
+            entry.internalFormat = desc.internalFormat;
+            entry.references = 1;
+
+            glGenTextures(1, &entry.texture);
+            glBindTexture(GL_TEXTURE_2D, entry.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, desc.wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, desc.wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+            if (desc.mipmaps) {
+                MipChain chain = generateMipChain(pixels, width, height, channels, desc.mipSettings);
+                uploadMipChain(GL_TEXTURE_2D, chain, desc.internalFormat);
+                entry.levels = (int)chain.levels.size();
+            } else {
+                GLint previousAlignment;
+                glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, width, height, 0,
+                             pixelFormatForChannels(channels), GL_UNSIGNED_BYTE, pixels);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+                entry.levels = 1;
+            }
+            entry.gpuBytes = mipChainBytes(width, height, 0, entry.levels, desc.internalFormat);
+
+            int id;
+            if (!freeIds.empty()) {
+                id = freeIds.back();
+                freeIds.pop_back();
+                entries[id] = std::move(entry);
+            } else {
+                id = (int)entries.size();
+                entries.push_back(std::move(entry));
+            }
+            lookup[key] = id;
+            return TextureHandle(this, id);
+        }
+
+        unsigned int Texture(const TextureHandle &handle) const {
+            return handle.registry == this ? entries[handle.id].texture : 0;
+        }
+
+        // memory owned elsewhere that should show up in the totals. the callback is
+        // asked every time Stats is called
+        void TrackExternal(const std::string &label, std::function<size_t()> bytes) {
+            external.push_back(External{ label, std::move(bytes) });
+        }
+
+        TextureMemoryStats Stats() const {
+            TextureMemoryStats stats = { 0, 0, 0, 0, dedupHits, dedupBytesSaved };
+            for (const Entry &entry : entries) {
+                if (entry.references > 0) {
+                    stats.textures++;
+                    stats.references += entry.references;
+                    stats.gpuBytes += entry.gpuBytes;
+                }
+            }
+            for (const External &source : external) {
+                stats.externalBytes += source.bytes();
+            }
+            return stats;
+        }
+
+        // every live texture, largest first
+        std::vector<TextureRecord> Records() const {
+            std::vector<TextureRecord> records;
+            for (const Entry &entry : entries) {
+                if (entry.references > 0) {
+                    records.push_back(TextureRecord{ entry.texture, entry.label, entry.width, entry.height, entry.channels,
+                                                     entry.levels, entry.internalFormat, entry.gpuBytes, entry.references });
+                }
+            }
+            std::sort(records.begin(), records.end(), [](const TextureRecord &a, const TextureRecord &b) {
+                return a.gpuBytes > b.gpuBytes;
+            });
+            return records;
+        }
+
+        // deletes every texture even if handles are still around, call before the
+        // context goes away. handles left over must only be destroyed afterwards
+        void Release() {
+            for (Entry &entry : entries) {
+                if (entry.references > 0) {
+                    glDeleteTextures(1, &entry.texture);
+                }
+                entry.references = 0;
+                entry.texture = 0;
+            }
+            lookup.clear();
+            external.clear();
+        }
+
+    private:
+        friend class TextureHandle;
+
+        struct Entry {
+            uint64_t key = 0;
+            std::string label;
+            unsigned int texture = 0;
+            int width = 0;
+            int height = 0;
+            int channels = 0;
+            int levels = 0;
+            GLenum internalFormat = GL_RGBA;
+            size_t gpuBytes = 0;
+            int references = 0;
+        };
+
+        struct External {
+            std::string label;
+            std::function<size_t()> bytes;
+        };
+
+        std::vector<Entry> entries;
+        std::vector<int> freeIds;
+        std::unordered_map<uint64_t, int> lookup;
+        std::vector<External> external;
+        size_t dedupHits;
+        size_t dedupBytesSaved;
+
+        static uint64_t contentKey(const unsigned char *pixels, int width, int height, int channels, const TextureDesc &desc) {
+            uint64_t h = hashBytes64(pixels, (size_t)width * height * channels);
+            const uint64_t fields[] = {
+                (uint64_t)width, (uint64_t)height, (uint64_t)channels, desc.internalFormat, desc.mipmaps,
+                (uint64_t)desc.mipSettings.filter, desc.mipSettings.srgb, (uint64_t)(desc.mipSettings.alphaCutoff * 65536.0f),
+                desc.mipSettings.wrap, (uint64_t)desc.mipSettings.maxLevels, desc.wrap, desc.minFilter, desc.magFilter
+            };
+            return hashBytes64(fields, sizeof(fields), h);
+        }
+
+        void retain(int id) {
+            entries[id].references++;
+        }
+
+        void release(int id) {
+            Entry &entry = entries[id];
+            if (entry.references <= 0) {
+                return;
+            }
+            if (--entry.references == 0) {
+                glDeleteTextures(1, &entry.texture);
+                entry.texture = 0;
+                auto found = lookup.find(entry.key);
+                if (found != lookup.end() && found->second == id) {
+                    lookup.erase(found);
+                }
+                freeIds.push_back(id);
+            }
+        }
+};
+
+inline void TextureHandle::Reset() {
+    if (registry) {
+        registry->release(id);
+    }
+    registry = nullptr;
+    id = -1;
+}
+
+inline unsigned int TextureHandle::Texture() const {
+    return registry ? registry->Texture(*this) : 0;
+}
+
+inline void TextureHandle::retain() {
+    if (registry) {
+        registry->retain(id);
+    }
+}
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "texture/mipmap.h"
+#include "texture/texture_format.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// fills `out` with the pixels of one mip level. runs on a pool thread
+typedef std::function<bool(int level, MipLevel &out)> MipLoader;
+
+// per texture counters
+struct TextureResidencyInfo {
+    unsigned int texture;
+    int levelCount;
+    // finest level with data on the gpu, GL_TEXTURE_BASE_LEVEL is clamped to it
+    int residentLevel;
+    // finest level any object asked for in the last updated frame
+    int wantedLevel;
+    size_t residentBytes;
+};
+
+struct ResidencyCounters {
+    size_t budgetBytes;
+    size_t residentBytes;
+    int textures;
+    int pendingLoads;
+    int uploadsThisFrame;
+    int evictionsThisFrame;
+};
+
+// streams mip levels in and out of textures based on how large the objects using
+// them appear on screen. each texture starts with only its small tail levels
+// resident and gains finer levels one at a time, loaded on the thread pool and
+// uploaded in Update. when the budget is exceeded the finest levels of the least
+// recently used textures are dropped again. the GL texture name never changes
+class TextureResidency {
+    public:
+        // levels at or below this size are loaded at registration and never evicted
+        static const int TAIL_SIZE = 64;
+
+        TextureResidency(size_t budgetBytes, size_t uploadBytesPerFrame = 8 * 1024 * 1024)
+            : budgetBytes(budgetBytes), uploadBytesPerFrame(uploadBytesPerFrame), frame(0),
+              uploadsThisFrame(0), evictionsThisFrame(0) {}
+
+        ~TextureResidency() {
+            Release();
+        }
+
+        TextureResidency(const TextureResidency&) = delete;
+        TextureResidency& operator=(const TextureResidency&) = delete;
+
+        // registers a texture whose levels come from loader. the tail levels are loaded
+        // right away on this thread so the texture is always usable. needs the GL context
+        int Register(int width, int height, int channels, int levelCount, GLenum internalFormat, MipLoader loader) {
+            entries.emplace_back();
+            Entry &entry = entries.back();
+            entry.width = width;
+            entry.height = height;
+            entry.channels = channels;
+            entry.levelCount = levelCount;
+            entry.internalFormat = internalFormat;
+            entry.loader = std::move(loader);
+            entry.wantedLevel = levelCount - 1;
+            entry.lastWantedLevel = levelCount - 1;
+            entry.lastUsedFrame = frame;
+
+            glGenTextures(1, &entry.texture);
+            glBindTexture(GL_TEXTURE_2D, entry.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+            entry.tailLevel = levelCount - 1;
+            while (entry.tailLevel > 0 && std::max(width >> (entry.tailLevel - 1), height >> (entry.tailLevel - 1)) <= TAIL_SIZE) {
+                entry.tailLevel--;
+            }
+            entry.residentLevel = levelCount;
+            for (int level = levelCount - 1; level >= entry.tailLevel; level--) {
+                MipLevel data;
+                if (!entry.loader(level, data)) {
+                    break;
+                }
+                upload(entry, level, data);
+            }
+            entry.tailLevel = entry.residentLevel;
+            return (int)entries.size() - 1;
+        }
+
+        // convenience for data that is already fully in memory
+        int Register(std::shared_ptr<const MipChain> chain, GLenum internalFormat) {
+            const MipLevel &top = chain->levels[0];
+            return Register(top.width, top.height, chain->channels, (int)chain->levels.size(), internalFormat,
+                [chain](int level, MipLevel &out) {
+                    out = chain->levels[level];
+                    return true;
+                });
+        }
+
+        // asks for the level that gives about one texel per pixel at this on-screen size
+        void RequestScreenSize(int id, float pixels) {
+            Entry &entry = entries[id];
+            float texels = (float)std::max(entry.width, entry.height);
+            int level = pixels > 0.0f ? (int)std::floor(std::log2(std::max(1.0f, texels / pixels))) : entry.levelCount - 1;
+            level = std::min(std::max(level, 0), entry.levelCount - 1);
+            entry.wantedLevel = std::min(entry.wantedLevel, level);
+            entry.lastUsedFrame = frame;
+        }
+
+        // projects a bounding sphere with the camera's field of view and requests that size
+        void RequestForObject(int id, const glm::vec3 &center, float radius, const Camera &camera, float viewportHeight) {
+            float distance = std::max(glm::length(center - camera.Position) - radius, 0.01f);
+            float pixels = radius * viewportHeight / (distance * std::tan(glm::radians(camera.Zoom) * 0.5f));
+            RequestScreenSize(id, pixels);
+        }
+
+        // call once per frame on the GL thread after the requests: uploads finished
+        // loads, starts new ones and evicts down to the budget
+        void Update() {
+            uploadsThisFrame = 0;
+            evictionsThisFrame = 0;
+            size_t uploaded = 0;
+
+            for (Entry &entry : entries) {
+                if (!entry.pending.valid() || entry.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    continue;
+                }
+                std::unique_ptr<MipLevel> data = entry.pending.get();
+                int level = entry.pendingLevel;
+                entry.pendingLevel = -1;
+                // skip data nobody wants any more, e.g. the object moved away while loading
+                if (data && level == entry.residentLevel - 1 && level >= entry.wantedLevel) {
+                    upload(entry, level, *data);
+                    uploaded += data->pixels.size();
+                    uploadsThisFrame++;
+                }
+            }
+
+            // finer levels for the textures that are visible, closest to their target first
+            std::vector<int> order;
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (entries[i].wantedLevel < entries[i].residentLevel && !entries[i].pending.valid()) {
+                    order.push_back((int)i);
+                }
+            }
+            std::sort(order.begin(), order.end(), [this](int a, int b) {
+                return entries[a].residentLevel - entries[a].wantedLevel < entries[b].residentLevel - entries[b].wantedLevel;
+            });
+            for (int id : order) {
+                Entry &entry = entries[id];
+                int level = entry.residentLevel - 1;
+                size_t bytes = mipLevelBytes(entry.width, entry.height, level, entry.internalFormat);
+                if (uploaded + bytes > uploadBytesPerFrame && uploaded > 0) {
+                    break;
+                }
+                if (!makeRoom(bytes, id)) {
+                    continue;
+                }
+                entry.pendingLevel = level;
+                MipLoader loader = entry.loader;
+                entry.pending = ThreadPool::Shared().Enqueue([loader, level]() -> std::unique_ptr<MipLevel> {
+                    std::unique_ptr<MipLevel> data(new MipLevel());
+                    if (!loader(level, *data)) {
+                        return nullptr;
+                    }
+                    return data;
+                });
+            }
+
+            // objects that dropped out of view give memory back when we are over budget
+            makeRoom(0, -1);
+
+            for (Entry &entry : entries) {
+                entry.lastWantedLevel = entry.wantedLevel;
+                entry.wantedLevel = entry.levelCount - 1;
+            }
+            frame++;
+        }
+
+        unsigned int Texture(int id) const {
+            return entries[id].texture;
+        }
+
+        TextureResidencyInfo Info(int id) const {
+            const Entry &entry = entries[id];
+            return TextureResidencyInfo{ entry.texture, entry.levelCount, entry.residentLevel, entry.lastWantedLevel, entry.residentBytes };
+        }
+
+        ResidencyCounters Counters() const {
+            ResidencyCounters counters = { budgetBytes, 0, (int)entries.size(), 0, uploadsThisFrame, evictionsThisFrame };
+            for (const Entry &entry : entries) {
+                counters.residentBytes += entry.residentBytes;
+                counters.pendingLoads += entry.pending.valid() ? 1 : 0;
+            }
+            return counters;
+        }
+
+        // waits for outstanding loads and deletes every texture, call before the context goes away
+        void Release() {
+            for (Entry &entry : entries) {
+                if (entry.pending.valid()) {
+                    entry.pending.wait();
+                }
+                glDeleteTextures(1, &entry.texture);
+            }
+            entries.clear();
+        }
+
+        void SetBudget(size_t bytes) {
+            budgetBytes = bytes;
+        }
+
+    private:
+        struct Entry {
+            unsigned int texture = 0;
+            int width = 0;
+            int height = 0;
+            int channels = 0;
+            int levelCount = 0;
+            GLenum internalFormat = GL_RGBA8;
+            MipLoader loader;
+            int tailLevel = 0;
+            int residentLevel = 0;
+            int wantedLevel = 0;
+            int lastWantedLevel = 0;
+            size_t residentBytes = 0;
+            unsigned long long lastUsedFrame = 0;
+            int pendingLevel = -1;
+            std::future<std::unique_ptr<MipLevel>> pending;
+        };
+
+        // loads only capture a copy of the loader, so entries may move when this grows
+        std::vector<Entry> entries;
+        size_t budgetBytes;
+        size_t uploadBytesPerFrame;
+        unsigned long long frame;
+        int uploadsThisFrame;
+        int evictionsThisFrame;
+
+        size_t totalResident() const {
+            size_t bytes = 0;
+            for (const Entry &entry : entries) {
+                bytes += entry.residentBytes;
+            }
+            return bytes;
+        }
+
+        void upload(Entry &entry, int level, const MipLevel &data) {
+            glBindTexture(GL_TEXTURE_2D, entry.texture);
+            GLint previousAlignment;
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, level, entry.internalFormat, data.width, data.height, 0,
+                         pixelFormatForChannels(entry.channels), GL_UNSIGNED_BYTE, data.pixels.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+            entry.residentLevel = level;
+            entry.residentBytes += mipLevelBytes(entry.width, entry.height, level, entry.internalFormat);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.residentLevel);
+        }
+
+        // drops the finest resident level. levels below the base level are ignored for
+        // completeness, so respecifying the level as 0x0 releases it and keeps the name
+        void evictFinest(Entry &entry) {
+            int level = entry.residentLevel;
+            glBindTexture(GL_TEXTURE_2D, entry.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+            glTexImage2D(GL_TEXTURE_2D, level, entry.internalFormat, 0, 0, 0,
+                         pixelFormatForChannels(entry.channels), GL_UNSIGNED_BYTE, NULL);
+            entry.residentLevel = level + 1;
+            entry.residentBytes -= mipLevelBytes(entry.width, entry.height, level, entry.internalFormat);
+            evictionsThisFrame++;
+        }
+
+        // evicts least recently used levels until `bytes` more fit in the budget.
+        // never touches the tail, the requesting texture or levels wanted this frame
+        bool makeRoom(size_t bytes, int requester) {
+            size_t resident = totalResident();
+            while (resident + bytes > budgetBytes) {
+                Entry *victim = nullptr;
+                for (size_t i = 0; i < entries.size(); i++) {
+                    Entry &entry = entries[i];
+                    bool wanted = entry.lastUsedFrame == frame && entry.residentLevel >= entry.wantedLevel;
+                    if ((int)i == requester || entry.residentLevel >= entry.tailLevel || wanted) {
+                        continue;
+                    }
+                    if (!victim || entry.lastUsedFrame < victim->lastUsedFrame) {
+                        victim = &entry;
+                    }
+                }
+                if (!victim) {
+                    return false;
+                }
+                size_t before = victim->residentBytes;
+                evictFinest(*victim);
+                resident -= before - victim->residentBytes;
+            }
+            return true;
+        }
+};
+
+#endif
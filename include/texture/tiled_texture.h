@@ -0,0 +1,315 @@
+#ifndef TILED_TEXTURE_H
+#define TILED_TEXTURE_H
+
+#include "images/qoi.h"
+#include "texture/mipmap.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// tiled mip file for virtual texturing (.vtex). the image is padded to a square
+// power of two number of pages, every level is cut into pages of pageSize texels
+// plus `border` texels copied from the neighbouring pages on each side, so the
+// pages can be filtered bilinearly once they sit next to unrelated pages in the
+// cache. pages are qoi encoded and can be read one at a time from any thread.
+//
+// layout, little endian:
+//   "VTEX", version, width, height, pageSize, border, levels, pagesPerSide   (u32 each)
+//   page index, level 0 first, page rows in image row order: offset (u64), size (u32)
+//   page data
+struct TiledTextureInfo {
+    // size of the image inside the padded virtual texture
+    int width = 0;
+    int height = 0;
+    int pageSize = 0;
+    int border = 0;
+    int levels = 0;
+    // pages across level 0, halves with every level down to 1
+    int pagesPerSide = 0;
+
+    int SlotSize() const {
+        return pageSize + 2 * border;
+    }
+
+    int PagesAt(int level) const {
+        return std::max(1, pagesPerSide >> level);
+    }
+
+    int VirtualSize() const {
+        return pagesPerSide * pageSize;
+    }
+
+    // bytes of one decoded page, always RGBA8
+    size_t PageBytes() const {
+        return (size_t)SlotSize() * SlotSize() * 4;
+    }
+};
+
+namespace tiled_detail {
+
+    const uint32_t VERSION = 1;
+    const int HEADER_WORDS = 8;
+    const int INDEX_ENTRY_BYTES = 12;
+    // page coordinates and levels travel through 8 bit channels in the page table and feedback
+    const int MAX_PAGES_PER_SIDE = 256;
+
+    inline size_t pageCount(const TiledTextureInfo &info) {
+        size_t count = 0;
+        for (int level = 0; level < info.levels; level++) {
+            count += (size_t)info.PagesAt(level) * info.PagesAt(level);
+        }
+        return count;
+    }
+
+    // index of the first page of every level in the page index
+    inline size_t firstPage(const TiledTextureInfo &info, int level) {
+        size_t first = 0;
+        for (int l = 0; l < level; l++) {
+            first += (size_t)info.PagesAt(l) * info.PagesAt(l);
+        }
+        return first;
+    }
+
+    inline void put32(std::vector<unsigned char> &out, uint32_t v) {
+        unsigned char bytes[4];
+        memcpy(bytes, &v, 4);
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    inline void put64(std::vector<unsigned char> &out, uint64_t v) {
+        unsigned char bytes[8];
+        memcpy(bytes, &v, 8);
+        out.insert(out.end(), bytes, bytes + 8);
+    }
+
+    // copies one page with its border out of a level, clamping at the level's edges
+    inline void extractPage(const MipLevel &level, int pageX, int pageY, int pageSize, int border, unsigned char *out) {
+        int slot = pageSize + 2 * border;
+        int x0 = pageX * pageSize - border;
+        int y0 = pageY * pageSize - border;
+        for (int y = 0; y < slot; y++) {
+            int sy = std::min(std::max(y0 + y, 0), level.height - 1);
+            const unsigned char *row = level.pixels.data() + (size_t)sy * level.width * 4;
+            unsigned char *dst = out + (size_t)y * slot * 4;
+            for (int x = 0; x < slot; x++) {
+                int sx = std::min(std::max(x0 + x, 0), level.width - 1);
+                memcpy(dst + x * 4, row + sx * 4, 4);
+            }
+        }
+    }
+
+    // page data can sit past 2GB, where long offsets stop on windows
+    inline int seek(FILE *file, uint64_t offset) {
+#if defined(_WIN32)
+        return _fseeki64(file, (long long)offset, SEEK_SET);
+#else
+        return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+    }
+}
+
+// builds a .vtex file from 8 bit pixels with 1 to 4 channels. page row 0 holds the
+// first image rows, so flip on load like the other GL textures (v = 0 at the bottom).
+// the mips are filtered with generateMipChain and the pages encoded on the pool
+inline bool writeTiledTexture(const std::string &path, const unsigned char *pixels, int width, int height, int channels,
+                              int pageSize = 128, int border = 1, const MipSettings &settings = MipSettings(),
+                              ThreadPool &pool = ThreadPool::Shared()) {
+    using namespace tiled_detail;
+    if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4 || pageSize <= 0 || border < 0 || border >= pageSize) {
+        return false;
+    }
+    TiledTextureInfo info;
+    info.width = width;
+    info.height = height;
+    info.pageSize = pageSize;
+    info.border = border;
+    info.pagesPerSide = 1;
+    info.levels = 1;
+    while (info.pagesPerSide * pageSize < std::max(width, height)) {
+        info.pagesPerSide *= 2;
+        info.levels++;
+    }
+    if (info.pagesPerSide > MAX_PAGES_PER_SIDE) {
+        return false;
+    }
+
+    // pad to the virtual size by repeating the last row and column, always RGBA
+    const int size = info.VirtualSize();
+    std::vector<unsigned char> padded((size_t)size * size * 4);
+    pool.ParallelFor(0, size, [&](int y) {
+        const unsigned char *row = pixels + (size_t)std::min(y, height - 1) * width * channels;
+        unsigned char *dst = padded.data() + (size_t)y * size * 4;
+        for (int x = 0; x < size; x++) {
+            const unsigned char *src = row + std::min(x, width - 1) * channels;
+            if (channels >= 3) {
+                dst[x * 4 + 0] = src[0];
+                dst[x * 4 + 1] = src[1];
+                dst[x * 4 + 2] = src[2];
+            } else {
+                dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = src[0];
+            }
+            dst[x * 4 + 3] = channels == 4 ? src[3] : channels == 2 ? src[1] : 255;
+        }
+    }, 16);
+
+    MipSettings mipSettings = settings;
+    mipSettings.maxLevels = info.levels;
+    MipChain chain = generateMipChain(padded.data(), size, size, 4, mipSettings, pool);
+    std::vector<unsigned char>().swap(padded);
+    if ((int)chain.levels.size() != info.levels) {
+        return false;
+    }
+
+    std::vector<std::vector<unsigned char>> pages(pageCount(info));
+    std::atomic<bool> encoded(true);
+    for (int level = 0; level < info.levels; level++) {
+        const int across = info.PagesAt(level);
+        const size_t first = firstPage(info, level);
+        pool.ParallelFor(0, across * across, [&](int i) {
+            std::vector<unsigned char> page(info.PageBytes());
+            extractPage(chain.levels[level], i % across, i / across, pageSize, border, page.data());
+            if (!qoiEncode(page.data(), info.SlotSize(), info.SlotSize(), 4, pages[first + i])) {
+                encoded = false;
+            }
+        });
+    }
+    if (!encoded) {
+        return false;
+    }
+
+    std::vector<unsigned char> head;
+    head.insert(head.end(), { 'V', 'T', 'E', 'X' });
+    const uint32_t fields[] = { VERSION, (uint32_t)width, (uint32_t)height, (uint32_t)pageSize, (uint32_t)border,
+                                (uint32_t)info.levels, (uint32_t)info.pagesPerSide };
+    for (uint32_t field : fields) {
+        put32(head, field);
+    }
+    uint64_t offset = HEADER_WORDS * 4 + (uint64_t)pages.size() * INDEX_ENTRY_BYTES;
+    for (const std::vector<unsigned char> &page : pages) {
+        put64(head, offset);
+        put32(head, (uint32_t)page.size());
+        offset += page.size();
+    }
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(head.data(), 1, head.size(), file) == head.size();
+    for (const std::vector<unsigned char> &page : pages) {
+        written = written && fwrite(page.data(), 1, page.size(), file) == page.size();
+    }
+    return fclose(file) == 0 && written;
+}
+
+// reads pages of a .vtex file. ReadPage may be called from several threads at
+// once, only the file read itself is serialized, decoding runs in parallel
+class TiledTextureFile {
+    public:
+        TiledTextureFile() : file(nullptr) {}
+
+        ~TiledTextureFile() {
+            Close();
+        }
+
+        TiledTextureFile(const TiledTextureFile&) = delete;
+        TiledTextureFile& operator=(const TiledTextureFile&) = delete;
+
+        bool Open(const std::string &path) {
+            using namespace tiled_detail;
+            Close();
+            file = fopen(path.c_str(), "rb");
+            if (!file) {
+                return false;
+            }
+            unsigned char head[HEADER_WORDS * 4];
+            uint32_t fields[HEADER_WORDS - 1];
+            if (fread(head, 1, sizeof(head), file) != sizeof(head) || memcmp(head, "VTEX", 4) != 0) {
+                Close();
+                return false;
+            }
+            memcpy(fields, head + 4, sizeof(fields));
+            info.width = (int)fields[1];
+            info.height = (int)fields[2];
+            info.pageSize = (int)fields[3];
+            info.border = (int)fields[4];
+            info.levels = (int)fields[5];
+            info.pagesPerSide = (int)fields[6];
+            bool valid = fields[0] == VERSION && info.pageSize > 0 && info.border >= 0 && info.levels > 0 && info.levels <= 9
+                && info.pagesPerSide == 1 << (info.levels - 1) && info.width > 0 && info.height > 0
+                && std::max(info.width, info.height) <= info.VirtualSize();
+            if (!valid) {
+                Close();
+                return false;
+            }
+
+            std::vector<unsigned char> raw(pageCount(info) * INDEX_ENTRY_BYTES);
+            if (fread(raw.data(), 1, raw.size(), file) != raw.size()) {
+                Close();
+                return false;
+            }
+            index.resize(pageCount(info));
+            for (size_t i = 0; i < index.size(); i++) {
+                memcpy(&index[i].offset, &raw[i * INDEX_ENTRY_BYTES], 8);
+                memcpy(&index[i].size, &raw[i * INDEX_ENTRY_BYTES + 8], 4);
+            }
+            return true;
+        }
+
+        void Close() {
+            if (file) {
+                fclose(file);
+                file = nullptr;
+            }
+            index.clear();
+            info = TiledTextureInfo();
+        }
+
+        bool IsOpen() const {
+            return file != nullptr;
+        }
+
+        const TiledTextureInfo& Info() const {
+            return info;
+        }
+
+        // decodes one page with its border into `out`, Info().PageBytes() of RGBA8
+        bool ReadPage(int level, int x, int y, unsigned char *out) {
+            if (level < 0 || level >= info.levels || x < 0 || y < 0 || x >= info.PagesAt(level) || y >= info.PagesAt(level)) {
+                return false;
+            }
+            const Page &page = index[tiled_detail::firstPage(info, level) + (size_t)y * info.PagesAt(level) + x];
+            std::vector<unsigned char> encoded(page.size);
+            {
+                std::lock_guard<std::mutex> lock(readMutex);
+                if (!file || tiled_detail::seek(file, page.offset) != 0 || fread(encoded.data(), 1, encoded.size(), file) != encoded.size()) {
+                    return false;
+                }
+            }
+            int w, h, c;
+            if (!qoiInfo(encoded.data(), encoded.size(), &w, &h, &c) || w != info.SlotSize() || h != info.SlotSize()) {
+                return false;
+            }
+            return qoiDecodeInto(encoded.data(), encoded.size(), out, info.PageBytes(), 0, 4);
+        }
+
+    private:
+        struct Page {
+            uint64_t offset = 0;
+            uint32_t size = 0;
+        };
+
+        FILE *file;
+        TiledTextureInfo info;
+        std::vector<Page> index;
+        std::mutex readMutex;
+};
+
+#endif
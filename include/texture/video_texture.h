@@ -0,0 +1,489 @@
+#ifndef VIDEO_TEXTURE_H
+#define VIDEO_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "images/qoi.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// decodes one encoded image into `out`, outSize bytes of RGBA8 rows bottom to top
+// like every GL texture. with out == nullptr it only reports the size. runs on pool
+// threads. the default handles qoi, for jpeg and png pass one that calls
+// stbi_load_from_memory_into (stb_image is compiled in main.cpp). that already
+// writes the rows bottom up while stbi_set_flip_vertically_on_load is set, which
+// pool threads read from the global flag
+typedef std::function<bool(const unsigned char *data, size_t size, unsigned char *out, size_t outSize,
+                           int *width, int *height)> ImageDecoder;
+
+inline bool decodeQoiFrame(const unsigned char *data, size_t size, unsigned char *out, size_t outSize, int *width, int *height) {
+    int channels;
+    if (!qoiInfo(data, size, width, height, &channels)) {
+        return false;
+    }
+    return !out || qoiDecodeInto(data, size, out, outSize, 0, 4, true);
+}
+
+// frames of a video, all the same size. Decode is called from pool threads,
+// several frames at once, so it must not keep state between calls
+class VideoFrameSource {
+    public:
+        virtual ~VideoFrameSource() {}
+
+        virtual int Width() const = 0;
+        virtual int Height() const = 0;
+        virtual int FrameCount() const = 0;
+        virtual double FrameRate() const = 0;
+
+        // writes frame `index` as RGBA8 rows bottom to top, Width() * Height() * 4 bytes
+        virtual bool Decode(int index, unsigned char *out) = 0;
+};
+
+// numbered image files, one per frame
+class ImageSequenceSource : public VideoFrameSource {
+    public:
+        ImageSequenceSource() : width(0), height(0), frameRate(30.0) {}
+
+        // `path` is a directory, whose images are played in name order, or a printf
+        // pattern such as "frames/%04d.jpg" counted up from 0 or 1 until a file is missing
+        bool Open(const std::string &path, double framesPerSecond = 30.0, ImageDecoder imageDecoder = ImageDecoder()) {
+            files.clear();
+            decoder = imageDecoder ? std::move(imageDecoder) : ImageDecoder(decodeQoiFrame);
+            frameRate = framesPerSecond > 0.0 ? framesPerSecond : 30.0;
+            std::error_code error;
+            if (path.find('%') != std::string::npos) {
+                char name[1024];
+                for (int first = 0; first <= 1 && files.empty(); first++) {
+                    for (int i = first; ; i++) {
+                        snprintf(name, sizeof(name), path.c_str(), i);
+                        if (!std::filesystem::is_regular_file(name, error)) {
+                            break;
+                        }
+                        files.push_back(name);
+                    }
+                }
+            } else if (std::filesystem::is_directory(path, error)) {
+                for (const auto &entry : std::filesystem::directory_iterator(path, error)) {
+                    std::string extension = entry.path().extension().string();
+                    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+                    if (entry.is_regular_file() && (extension == ".jpg" || extension == ".jpeg" || extension == ".png"
+                                                     || extension == ".qoi" || extension == ".tga" || extension == ".bmp")) {
+                        files.push_back(entry.path().string());
+                    }
+                }
+                std::sort(files.begin(), files.end());
+            }
+            if (files.empty()) {
+                return false;
+            }
+            std::vector<unsigned char> data = readFile(files[0]);
+            if (data.empty() || !decoder(data.data(), data.size(), nullptr, 0, &width, &height) || width <= 0 || height <= 0) {
+                files.clear();
+                return false;
+            }
+            return true;
+        }
+
+        int Width() const override {
+            return width;
+        }
+
+        int Height() const override {
+            return height;
+        }
+
+        int FrameCount() const override {
+            return (int)files.size();
+        }
+
+        double FrameRate() const override {
+            return frameRate;
+        }
+
+        bool Decode(int index, unsigned char *out) override {
+            if (index < 0 || index >= (int)files.size()) {
+                return false;
+            }
+            std::vector<unsigned char> data = readFile(files[index]);
+            int w, h;
+            // every frame must match the first, the pixel buffers are sized for it
+            if (data.empty() || !decoder(data.data(), data.size(), nullptr, 0, &w, &h) || w != width || h != height) {
+                return false;
+            }
+            return decoder(data.data(), data.size(), out, (size_t)width * height * 4, &w, &h);
+        }
+
+    private:
+        std::vector<std::string> files;
+        ImageDecoder decoder;
+        int width;
+        int height;
+        double frameRate;
+
+        static std::vector<unsigned char> readFile(const std::string &path) {
+            std::ifstream file(path, std::ios::binary);
+            return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+};
+
+struct VideoTextureSettings {
+    // pixel buffer + texture pairs: one is shown, the rest decode and upload ahead
+    int ringSize = 4;
+    int maxUploadsPerFrame = 2;
+    bool loop = true;
+    // video seconds per clock second
+    double speed = 1.0;
+};
+
+struct VideoTextureStats {
+    // frame number on the video clock that should be on screen, and the one that is
+    long long dueFrame;
+    long long shownFrame;
+    long long presentedFrames;
+    // frames that were never shown because a later frame was already due
+    long long droppedFrames;
+    // due frames that weren't uploaded in time, an older frame stayed on screen instead
+    long long lateFrames;
+    long long decodeErrors;
+    int decodingFrames;
+    int uploadingFrames;
+    int readyFrames;
+    // average over all decoded frames, on the pool thread
+    double decodeMilliseconds;
+};
+
+// plays a VideoFrameSource on a texture without ever waiting for the decoder or
+// the GPU. every ring slot owns a pixel unpack buffer and a texture: the buffer is
+// mapped on the GL thread and a pool thread decodes straight into it, then Update
+// unmaps it, starts the asynchronous copy into the slot's texture and sets a fence.
+// once the fence has passed the frame is ready, and Update shows the newest ready
+// frame that is due on the video clock. a slot that stops being shown gets another
+// fence so it isn't rewritten while earlier draws may still sample it.
+//
+//   video.Open(source);
+//   every frame: video.Update(glfwGetTime()); bind video.Texture()
+class VideoTexture {
+    public:
+        VideoTexture() : shown(-1), startClock(-1.0), nextFrame(0), dueFrame(0), lastLateFrame(-1), presentedFrames(0),
+                         droppedFrames(0), lateFrames(0), decodeErrors(0), decodedFrames(0), decodeSeconds(0.0) {}
+
+        ~VideoTexture() {
+            Release();
+        }
+
+        VideoTexture(const VideoTexture&) = delete;
+        VideoTexture& operator=(const VideoTexture&) = delete;
+
+        // creates the ring and shows the first frame, decoded on this thread. needs the GL context
+        bool Open(std::shared_ptr<VideoFrameSource> frames, const VideoTextureSettings &newSettings = VideoTextureSettings()) {
+            Release();
+            if (!frames || frames->FrameCount() <= 0 || frames->Width() <= 0 || frames->Height() <= 0) {
+                return false;
+            }
+            source = frames;
+            settings = newSettings;
+            settings.ringSize = std::max(2, settings.ringSize);
+            settings.maxUploadsPerFrame = std::max(1, settings.maxUploadsPerFrame);
+            frameBytes = (size_t)source->Width() * source->Height() * 4;
+
+            slots.resize(settings.ringSize);
+            for (Slot &slot : slots) {
+                glGenBuffers(1, &slot.buffer);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, frameBytes, NULL, GL_STREAM_DRAW);
+                glGenTextures(1, &slot.texture);
+                glBindTexture(GL_TEXTURE_2D, slot.texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, source->Width(), source->Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            // frame 0, so there is always something to show
+            std::vector<unsigned char> first(frameBytes);
+            if (!source->Decode(0, first.data())) {
+                Release();
+                return false;
+            }
+            glBindTexture(GL_TEXTURE_2D, slots[0].texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, source->Width(), source->Height(), GL_RGBA, GL_UNSIGNED_BYTE, first.data());
+            slots[0].state = SLOT_SHOWN;
+            slots[0].frame = 0;
+            shown = 0;
+            nextFrame = 1;
+            presentedFrames = 1;
+            return true;
+        }
+
+        bool IsOpen() const {
+            return source != nullptr;
+        }
+
+        // call once per frame on the GL thread before drawing. `clockSeconds` is the
+        // render clock, playback starts at the value of the first call
+        void Update(double clockSeconds) {
+            if (!source) {
+                return;
+            }
+            if (startClock < 0.0) {
+                startClock = clockSeconds;
+            }
+            const long long count = source->FrameCount();
+            dueFrame = (long long)std::floor((clockSeconds - startClock) * settings.speed * source->FrameRate());
+            dueFrame = std::max(0LL, settings.loop ? dueFrame : std::min(dueFrame, count - 1));
+
+            pollFences();
+            finishDecodes();
+            present();
+
+            // the decoder is behind the clock: don't start frames that are already over
+            if (nextFrame < dueFrame) {
+                droppedFrames += dueFrame - nextFrame;
+                nextFrame = dueFrame;
+            }
+            startDecodes(count);
+        }
+
+        // the texture holding the frame to draw with, changes between updates
+        unsigned int Texture() const {
+            return shown >= 0 ? slots[shown].texture : 0;
+        }
+
+        int Width() const {
+            return source ? source->Width() : 0;
+        }
+
+        int Height() const {
+            return source ? source->Height() : 0;
+        }
+
+        // the pixel buffers and textures of the ring
+        size_t GpuBytes() const {
+            return source ? slots.size() * frameBytes * 2 : 0;
+        }
+
+        // a video that doesn't loop is finished once its last frame is shown
+        bool Finished() const {
+            return source && !settings.loop && shown >= 0 && slots[shown].frame >= source->FrameCount() - 1;
+        }
+
+        VideoTextureStats Stats() const {
+            VideoTextureStats stats = {};
+            stats.dueFrame = dueFrame;
+            stats.shownFrame = shown >= 0 ? slots[shown].frame : -1;
+            stats.presentedFrames = presentedFrames;
+            stats.droppedFrames = droppedFrames;
+            stats.lateFrames = lateFrames;
+            stats.decodeErrors = decodeErrors;
+            for (const Slot &slot : slots) {
+                stats.decodingFrames += slot.state == SLOT_DECODING;
+                stats.uploadingFrames += slot.state == SLOT_UPLOADING;
+                stats.readyFrames += slot.state == SLOT_READY;
+            }
+            stats.decodeMilliseconds = decodedFrames > 0 ? decodeSeconds * 1000.0 / decodedFrames : 0.0;
+            return stats;
+        }
+
+        // waits for the decodes in flight and deletes the GL objects, call before the context goes away
+        void Release() {
+            for (Slot &slot : slots) {
+                if (slot.state == SLOT_DECODING) {
+                    slot.decoded.wait();
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                }
+                if (slot.fence) {
+                    glDeleteSync(slot.fence);
+                }
+                glDeleteBuffers(1, &slot.buffer);
+                glDeleteTextures(1, &slot.texture);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            slots.clear();
+            source.reset();
+            shown = -1;
+            startClock = -1.0;
+            nextFrame = dueFrame = 0;
+            lastLateFrame = -1;
+            presentedFrames = droppedFrames = lateFrames = decodeErrors = decodedFrames = 0;
+            decodeSeconds = 0.0;
+        }
+
+    private:
+        enum SlotState {
+            SLOT_FREE,
+            // mapped, a pool thread is writing the frame
+            SLOT_DECODING,
+            // copy to the texture issued, waiting for its fence
+            SLOT_UPLOADING,
+            SLOT_READY,
+            SLOT_SHOWN,
+            // taken off screen, waiting until the draws that used it are done
+            SLOT_RETIRING
+        };
+
+        struct Decoded {
+            bool ok;
+            double seconds;
+        };
+
+        struct Slot {
+            unsigned int buffer = 0;
+            unsigned int texture = 0;
+            SlotState state = SLOT_FREE;
+            // frame number on the video clock, keeps counting up when looping
+            long long frame = -1;
+            GLsync fence = 0;
+            std::future<Decoded> decoded;
+        };
+
+        std::shared_ptr<VideoFrameSource> source;
+        VideoTextureSettings settings;
+        size_t frameBytes;
+        std::vector<Slot> slots;
+        int shown;
+        double startClock;
+        long long nextFrame;
+        long long dueFrame;
+        long long lastLateFrame;
+
+        long long presentedFrames;
+        long long droppedFrames;
+        long long lateFrames;
+        long long decodeErrors;
+        long long decodedFrames;
+        double decodeSeconds;
+
+        static bool signaled(GLsync fence) {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+        }
+
+        void pollFences() {
+            for (Slot &slot : slots) {
+                if ((slot.state == SLOT_UPLOADING || slot.state == SLOT_RETIRING) && signaled(slot.fence)) {
+                    glDeleteSync(slot.fence);
+                    slot.fence = 0;
+                    slot.state = slot.state == SLOT_UPLOADING ? SLOT_READY : SLOT_FREE;
+                }
+            }
+        }
+
+        // unmaps the finished decodes and starts their copies, oldest frames first
+        void finishDecodes() {
+            int uploads = 0;
+            while (uploads < settings.maxUploadsPerFrame) {
+                Slot *oldest = nullptr;
+                for (Slot &slot : slots) {
+                    if (slot.state == SLOT_DECODING && (!oldest || slot.frame < oldest->frame)
+                        && slot.decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                        oldest = &slot;
+                    }
+                }
+                if (!oldest) {
+                    return;
+                }
+                Decoded result = oldest->decoded.get();
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, oldest->buffer);
+                // false means the storage was lost while mapped and the contents are undefined
+                bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+                decodedFrames++;
+                decodeSeconds += result.seconds;
+                // a frame that is already behind the shown one would only be dropped
+                bool stale = shown >= 0 && oldest->frame <= slots[shown].frame;
+                if (!result.ok || !intact || stale) {
+                    decodeErrors += !result.ok || !intact;
+                    droppedFrames += stale && result.ok && intact;
+                    oldest->state = SLOT_FREE;
+                } else {
+                    GLint previousAlignment;
+                    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                    glBindTexture(GL_TEXTURE_2D, oldest->texture);
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, source->Width(), source->Height(), GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+                    oldest->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    oldest->state = SLOT_UPLOADING;
+                    uploads++;
+                }
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+        }
+
+        // shows the newest ready frame that is due, drops the ready frames it overtakes
+        void present() {
+            int best = -1;
+            for (int i = 0; i < (int)slots.size(); i++) {
+                if (slots[i].state == SLOT_READY && slots[i].frame <= dueFrame && (best < 0 || slots[i].frame > slots[best].frame)) {
+                    best = i;
+                }
+            }
+            if (best >= 0) {
+                for (Slot &slot : slots) {
+                    if (slot.state == SLOT_READY && slot.frame < slots[best].frame) {
+                        slot.state = SLOT_FREE;
+                        droppedFrames++;
+                    }
+                }
+                if (shown >= 0) {
+                    slots[shown].state = SLOT_RETIRING;
+                    slots[shown].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                }
+                slots[best].state = SLOT_SHOWN;
+                shown = best;
+                presentedFrames++;
+            }
+            if (shown >= 0 && slots[shown].frame < dueFrame && lastLateFrame != dueFrame) {
+                lateFrames++;
+                lastLateFrame = dueFrame;
+            }
+        }
+
+        // maps free slots and hands them to the pool, at most one ring ahead of the clock
+        void startDecodes(long long count) {
+            for (Slot &slot : slots) {
+                if (nextFrame > dueFrame + (long long)slots.size() || (!settings.loop && nextFrame >= count)) {
+                    return;
+                }
+                if (slot.state != SLOT_FREE) {
+                    continue;
+                }
+                // the buffer's last copy has passed its fence, so this doesn't wait
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+                unsigned char *mapped = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frameBytes,
+                                                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                if (!mapped) {
+                    return;
+                }
+                std::shared_ptr<VideoFrameSource> frames = source;
+                int index = (int)(nextFrame % count);
+                slot.decoded = ThreadPool::Shared().Enqueue([frames, index, mapped]() {
+                    auto start = std::chrono::steady_clock::now();
+                    bool ok = frames->Decode(index, mapped);
+                    Decoded result = { ok, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+                    return result;
+                });
+                slot.frame = nextFrame++;
+                slot.state = SLOT_DECODING;
+            }
+        }
+};
+
+#endif
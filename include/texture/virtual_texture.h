@@ -0,0 +1,557 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "shader/shader.h"
+#include "texture/tiled_texture.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct VirtualTextureSettings {
+    // the physical cache holds cacheSlots x cacheSlots pages
+    int cacheSlots = 16;
+    // the feedback pass renders at 1/feedbackDivisor of the viewport
+    int feedbackDivisor = 8;
+    int maxUploadsPerFrame = 16;
+    int maxPendingLoads = 32;
+};
+
+struct VirtualTextureStats {
+    int cachePages;
+    int residentPages;
+    // distinct pages in the last feedback read back
+    int requestedPages;
+    // requested pages (and their parents) that were not resident
+    int missingPages;
+    int pendingLoads;
+    int uploadsThisFrame;
+    int evictionsThisFrame;
+    // loaded pages thrown away because every slot was in use this frame
+    int droppedPages;
+};
+
+// software virtual texturing on plain GL 3.3, no sparse textures. a huge image
+// lives in a .vtex file (see tiled_texture.h) and only the pages the camera
+// needs are kept in a fixed size cache texture. a page table texture, one texel
+// per page and one mip per level, tells the shader which cache slot holds a page;
+// pages that aren't loaded yet point at their finest loaded ancestor, and the
+// single page of the coarsest level is always loaded, so sampling never misses.
+//
+// every frame the scene is drawn once more at low resolution with the feedback
+// shader, which writes the page each pixel wants. the read back goes through a
+// pixel buffer and a fence so it never stalls, a frame or two later Update loads
+// the missing pages on the pool and uploads the finished ones. least recently
+// used slots are reused
+//
+//   vt.BeginFeedback(width, height);  draw with vt_feedback.frag after vt.BindFeedback(shader)
+//   vt.EndFeedback();
+//   vt.Update();
+//   vt.Bind(shader, 0, 1);            draw with virtual_texture.frag
+class VirtualTexture {
+    public:
+        static const int FEEDBACK_BUFFERS = 2;
+
+        VirtualTexture() : cacheTexture(0), pageTable(0), feedbackFramebuffer(0), feedbackColor(0), feedbackDepth(0),
+                           feedbackWidth(0), feedbackHeight(0), feedbackNext(0), frame(0), tableDirty(false),
+                           requestedPages(0), missingPages(0), uploadsThisFrame(0), evictionsThisFrame(0), droppedPages(0) {}
+
+        ~VirtualTexture() {
+            Release();
+        }
+
+        VirtualTexture(const VirtualTexture&) = delete;
+        VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+        // opens the file, creates the textures and loads the coarsest page. needs the GL context
+        bool Open(const std::string &path, const VirtualTextureSettings &newSettings = VirtualTextureSettings()) {
+            Release();
+            std::shared_ptr<TiledTextureFile> opened = std::make_shared<TiledTextureFile>();
+            if (!opened->Open(path)) {
+                return false;
+            }
+            file = opened;
+            info = file->Info();
+            settings = newSettings;
+
+            GLint maxSize;
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+            settings.cacheSlots = std::max(1, std::min(std::min(settings.cacheSlots, 256), maxSize / info.SlotSize()));
+            slots.assign((size_t)settings.cacheSlots * settings.cacheSlots, Slot());
+
+            const int cacheSize = settings.cacheSlots * info.SlotSize();
+            glGenTextures(1, &cacheTexture);
+            glBindTexture(GL_TEXTURE_2D, cacheTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheSize, cacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+            // read with texelFetch only, but every level must exist for the texture to be complete
+            glGenTextures(1, &pageTable);
+            glBindTexture(GL_TEXTURE_2D, pageTable);
+            tableLevels.resize(info.levels);
+            for (int level = 0; level < info.levels; level++) {
+                int pages = info.PagesAt(level);
+                tableLevels[level].assign((size_t)pages * pages, 0);
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, pages, pages, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, info.levels - 1);
+
+            // the fallback for everything, loaded here and never evicted
+            std::vector<unsigned char> root(info.PageBytes());
+            if (!file->ReadPage(info.levels - 1, 0, 0, root.data())) {
+                Release();
+                return false;
+            }
+            int slot = 0;
+            uploadPage(slot, pageKey(info.levels - 1, 0, 0), root.data());
+            slots[slot].pinned = true;
+            rebuildPageTable();
+            return true;
+        }
+
+        bool IsOpen() const {
+            return file != nullptr;
+        }
+
+        const TiledTextureInfo& Info() const {
+            return info;
+        }
+
+        // redirects drawing into the low resolution feedback target and clears it.
+        // draw the textured geometry with the feedback shader between this and EndFeedback
+        void BeginFeedback(int viewportWidth, int viewportHeight) {
+            if (!file) {
+                return;
+            }
+            int width = std::max(1, viewportWidth / settings.feedbackDivisor);
+            int height = std::max(1, viewportHeight / settings.feedbackDivisor);
+            if (width != feedbackWidth || height != feedbackHeight) {
+                createFeedbackTarget(width, height);
+            }
+            glGetIntegerv(GL_VIEWPORT, savedViewport);
+            glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+            glViewport(0, 0, feedbackWidth, feedbackHeight);
+            // alpha 0 marks pixels without virtual texture
+            GLfloat clearColor[4];
+            glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+        }
+
+        // starts the asynchronous read back and restores the default framebuffer
+        void EndFeedback() {
+            if (!file) {
+                return;
+            }
+            Readback &target = readback[feedbackNext];
+            feedbackNext = (feedbackNext + 1) % FEEDBACK_BUFFERS;
+            if (target.fence) {
+                // still not consumed, the driver is far behind. the newer request wins
+                glDeleteSync(target.fence);
+                target.fence = 0;
+            }
+            size_t bytes = (size_t)feedbackWidth * feedbackHeight * 4;
+            if (target.buffer == 0) {
+                glGenBuffers(1, &target.buffer);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, target.buffer);
+            if (bytes > target.capacity) {
+                glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+                target.capacity = bytes;
+            }
+            glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            target.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            target.bytes = bytes;
+            target.frame = frame;
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+        }
+
+        // call once per frame on the GL thread: reads back finished feedback, uploads
+        // finished loads, starts new ones and refreshes the page table
+        void Update() {
+            if (!file) {
+                return;
+            }
+            uploadsThisFrame = 0;
+            evictionsThisFrame = 0;
+            consumeFeedback();
+            finishLoads();
+            startLoads();
+            if (tableDirty) {
+                rebuildPageTable();
+            }
+            frame++;
+        }
+
+        // binds the cache and page table and sets the uniforms of virtual_texture.frag
+        void Bind(const Shader &shader, int cacheUnit, int pageTableUnit) const {
+            glActiveTexture(GL_TEXTURE0 + cacheUnit);
+            glBindTexture(GL_TEXTURE_2D, cacheTexture);
+            glActiveTexture(GL_TEXTURE0 + pageTableUnit);
+            glBindTexture(GL_TEXTURE_2D, pageTable);
+            shader.setInt("vtCache", cacheUnit);
+            shader.setInt("vtPageTable", pageTableUnit);
+            setCommonUniforms(shader, 0.0f);
+        }
+
+        // uniforms of vt_feedback.frag. the bias makes the small target ask for the
+        // levels the full resolution pass will sample
+        void BindFeedback(const Shader &shader) const {
+            setCommonUniforms(shader, -std::log2((float)settings.feedbackDivisor));
+        }
+
+        VirtualTextureStats Stats() const {
+            VirtualTextureStats stats = { (int)slots.size(), (int)resident.size(), requestedPages, missingPages,
+                                          (int)pending.size(), uploadsThisFrame, evictionsThisFrame, droppedPages };
+            return stats;
+        }
+
+        // waits for outstanding loads and deletes the GL objects, call before the context goes away
+        void Release() {
+            for (Pending &load : pending) {
+                load.data.wait();
+            }
+            pending.clear();
+            for (Readback &buffer : readback) {
+                if (buffer.fence) {
+                    glDeleteSync(buffer.fence);
+                }
+                if (buffer.buffer) {
+                    glDeleteBuffers(1, &buffer.buffer);
+                }
+                buffer = Readback();
+            }
+            deleteFeedbackTarget();
+            if (cacheTexture) {
+                glDeleteTextures(1, &cacheTexture);
+                cacheTexture = 0;
+            }
+            if (pageTable) {
+                glDeleteTextures(1, &pageTable);
+                pageTable = 0;
+            }
+            file.reset();
+            info = TiledTextureInfo();
+            slots.clear();
+            resident.clear();
+            tableLevels.clear();
+            wanted.clear();
+        }
+
+    private:
+        struct Slot {
+            uint32_t page = INVALID_PAGE;
+            unsigned long long lastUsed = 0;
+            bool pinned = false;
+        };
+
+        struct Readback {
+            unsigned int buffer = 0;
+            size_t capacity = 0;
+            size_t bytes = 0;
+            GLsync fence = 0;
+            unsigned long long frame = 0;
+        };
+
+        struct Pending {
+            uint32_t page;
+            std::future<std::unique_ptr<std::vector<unsigned char>>> data;
+        };
+
+        static const uint32_t INVALID_PAGE = 0xffffffffu;
+
+        std::shared_ptr<TiledTextureFile> file;
+        TiledTextureInfo info;
+        VirtualTextureSettings settings;
+
+        unsigned int cacheTexture;
+        unsigned int pageTable;
+        unsigned int feedbackFramebuffer;
+        unsigned int feedbackColor;
+        unsigned int feedbackDepth;
+        int feedbackWidth;
+        int feedbackHeight;
+        GLint savedViewport[4];
+        Readback readback[FEEDBACK_BUFFERS];
+        int feedbackNext;
+
+        std::vector<Slot> slots;
+        // page -> slot
+        std::unordered_map<uint32_t, int> resident;
+        std::vector<Pending> pending;
+        // missing pages from the last feedback, coarsest first
+        std::vector<uint32_t> wanted;
+        // one RGBA8 texel per page: slot x, slot y, level of the mapped page, 255
+        std::vector<std::vector<uint32_t>> tableLevels;
+        unsigned long long frame;
+        bool tableDirty;
+
+        int requestedPages;
+        int missingPages;
+        int uploadsThisFrame;
+        int evictionsThisFrame;
+        int droppedPages;
+
+        // the same bytes the feedback shader writes: x, y, level
+        static uint32_t pageKey(int level, int x, int y) {
+            return (uint32_t)x | (uint32_t)y << 8 | (uint32_t)level << 16;
+        }
+
+        static int keyLevel(uint32_t key) { return (int)((key >> 16) & 0xff); }
+        static int keyX(uint32_t key) { return (int)(key & 0xff); }
+        static int keyY(uint32_t key) { return (int)((key >> 8) & 0xff); }
+
+        static uint32_t parentKey(uint32_t key) {
+            return pageKey(keyLevel(key) + 1, keyX(key) >> 1, keyY(key) >> 1);
+        }
+
+        void setCommonUniforms(const Shader &shader, float lodBias) const {
+            shader.setVec4("vtParams", (float)info.pagesPerSide, (float)(info.levels - 1), (float)info.pageSize, (float)info.border);
+            shader.setFloat("vtCacheSize", (float)(settings.cacheSlots * info.SlotSize()));
+            shader.setVec2("vtUvScale", (float)info.width / info.VirtualSize(), (float)info.height / info.VirtualSize());
+            shader.setFloat("vtLodBias", lodBias);
+        }
+
+        void createFeedbackTarget(int width, int height) {
+            deleteFeedbackTarget();
+            feedbackWidth = width;
+            feedbackHeight = height;
+            glGenFramebuffers(1, &feedbackFramebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+            glGenRenderbuffers(1, &feedbackColor);
+            glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+            glGenRenderbuffers(1, &feedbackDepth);
+            glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+        void deleteFeedbackTarget() {
+            if (feedbackFramebuffer) {
+                glDeleteFramebuffers(1, &feedbackFramebuffer);
+                glDeleteRenderbuffers(1, &feedbackColor);
+                glDeleteRenderbuffers(1, &feedbackDepth);
+            }
+            feedbackFramebuffer = feedbackColor = feedbackDepth = 0;
+            feedbackWidth = feedbackHeight = 0;
+        }
+
+        // reads the oldest finished feedback buffer, never waits for the GPU
+        void consumeFeedback() {
+            Readback *ready = nullptr;
+            for (Readback &buffer : readback) {
+                if (!buffer.fence || (ready && ready->frame < buffer.frame)) {
+                    continue;
+                }
+                GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+                if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                    ready = &buffer;
+                }
+            }
+            if (!ready) {
+                return;
+            }
+            glDeleteSync(ready->fence);
+            ready->fence = 0;
+
+            std::vector<uint32_t> requests;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, ready->buffer);
+            const uint32_t *texels = (const uint32_t *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, ready->bytes, GL_MAP_READ_BIT);
+            if (texels) {
+                size_t count = ready->bytes / 4;
+                uint32_t previous = INVALID_PAGE;
+                for (size_t i = 0; i < count; i++) {
+                    uint32_t texel = texels[i];
+                    // neighbouring pixels mostly want the same page
+                    if (texel != previous && (texel >> 24) == 0xff) {
+                        requests.push_back(texel & 0xffffff);
+                    }
+                    previous = texel;
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            std::sort(requests.begin(), requests.end());
+            requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+            requestedPages = (int)requests.size();
+
+            // a page and all of its ancestors count as used, the missing ones are wanted
+            wanted.clear();
+            std::vector<uint32_t> visited;
+            for (uint32_t key : requests) {
+                if (keyLevel(key) >= info.levels || keyX(key) >= info.PagesAt(keyLevel(key)) || keyY(key) >= info.PagesAt(keyLevel(key))) {
+                    continue;
+                }
+                for (; keyLevel(key) < info.levels; key = parentKey(key)) {
+                    visited.push_back(key);
+                }
+            }
+            std::sort(visited.begin(), visited.end());
+            visited.erase(std::unique(visited.begin(), visited.end()), visited.end());
+            for (uint32_t key : visited) {
+                auto found = resident.find(key);
+                if (found != resident.end()) {
+                    slots[found->second].lastUsed = frame;
+                } else {
+                    wanted.push_back(key);
+                }
+            }
+            missingPages = (int)wanted.size();
+            // coarse pages first, they fill the most screen while the fine ones load
+            std::stable_sort(wanted.begin(), wanted.end(), [](uint32_t a, uint32_t b) {
+                return keyLevel(a) > keyLevel(b);
+            });
+        }
+
+        void finishLoads() {
+            for (size_t i = 0; i < pending.size() && uploadsThisFrame < settings.maxUploadsPerFrame; ) {
+                Pending &load = pending[i];
+                if (load.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    i++;
+                    continue;
+                }
+                std::unique_ptr<std::vector<unsigned char>> data = load.data.get();
+                uint32_t key = load.page;
+                pending.erase(pending.begin() + i);
+                if (!data) {
+                    continue;
+                }
+                int slot = findSlot();
+                if (slot < 0) {
+                    droppedPages++;
+                    continue;
+                }
+                uploadPage(slot, key, data->data());
+                uploadsThisFrame++;
+            }
+        }
+
+        // only as many loads as there are slots to put them in, so a working set
+        // larger than the cache keeps showing the coarser pages instead of thrashing
+        void startLoads() {
+            int available = -(int)pending.size();
+            for (const Slot &slot : slots) {
+                if (slot.page == INVALID_PAGE || (!slot.pinned && slot.lastUsed + 1 < frame)) {
+                    available++;
+                }
+            }
+            for (uint32_t key : wanted) {
+                if ((int)pending.size() >= settings.maxPendingLoads || available <= 0) {
+                    break;
+                }
+                if (resident.count(key)) {
+                    continue;
+                }
+                bool loading = false;
+                for (const Pending &load : pending) {
+                    loading = loading || load.page == key;
+                }
+                if (loading) {
+                    continue;
+                }
+                std::shared_ptr<TiledTextureFile> source = file;
+                size_t bytes = info.PageBytes();
+                Pending load;
+                load.page = key;
+                load.data = ThreadPool::Shared().Enqueue([source, key, bytes]() -> std::unique_ptr<std::vector<unsigned char>> {
+                    std::unique_ptr<std::vector<unsigned char>> data(new std::vector<unsigned char>(bytes));
+                    if (!source->ReadPage(keyLevel(key), keyX(key), keyY(key), data->data())) {
+                        return nullptr;
+                    }
+                    return data;
+                });
+                pending.push_back(std::move(load));
+                available--;
+            }
+            wanted.clear();
+        }
+
+        // a free slot, or the least recently used one not needed this frame
+        int findSlot() {
+            int victim = -1;
+            for (size_t i = 0; i < slots.size(); i++) {
+                const Slot &slot = slots[i];
+                if (slot.page == INVALID_PAGE) {
+                    return (int)i;
+                }
+                if (slot.pinned || slot.lastUsed + 1 >= frame) {
+                    continue;
+                }
+                if (victim < 0 || slot.lastUsed < slots[victim].lastUsed) {
+                    victim = (int)i;
+                }
+            }
+            if (victim >= 0) {
+                resident.erase(slots[victim].page);
+                slots[victim].page = INVALID_PAGE;
+                evictionsThisFrame++;
+                tableDirty = true;
+            }
+            return victim;
+        }
+
+        void uploadPage(int slot, uint32_t key, const unsigned char *pixels) {
+            const int size = info.SlotSize();
+            glBindTexture(GL_TEXTURE_2D, cacheTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % settings.cacheSlots) * size, (slot / settings.cacheSlots) * size,
+                            size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            slots[slot].page = key;
+            slots[slot].lastUsed = frame;
+            resident[key] = slot;
+            tableDirty = true;
+        }
+
+        // every entry maps to its own page when resident, otherwise to whatever its parent maps to
+        void rebuildPageTable() {
+            glBindTexture(GL_TEXTURE_2D, pageTable);
+            GLint previousAlignment;
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            for (int level = info.levels - 1; level >= 0; level--) {
+                const int pages = info.PagesAt(level);
+                std::vector<uint32_t> &table = tableLevels[level];
+                for (int y = 0; y < pages; y++) {
+                    for (int x = 0; x < pages; x++) {
+                        uint32_t entry;
+                        auto found = resident.find(pageKey(level, x, y));
+                        if (found != resident.end()) {
+                            int slot = found->second;
+                            entry = pageKey(level, slot % settings.cacheSlots, slot / settings.cacheSlots) | 0xff000000u;
+                        } else {
+                            entry = tableLevels[level + 1][(size_t)(y >> 1) * info.PagesAt(level + 1) + (x >> 1)];
+                        }
+                        table[(size_t)y * pages + x] = entry;
+                    }
+                }
+                glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pages, pages, GL_RGBA, GL_UNSIGNED_BYTE, table.data());
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+            tableDirty = false;
+        }
+};
+
+#endif
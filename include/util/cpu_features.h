@@ -0,0 +1,75 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// compile time SIMD availability. SSE2 is baseline on x64, AVX2 is only ever used
+// behind a runtime check so the binary still runs on older machines
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define CPU_X86 1
+    #include <immintrin.h>
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define CPU_SSE2 1
+    #endif
+    #if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+        #define CPU_AVX2 1
+    #endif
+#endif
+
+// functions using AVX2 intrinsics are tagged with this so gcc/clang generate them
+// without -mavx2 for the whole translation unit. msvc does not need it
+#if defined(CPU_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    #define TARGET_AVX2 __attribute__((target("avx2")))
+    #define TARGET_AVX2_F16C __attribute__((target("avx2,f16c")))
+#else
+    #define TARGET_AVX2
+    #define TARGET_AVX2_F16C
+#endif
+
+#if defined(_MSC_VER) && defined(CPU_X86)
+    #include <intrin.h>
+#endif
+
+// true when both the cpu and the os (saved ymm state) support AVX2
+inline bool cpuHasAvx2() {
+#if !defined(CPU_AVX2)
+    return false;
+#elif defined(_MSC_VER)
+    static const bool hasAvx2 = [] {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return hasAvx2;
+#else
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2;
+#endif
+}
+
+// half float conversion instructions, every AVX2 cpu we know of has them too
+inline bool cpuHasF16c() {
+#if !defined(CPU_AVX2)
+    return false;
+#elif defined(_MSC_VER)
+    static const bool hasF16c = [] {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 29)) != 0;
+    }();
+    return hasF16c && cpuHasAvx2();
+#else
+    static const bool hasF16c = __builtin_cpu_supports("f16c");
+    return hasF16c && cpuHasAvx2();
+#endif
+}
+
+#endif
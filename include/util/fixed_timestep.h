@@ -0,0 +1,185 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <chrono>
+#include <cstdint>
+
+// time as 64 bit nanoseconds, exact for centuries. floats in seconds lose a
+// millisecond of resolution after a few hours of uptime
+typedef int64_t Ticks;
+
+const Ticks TICKS_PER_SECOND = 1000000000;
+
+// monotonic now, unrelated to the wall clock
+inline Ticks clockTicks() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline double ticksToSeconds(Ticks ticks) {
+    return (double)ticks / (double)TICKS_PER_SECOND;
+}
+
+struct FixedTimestepStats {
+    int64_t steps;
+    // frames that were too far behind and skipped time instead of stepping more
+    int64_t clampedFrames;
+    Ticks skippedTicks;
+    // time dropped on purpose by Skip, while there was nothing to simulate
+    Ticks idleTicks;
+};
+
+// runs the simulation at a fixed rate whatever the frame rate is: every frame
+// Advance says how many steps of exactly StepSeconds are due, and Alpha how far the
+// frame is between the last two steps so the renderer can interpolate. step n ends
+// at n * TICKS_PER_SECOND / rate, so rates that don't divide a second don't drift
+//
+//   int steps = clock.Advance(clockTicks());
+//   for each step: state.BeginStep(); simulate(state.Current(), clock.StepSeconds());
+//   render state.Previous() blended with state.Current() by clock.Alpha()
+class FixedTimestep {
+    public:
+        // after a stall (a breakpoint, a window drag) at most maxStepsPerFrame steps
+        // are run and the rest of the time is skipped, so a slow step can't snowball
+        explicit FixedTimestep(int stepsPerSecond = 120, int maxStepsPerFrame = 8) : rate(stepsPerSecond),
+                     maxSteps(maxStepsPerFrame), start(0), started(false), elapsed(0), skipped(0), idle(0), step(0), clampedFrames(0) {}
+
+        // call once per frame with the current time, returns the steps to run
+        int Advance(Ticks now) {
+            if (!started) {
+                start = now;
+                started = true;
+            }
+            elapsed = now - start - skipped;
+            int64_t due = stepsBefore(elapsed) - step;
+            if (due > maxSteps) {
+                // drop the time the extra steps would have covered
+                skipped += elapsed - stepEnd(step + maxSteps);
+                elapsed = stepEnd(step + maxSteps);
+                due = maxSteps;
+                clampedFrames++;
+            }
+            step += due;
+            return (int)due;
+        }
+
+        float StepSeconds() const {
+            return 1.0f / (float)rate;
+        }
+
+        int StepsPerSecond() const {
+            return rate;
+        }
+
+        // steps run since the start
+        int64_t Step() const {
+            return step;
+        }
+
+        // how far the last Advance is past the end of the current step, in [0, 1) of a
+        // step. the frame blends the previous state into the current one by it, so
+        // what's shown runs one step behind
+        float Alpha() const {
+            Ticks from = stepEnd(step);
+            return (float)((double)(elapsed - from) / (double)(stepEnd(step + 1) - from));
+        }
+
+        // the time the frame shows, in ticks since the first Advance and without
+        // the skipped time
+        Ticks Elapsed() const {
+            return elapsed;
+        }
+
+        double Seconds() const {
+            return ticksToSeconds(elapsed);
+        }
+
+        // the simulation time of the current state, in ticks since the first Advance
+        Ticks StateTime() const {
+            return stepEnd(step);
+        }
+
+        // when the current state was due, on the clockTicks clock
+        Ticks StateClockTicks() const {
+            return start + skipped + stepEnd(step);
+        }
+
+        // the length of the next step, in ticks
+        Ticks StepTicks() const {
+            return stepEnd(step + 1) - stepEnd(step);
+        }
+
+        // drops the time since the current state without stepping through it, for when
+        // the simulation had nothing to do, e.g. after sleeping until the next input
+        void Skip(Ticks now) {
+            Ticks behind = now - StateClockTicks();
+            if (behind > 0) {
+                skipped += behind;
+                idle += behind;
+            }
+        }
+
+        FixedTimestepStats Stats() const {
+            FixedTimestepStats stats = { step, clampedFrames, skipped - idle, idle };
+            return stats;
+        }
+
+    private:
+        int rate;
+        int maxSteps;
+        Ticks start;
+        bool started;
+        Ticks elapsed;
+        Ticks skipped;
+        Ticks idle;
+        int64_t step;
+        int64_t clampedFrames;
+
+        // the state after n steps is the one at stepEnd(n). split so n * TICKS_PER_SECOND
+        // can't overflow
+        Ticks stepEnd(int64_t n) const {
+            return n / rate * TICKS_PER_SECOND + n % rate * TICKS_PER_SECOND / rate;
+        }
+
+        // the last n with stepEnd(n) <= ticks, which is ((ticks + 1) * rate - 1) / TICKS_PER_SECOND
+        int64_t stepsBefore(Ticks ticks) const {
+            Ticks whole = (ticks + 1) / TICKS_PER_SECOND;
+            Ticks part = (ticks + 1) % TICKS_PER_SECOND;
+            if (part == 0) {
+                return whole * rate - 1;
+            }
+            return whole * rate + (part * rate - 1) / TICKS_PER_SECOND;
+        }
+};
+
+// the simulated state twice: the step being written and the one before it, so a
+// frame can show a point between them
+//
+//   per step: state.BeginStep(); then change state.Current()
+template <typename T>
+class InterpolatedState {
+    public:
+        explicit InterpolatedState(const T &initial = T()) : previous(initial), current(initial) {}
+
+        // the result of the last step becomes the previous state
+        void BeginStep() {
+            previous = current;
+        }
+
+        T& Current() {
+            return current;
+        }
+
+        const T& Current() const {
+            return current;
+        }
+
+        const T& Previous() const {
+            return previous;
+        }
+
+    private:
+        T previous;
+        T current;
+};
+
+#endif
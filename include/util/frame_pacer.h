@@ -0,0 +1,254 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "util/fixed_timestep.h"
+#include "util/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+struct FramePacerSettings {
+    // 1 waits for vblank, 0 doesn't, -1 is adaptive vsync: waits unless the frame
+    // is already late, and falls back to 1 where the driver can't do it
+    int swapInterval;
+    // frames per second the loop is held to, 0 for no cap
+    double maxFps;
+    // frames the GPU may be behind the CPU. 1 keeps input latency lowest, more
+    // keeps the GPU busier
+    int maxFramesInFlight;
+    // the frame cap sleeps until this long before its deadline, then spins, since
+    // sleeps wake up late by up to a scheduler tick
+    double spinMilliseconds;
+
+    FramePacerSettings() : swapInterval(-1), maxFps(0.0), maxFramesInFlight(1), spinMilliseconds(2.0) {}
+};
+
+// average and percentiles over the recent frames, in milliseconds
+struct FrameTimeStats {
+    double average;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+struct FramePacerStats {
+    int64_t frames;
+    // from BeginFrame to the swap
+    FrameTimeStats cpu;
+    // the GPU time of a frame's commands, a few frames behind
+    FrameTimeStats gpu;
+    // between two swaps returning
+    FrameTimeStats present;
+    // spent in BeginFrame waiting for fences and the frame cap
+    FrameTimeStats wait;
+    int actualSwapInterval;
+};
+
+// paces the render loop for low input latency: caps the frame rate, and keeps the
+// driver from queuing frames by waiting on a fence from maxFramesInFlight frames
+// back, so the input a frame is built from is never older than that. also keeps
+// per frame timings for tuning. on the GL thread:
+//
+//   pacer.Init(settings) once; every frame: pacer.BeginFrame(); take the newest
+//   input, draw; pacer.EndFrame(window)
+class FramePacer {
+    public:
+        static const int HISTORY = 512;
+
+        FramePacer() : swapInterval(0), frame(0), nextDeadline(0), beginTicks(0), lastPresent(0), waitTicks(0), queryActive(false) {}
+
+        ~FramePacer() {
+            Release();
+        }
+
+        FramePacer(const FramePacer&) = delete;
+        FramePacer& operator=(const FramePacer&) = delete;
+
+        // needs the context current
+        void Init(const FramePacerSettings &settings) {
+            this->settings = settings;
+            this->settings.maxFramesInFlight = std::max(1, settings.maxFramesInFlight);
+            swapInterval = settings.swapInterval;
+            if (swapInterval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+                !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+                swapInterval = 1;
+            }
+            glfwSwapInterval(swapInterval);
+            fences.assign(this->settings.maxFramesInFlight, (GLsync)0);
+            // enough queries that a result is normally ready by the time its slot comes round again
+            queries.resize(this->settings.maxFramesInFlight + 3);
+            glGenQueries((GLsizei)queries.size(), queries.data());
+            queryUsed.assign(queries.size(), false);
+        }
+
+        // waits until the frame may start: the GPU is done with the frame
+        // maxFramesInFlight back and the frame cap's deadline has passed
+        void BeginFrame() {
+            PROFILE_ZONE("pacing wait");
+            Ticks waitStart = clockTicks();
+            GLsync &fence = fences[frame % fences.size()];
+            if (fence) {
+                // flush so the wait can't hang on commands that were never sent
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)1000000000);
+                glDeleteSync(fence);
+                fence = 0;
+            }
+            if (settings.maxFps > 0.0) {
+                Ticks interval = (Ticks)((double)TICKS_PER_SECOND / settings.maxFps);
+                Ticks now = clockTicks();
+                if (nextDeadline == 0 || now - nextDeadline > interval) {
+                    // first frame or far behind, don't try to catch up with a burst
+                    nextDeadline = now;
+                }
+                waitUntil(nextDeadline);
+                nextDeadline += interval;
+            }
+            beginTicks = clockTicks();
+            waitTicks = beginTicks - waitStart;
+
+            // the query this slot used a few frames ago, if the GPU is done with it
+            size_t slot = frame % queries.size();
+            if (queryUsed[slot]) {
+                GLint available = 0;
+                glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available) {
+                    GLuint64 nanoseconds = 0;
+                    glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+                    record(gpuHistory, (double)nanoseconds / 1e6);
+                }
+                // not ready is dropped rather than waited for
+            }
+            glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+            queryUsed[slot] = true;
+            queryActive = true;
+        }
+
+        // swaps and fences the frame
+        void EndFrame(GLFWwindow *window) {
+            glEndQuery(GL_TIME_ELAPSED);
+            queryActive = false;
+            Ticks cpuEnd = clockTicks();
+            {
+                PROFILE_ZONE("glfwSwapBuffers");
+                glfwSwapBuffers(window);
+            }
+            fences[frame % fences.size()] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            Ticks present = clockTicks();
+
+            record(cpuHistory, ticksToSeconds(cpuEnd - beginTicks) * 1000.0);
+            record(waitHistory, ticksToSeconds(waitTicks) * 1000.0);
+            if (lastPresent != 0) {
+                record(presentHistory, ticksToSeconds(present - lastPresent) * 1000.0);
+            }
+            lastPresent = present;
+            frame++;
+        }
+
+        // call when frames stop for a while, so the gap isn't taken for a frame interval
+        // and the frame cap doesn't start out behind
+        void Pause() {
+            lastPresent = 0;
+            nextDeadline = 0;
+        }
+
+        FramePacerStats Stats() const {
+            FramePacerStats stats;
+            stats.frames = frame;
+            stats.cpu = summarize(cpuHistory);
+            stats.gpu = summarize(gpuHistory);
+            stats.present = summarize(presentHistory);
+            stats.wait = summarize(waitHistory);
+            stats.actualSwapInterval = swapInterval;
+            return stats;
+        }
+
+        // deletes the fences and queries, call before the context goes away. a frame
+        // begun but never ended is dropped
+        void Release() {
+            if (queryActive) {
+                glEndQuery(GL_TIME_ELAPSED);
+                queryActive = false;
+            }
+            for (GLsync &fence : fences) {
+                if (fence) {
+                    glDeleteSync(fence);
+                }
+            }
+            fences.clear();
+            if (!queries.empty()) {
+                glDeleteQueries((GLsizei)queries.size(), queries.data());
+                queries.clear();
+            }
+            queryUsed.clear();
+        }
+
+    private:
+        FramePacerSettings settings;
+        int swapInterval;
+        int64_t frame;
+        Ticks nextDeadline;
+        Ticks beginTicks;
+        Ticks lastPresent;
+        Ticks waitTicks;
+        bool queryActive;
+        std::vector<GLsync> fences;
+        std::vector<GLuint> queries;
+        std::vector<bool> queryUsed;
+        std::vector<double> cpuHistory;
+        std::vector<double> gpuHistory;
+        std::vector<double> presentHistory;
+        std::vector<double> waitHistory;
+
+        // sleeps most of the way, then spins for the last spinMilliseconds
+        void waitUntil(Ticks deadline) const {
+            Ticks spin = (Ticks)(settings.spinMilliseconds * 1e6);
+            Ticks now = clockTicks();
+            if (deadline - now > spin) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - spin));
+            }
+            while (clockTicks() < deadline) {
+                std::this_thread::yield();
+            }
+        }
+
+        // keeps the last HISTORY samples, oldest overwritten first
+        void record(std::vector<double> &history, double milliseconds) {
+            if (history.size() < (size_t)HISTORY) {
+                history.push_back(milliseconds);
+            } else {
+                history[frame % HISTORY] = milliseconds;
+            }
+        }
+
+        static FrameTimeStats summarize(const std::vector<double> &history) {
+            FrameTimeStats stats = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+            if (history.empty()) {
+                return stats;
+            }
+            std::vector<double> sorted(history);
+            std::sort(sorted.begin(), sorted.end());
+            for (double sample : sorted) {
+                stats.average += sample;
+            }
+            stats.average /= (double)sorted.size();
+            stats.p50 = percentile(sorted, 0.50);
+            stats.p95 = percentile(sorted, 0.95);
+            stats.p99 = percentile(sorted, 0.99);
+            stats.max = sorted.back();
+            return stats;
+        }
+
+        // nearest rank
+        static double percentile(const std::vector<double> &sorted, double fraction) {
+            size_t rank = (size_t)(fraction * (double)sorted.size() + 0.999999);
+            return sorted[std::min(sorted.size(), std::max(rank, (size_t)1)) - 1];
+        }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include "util/fixed_timestep.h"
+#include "util/profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// the GPU time of one labelled pass over the frames resolved so far, in milliseconds
+struct GpuPassStats {
+    const char *label;
+    int64_t samples;
+    double last;
+    double average;
+    double max;
+};
+
+struct GpuProfilerStats {
+    int64_t resolvedFrames;
+    // frames whose queries weren't done when their slot came round again
+    int64_t droppedFrames;
+    // passes past maxPassesPerFrame, not timed
+    int64_t droppedPasses;
+};
+
+// times passes on the GPU without ever stalling for a result: every pass writes a
+// GL_TIMESTAMP query at its start and end into the slot of the current frame, and a
+// slot is only read latencyFrames frames later, once its queries are available.
+// timestamps rather than GL_TIME_ELAPSED, since those can't nest and the frame
+// pacer already has one open around the whole frame. built with the profiler the
+// passes also go into its trace, on a "gpu" track lined up with the cpu zones
+//
+//   profiler.Init() once with the context current; every frame:
+//   profiler.BeginFrame(); { GpuZone zone(profiler, "pass"); draw } ... profiler.EndFrame()
+class GpuProfiler {
+    public:
+        explicit GpuProfiler(int latencyFrames = 4, int maxPassesPerFrame = 32) : latency(std::max(1, latencyFrames) + 1),
+                     maxPasses(std::max(1, maxPassesPerFrame)), frame(0), clockOffset(0), inFrame(false) {
+            stats = { 0, 0, 0 };
+        }
+
+        ~GpuProfiler() {
+            Release();
+        }
+
+        GpuProfiler(const GpuProfiler&) = delete;
+        GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+        // needs the context current
+        void Init() {
+            queries.resize((size_t)latency * maxPasses * 2);
+            glGenQueries((GLsizei)queries.size(), queries.data());
+            frames.assign(latency, Frame());
+            calibrate();
+        }
+
+        // reads every earlier frame whose queries are done and frees this frame's slot
+        void BeginFrame() {
+            if (queries.empty()) {
+                return;
+            }
+            // the GPU and cpu clocks drift apart a little, line them up again now and then
+            if (frame % CALIBRATE_FRAMES == 0) {
+                calibrate();
+            }
+            for (int64_t pending = std::max((int64_t)0, frame - latency); pending < frame; pending++) {
+                if (!resolve((int)(pending % latency))) {
+                    break;
+                }
+            }
+            Frame &slot = frames[frame % latency];
+            if (slot.pending) {
+                // still not done a whole ring later, drop it rather than wait
+                slot.pending = false;
+                stats.droppedFrames++;
+            }
+            slot.labels.clear();
+            slot.clockOffset = clockOffset;
+            inFrame = true;
+        }
+
+        void EndFrame() {
+            if (!inFrame) {
+                return;
+            }
+            Frame &slot = frames[frame % latency];
+            slot.pending = !slot.labels.empty();
+            inFrame = false;
+            frame++;
+        }
+
+        // starts a pass, returns its index for EndPass or -1 when it isn't timed
+        int BeginPass(const char *label) {
+            if (!inFrame) {
+                return -1;
+            }
+            Frame &slot = frames[frame % latency];
+            if ((int)slot.labels.size() == maxPasses) {
+                stats.droppedPasses++;
+                return -1;
+            }
+            int pass = (int)slot.labels.size();
+            slot.labels.push_back(label);
+            glQueryCounter(query((int)(frame % latency), pass, 0), GL_TIMESTAMP);
+            return pass;
+        }
+
+        void EndPass(int pass) {
+            if (pass >= 0 && inFrame) {
+                glQueryCounter(query((int)(frame % latency), pass, 1), GL_TIMESTAMP);
+            }
+        }
+
+        std::vector<GpuPassStats> Passes() const {
+            std::vector<GpuPassStats> result;
+            for (const Pass &pass : passes) {
+                GpuPassStats passStats = { pass.label, pass.samples, pass.last, pass.total / (double)pass.samples, pass.max };
+                result.push_back(passStats);
+            }
+            return result;
+        }
+
+        GpuProfilerStats Stats() const {
+            return stats;
+        }
+
+        // deletes the queries, call before the context goes away
+        void Release() {
+            if (!queries.empty()) {
+                glDeleteQueries((GLsizei)queries.size(), queries.data());
+                queries.clear();
+            }
+            frames.clear();
+            inFrame = false;
+        }
+
+    private:
+        static const int64_t CALIBRATE_FRAMES = 256;
+
+        struct Frame {
+            // recorded and not read yet
+            bool pending;
+            // clockTicks minus the GPU's timestamp when the frame was recorded
+            Ticks clockOffset;
+            std::vector<const char*> labels;
+
+            Frame() : pending(false), clockOffset(0) {}
+        };
+
+        // running totals per label
+        struct Pass {
+            const char *label;
+            int64_t samples;
+            double last;
+            double total;
+            double max;
+        };
+
+        int latency;
+        int maxPasses;
+        int64_t frame;
+        Ticks clockOffset;
+        bool inFrame;
+        std::vector<GLuint> queries;
+        std::vector<Frame> frames;
+        std::vector<Pass> passes;
+        GpuProfilerStats stats;
+
+        // each slot has a begin and an end query per pass
+        GLuint query(int slot, int pass, int end) const {
+            return queries[((size_t)slot * maxPasses + pass) * 2 + end];
+        }
+
+        // the GPU clock read between two cpu clock reads, so the offset is off by at
+        // most half the round trip
+        void calibrate() {
+            Ticks before = clockTicks();
+            GLint64 gpu = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpu);
+            Ticks after = clockTicks();
+            clockOffset = before + (after - before) / 2 - (Ticks)gpu;
+        }
+
+        // false, and nothing read, if the GPU isn't done with the frame yet. with
+        // nested passes the last end written isn't the last pass's, so all are checked
+        bool resolve(int index) {
+            Frame &slot = frames[index];
+            if (!slot.pending) {
+                return true;
+            }
+            int count = (int)slot.labels.size();
+            for (int i = 0; i < count; i++) {
+                GLint available = 0;
+                glGetQueryObjectiv(query(index, i, 1), GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) {
+                    return false;
+                }
+            }
+#if PROFILER_ENABLED
+            ProfileThreadBuffer &track = Profiler::Get().Track("gpu");
+#endif
+            for (int i = 0; i < count; i++) {
+                GLuint64 begin = 0;
+                GLuint64 end = 0;
+                glGetQueryObjectui64v(query(index, i, 0), GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(query(index, i, 1), GL_QUERY_RESULT, &end);
+                record(slot.labels[i], ticksToSeconds((Ticks)(end - begin)) * 1000.0);
+#if PROFILER_ENABLED
+                track.Record(slot.labels[i], (uint64_t)((Ticks)begin + slot.clockOffset), (uint64_t)((Ticks)end + slot.clockOffset));
+#endif
+            }
+            slot.pending = false;
+            stats.resolvedFrames++;
+            return true;
+        }
+
+        void record(const char *label, double milliseconds) {
+            for (Pass &pass : passes) {
+                if (pass.label == label || strcmp(pass.label, label) == 0) {
+                    pass.samples++;
+                    pass.last = milliseconds;
+                    pass.total += milliseconds;
+                    pass.max = std::max(pass.max, milliseconds);
+                    return;
+                }
+            }
+            Pass pass = { label, 1, milliseconds, milliseconds, milliseconds };
+            passes.push_back(pass);
+        }
+};
+
+// times the GPU work issued between its construction and destruction as a pass
+class GpuZone {
+    public:
+        GpuZone(GpuProfiler &profiler, const char *label) : profiler(profiler), pass(profiler.BeginPass(label)) {}
+
+        ~GpuZone() {
+            profiler.EndPass(pass);
+        }
+
+        GpuZone(const GpuZone&) = delete;
+        GpuZone& operator=(const GpuZone&) = delete;
+
+    private:
+        GpuProfiler &profiler;
+        int pass;
+};
+
+#endif
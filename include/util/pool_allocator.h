@@ -0,0 +1,207 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// thread local free lists of power of two blocks. made for loaders that decode
+// image after image: the pixel buffers, zlib windows and scanline buffers of one
+// image are reused by the next instead of going back to the heap each time.
+// a block freed on another thread goes to that thread's lists, so decoding on
+// the pool and freeing on the GL thread works, it just migrates the memory.
+// what all threads keep cached together is capped as well, and pool workers give
+// theirs back once they run out of work (ThreadPool)
+struct PoolStats {
+    size_t allocations;
+    // allocations served from a free list
+    size_t reused;
+    size_t cachedBytes;
+};
+
+class PoolArena {
+    public:
+        // 64 bytes to 256MB, bigger requests go straight to malloc
+        static const int MIN_SHIFT = 6;
+        static const int MAX_SHIFT = 28;
+        static const int CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+
+        // enough for one 4K RGBA image in its 64MB class per thread
+        static const size_t DEFAULT_CACHE_LIMIT = (size_t)64 * 1024 * 1024;
+        static const size_t DEFAULT_SHARED_CACHE_LIMIT = (size_t)256 * 1024 * 1024;
+
+        PoolArena() : cacheLimit(DEFAULT_CACHE_LIMIT), cachedBytes(0), allocations(0), reused(0) {}
+
+        ~PoolArena() {
+            Trim();
+        }
+
+        PoolArena(const PoolArena&) = delete;
+        PoolArena& operator=(const PoolArena&) = delete;
+
+        // the calling thread's arena. not usable from destructors of other thread_local objects
+        static PoolArena& Local() {
+            thread_local PoolArena arena;
+            return arena;
+        }
+
+        void *Allocate(size_t size) {
+            allocations++;
+            int sizeClass = classFor(size);
+            if (sizeClass < 0) {
+                Header *header = (Header *)malloc(sizeof(Header) + size);
+                if (!header) {
+                    return nullptr;
+                }
+                header->sizeClass = -1;
+                return header + 1;
+            }
+            std::vector<Header *> &list = freeLists[sizeClass];
+            if (!list.empty()) {
+                Header *header = list.back();
+                list.pop_back();
+                cachedBytes -= classBytes(sizeClass);
+                sharedCached() -= classBytes(sizeClass);
+                reused++;
+                return header + 1;
+            }
+            Header *header = (Header *)malloc(sizeof(Header) + classBytes(sizeClass));
+            if (!header) {
+                return nullptr;
+            }
+            header->sizeClass = sizeClass;
+            return header + 1;
+        }
+
+        // grows in place while the block's size class still has room
+        void *Reallocate(void *pointer, size_t size) {
+            if (!pointer) {
+                return Allocate(size);
+            }
+            Header *header = (Header *)pointer - 1;
+            if (header->sizeClass < 0) {
+                if (classFor(size) < 0) {
+                    header = (Header *)realloc(header, sizeof(Header) + size);
+                    return header ? header + 1 : nullptr;
+                }
+            } else if (size <= classBytes(header->sizeClass)) {
+                return pointer;
+            }
+            void *grown = Allocate(size);
+            if (!grown) {
+                return nullptr;
+            }
+            // a large block doesn't know its size, but it only gets here when it shrinks
+            // into a size class, so size is the smaller one
+            size_t oldSize = header->sizeClass < 0 ? size : classBytes(header->sizeClass);
+            memcpy(grown, pointer, std::min(oldSize, size));
+            Free(pointer);
+            return grown;
+        }
+
+        void Free(void *pointer) {
+            if (!pointer) {
+                return;
+            }
+            Header *header = (Header *)pointer - 1;
+            size_t bytes = header->sizeClass < 0 ? 0 : classBytes(header->sizeClass);
+            if (header->sizeClass < 0 || cachedBytes + bytes > cacheLimit) {
+                free(header);
+                return;
+            }
+            if (sharedCached().fetch_add(bytes) + bytes > sharedCacheLimit()) {
+                sharedCached() -= bytes;
+                free(header);
+                return;
+            }
+            freeLists[header->sizeClass].push_back(header);
+            cachedBytes += bytes;
+        }
+
+        // gives every cached block back to the heap
+        void Trim() {
+            for (std::vector<Header *> &list : freeLists) {
+                for (Header *header : list) {
+                    free(header);
+                }
+                list.clear();
+            }
+            sharedCached() -= cachedBytes;
+            cachedBytes = 0;
+        }
+
+        // most bytes kept in the free lists of this thread, more is freed right away
+        void SetCacheLimit(size_t bytes) {
+            cacheLimit = bytes;
+            if (cachedBytes > cacheLimit) {
+                Trim();
+            }
+        }
+
+        // most bytes kept in the free lists of all threads together
+        static void SetSharedCacheLimit(size_t bytes) {
+            sharedCacheLimit() = bytes;
+        }
+
+        PoolStats Stats() const {
+            return PoolStats{ allocations, reused, cachedBytes };
+        }
+
+    private:
+        // keeps the returned memory 16 byte aligned for SSE loads
+        struct alignas(16) Header {
+            int sizeClass;
+        };
+
+        std::vector<Header *> freeLists[CLASSES];
+        size_t cacheLimit;
+        size_t cachedBytes;
+        size_t allocations;
+        size_t reused;
+
+        static std::atomic<size_t>& sharedCached() {
+            static std::atomic<size_t> bytes(0);
+            return bytes;
+        }
+
+        static std::atomic<size_t>& sharedCacheLimit() {
+            static std::atomic<size_t> bytes(DEFAULT_SHARED_CACHE_LIMIT);
+            return bytes;
+        }
+
+        static size_t classBytes(int sizeClass) {
+            return (size_t)1 << (sizeClass + MIN_SHIFT);
+        }
+
+        static int classFor(size_t size) {
+            int shift = MIN_SHIFT;
+            while (((size_t)1 << shift) < size) {
+                if (++shift > MAX_SHIFT) {
+                    return -1;
+                }
+            }
+            return shift - MIN_SHIFT;
+        }
+};
+
+// allocator hooks for stb_image. define these before the implementation:
+//   #define STBI_MALLOC(sz)    poolMalloc(sz)
+//   #define STBI_REALLOC(p,sz) poolRealloc(p,sz)
+//   #define STBI_FREE(p)       poolFree(p)
+// and free the images with stbi_image_free, never with free
+inline void *poolMalloc(size_t size) {
+    return PoolArena::Local().Allocate(size);
+}
+
+inline void *poolRealloc(void *pointer, size_t size) {
+    return PoolArena::Local().Reallocate(pointer, size);
+}
+
+inline void poolFree(void *pointer) {
+    PoolArena::Local().Free(pointer);
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// scoped CPU zones for finding out where frame time goes. built with
+// PROFILER_ENABLED (cmake -DPROFILER=ON) every PROFILE_ZONE records a begin and
+// end timestamp into a ring on its own thread, and PROFILE_WRITE_TRACE writes the
+// recent zones of all threads as Chrome trace event JSON, which chrome://tracing
+// and ui.perfetto.dev both open. without it the macros compile to nothing
+//
+//   void update() {
+//       PROFILE_ZONE("update");
+//       ...
+//   }
+#ifndef PROFILER_ENABLED
+    #define PROFILER_ENABLED 0
+#endif
+
+#if PROFILER_ENABLED
+
+#include "util/cpu_features.h"
+#include "util/fixed_timestep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+    #include <intrin.h>
+#elif defined(CPU_X86)
+    #include <x86intrin.h>
+#endif
+
+// the cheapest timestamp there is: the cpu's time stamp counter where there is
+// one, which runs at a constant rate and in step across cores on anything recent.
+// only ever converted to nanoseconds when the trace is written
+inline uint64_t profilerTicks() {
+#if defined(CPU_X86)
+    return __rdtsc();
+#else
+    return (uint64_t)clockTicks();
+#endif
+}
+
+// a zone that ended, the name is always a string literal
+struct ProfileZoneEvent {
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> begin;
+    std::atomic<uint64_t> end;
+};
+
+// one thread's zones. only that thread writes, so recording takes no lock; the
+// writer of the trace reads whatever was written and drops what may have been
+// overwritten while it read. a track that isn't a thread, like the GPU's, works the
+// same with one thread recording for it, in clockTicks rather than profilerTicks
+class ProfileThreadBuffer {
+    public:
+        static const size_t CAPACITY = 1 << 16;
+
+        ProfileThreadBuffer(uint32_t id, bool clockTimes = false) : id(id), clockTimes(clockTimes), written(0),
+                                                                    events(new ProfileZoneEvent[CAPACITY]) {}
+
+        ProfileThreadBuffer(const ProfileThreadBuffer&) = delete;
+        ProfileThreadBuffer& operator=(const ProfileThreadBuffer&) = delete;
+
+        // owning thread only
+        void Record(const char *name, uint64_t begin, uint64_t end) {
+            uint64_t index = written.load(std::memory_order_relaxed);
+            ProfileZoneEvent &event = events[index & (CAPACITY - 1)];
+            event.name.store(name, std::memory_order_relaxed);
+            event.begin.store(begin, std::memory_order_relaxed);
+            event.end.store(end, std::memory_order_relaxed);
+            written.store(index + 1, std::memory_order_release);
+        }
+
+        // any thread: the zones still in the ring, oldest first
+        template <typename F>
+        void ForEach(F &&visit) const {
+            uint64_t last = written.load(std::memory_order_acquire);
+            uint64_t first = last > CAPACITY ? last - CAPACITY : 0;
+            struct Copy {
+                const char *name;
+                uint64_t begin;
+                uint64_t end;
+            };
+            std::vector<Copy> copies;
+            copies.reserve((size_t)(last - first));
+            for (uint64_t i = first; i < last; i++) {
+                const ProfileZoneEvent &event = events[i & (CAPACITY - 1)];
+                copies.push_back({ event.name.load(std::memory_order_relaxed), event.begin.load(std::memory_order_relaxed),
+                                   event.end.load(std::memory_order_relaxed) });
+            }
+            // the owner may have lapped the oldest ones while they were copied
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t now = written.load(std::memory_order_relaxed);
+            uint64_t valid = now > CAPACITY ? now - CAPACITY : 0;
+            for (uint64_t i = std::max(first, valid); i < last; i++) {
+                const Copy &copy = copies[(size_t)(i - first)];
+                visit(copy.name, copy.begin, copy.end);
+            }
+        }
+
+        const uint32_t id;
+        // the times are clockTicks, not profilerTicks
+        const bool clockTimes;
+        // set once by NameThread or Track, before any trace is written
+        std::string name;
+
+    private:
+        std::atomic<uint64_t> written;
+        std::unique_ptr<ProfileZoneEvent[]> events;
+};
+
+// keeps every thread's buffer and writes the trace
+class Profiler {
+    public:
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        static Profiler& Get() {
+            static Profiler profiler;
+            return profiler;
+        }
+
+        // the calling thread's buffer, made the first time a thread records. buffers
+        // outlive their threads so the trace still has them
+        ProfileThreadBuffer& ThreadBuffer() {
+            thread_local ProfileThreadBuffer *buffer = nullptr;
+            if (!buffer) {
+                std::lock_guard<std::mutex> lock(buffersMutex);
+                buffers.emplace_back(new ProfileThreadBuffer((uint32_t)buffers.size() + 1));
+                buffer = buffers.back().get();
+            }
+            return *buffer;
+        }
+
+        // the name the trace shows for the calling thread
+        void NameThread(const char *name) {
+            ProfileThreadBuffer &buffer = ThreadBuffer();
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            buffer.name = name;
+        }
+
+        // a track of its own in the trace for zones that aren't timed on a cpu thread,
+        // recorded with clockTicks times. made on the first call with that name
+        ProfileThreadBuffer& Track(const char *name) {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            for (const std::unique_ptr<ProfileThreadBuffer> &buffer : buffers) {
+                if (buffer->clockTimes && buffer->name == name) {
+                    return *buffer;
+                }
+            }
+            buffers.emplace_back(new ProfileThreadBuffer((uint32_t)buffers.size() + 1, true));
+            buffers.back()->name = name;
+            return *buffers.back();
+        }
+
+        // nanoseconds per profilerTicks tick, measured against the steady clock
+        // over the whole run so far
+        double NanosecondsPerTick() {
+            Ticks sinceStart = clockTicks() - startClock;
+            if (sinceStart < CALIBRATION_TICKS) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(CALIBRATION_TICKS - sinceStart));
+            }
+            uint64_t ticks = profilerTicks();
+            Ticks clock = clockTicks();
+            return (double)(clock - startClock) / (double)(ticks - startTicks);
+        }
+
+        // writes the zones still in the rings of all threads, any thread may call
+        // it at any time. false if the file can't be written
+        bool WriteChromeTrace(const std::string &path) {
+            double scale = NanosecondsPerTick();
+            FILE *file = fopen(path.c_str(), "wb");
+            if (!file) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+            bool first = true;
+            for (const std::unique_ptr<ProfileThreadBuffer> &buffer : buffers) {
+                if (!buffer->name.empty()) {
+                    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                            first ? "" : ",\n", buffer->id, escaped(buffer->name.c_str()).c_str());
+                    first = false;
+                }
+                // microseconds since the profiler started, as the format wants
+                uint64_t origin = buffer->clockTimes ? (uint64_t)startClock : startTicks;
+                double toMicroseconds = (buffer->clockTimes ? 1.0 : scale) / 1000.0;
+                buffer->ForEach([&](const char *name, uint64_t begin, uint64_t end) {
+                    double ts = (double)(int64_t)(begin - origin) * toMicroseconds;
+                    double dur = (double)(int64_t)(end - begin) * toMicroseconds;
+                    fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                            first ? "" : ",\n", escaped(name).c_str(), buffer->id, ts, dur);
+                    first = false;
+                });
+            }
+            fputs("\n]}\n", file);
+            return fclose(file) == 0;
+        }
+
+    private:
+        // the calibration needs a few milliseconds to be good to a part in a thousand
+        static const Ticks CALIBRATION_TICKS = 10000000;
+
+        Profiler() : startTicks(profilerTicks()), startClock(clockTicks()) {}
+
+        uint64_t startTicks;
+        Ticks startClock;
+        std::mutex buffersMutex;
+        std::vector<std::unique_ptr<ProfileThreadBuffer>> buffers;
+
+        static std::string escaped(const char *text) {
+            std::string out;
+            for (const char *c = text; *c; c++) {
+                if (*c == '"' || *c == '\\') {
+                    out += '\\';
+                }
+                out += *c;
+            }
+            return out;
+        }
+};
+
+// records the time between its construction and destruction as a zone
+class ProfileZone {
+    public:
+        explicit ProfileZone(const char *name) : name(name), buffer(Profiler::Get().ThreadBuffer()), begin(profilerTicks()) {}
+
+        ~ProfileZone() {
+            buffer.Record(name, begin, profilerTicks());
+        }
+
+        ProfileZone(const ProfileZone&) = delete;
+        ProfileZone& operator=(const ProfileZone&) = delete;
+
+    private:
+        const char *name;
+        ProfileThreadBuffer &buffer;
+        uint64_t begin;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::Get().NameThread(name)
+#define PROFILE_WRITE_TRACE(path) Profiler::Get().WriteChromeTrace(path)
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_WRITE_TRACE(path) false
+
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// fixed size lock-free queue between exactly one producer thread and one consumer
+// thread. neither side ever waits: TryPush fails when the queue is full and TryPop
+// when it's empty. Capacity must be a power of two
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+    public:
+        SpscQueue() : head(0), cachedTail(0), tail(0), cachedHead(0) {}
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // producer thread only
+        bool TryPush(const T &item) {
+            size_t back = tail.load(std::memory_order_relaxed);
+            if (back - cachedHead == Capacity) {
+                // only look at the consumer's index when the stale copy says full
+                cachedHead = head.load(std::memory_order_acquire);
+                if (back - cachedHead == Capacity) {
+                    return false;
+                }
+            }
+            items[back & (Capacity - 1)] = item;
+            tail.store(back + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer thread only
+        bool TryPop(T &item) {
+            size_t front = head.load(std::memory_order_relaxed);
+            if (front == cachedTail) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (front == cachedTail) {
+                    return false;
+                }
+            }
+            item = items[front & (Capacity - 1)];
+            head.store(front + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        // each side's index on its own cache line, next to its copy of the other's
+        alignas(64) std::atomic<size_t> head;
+        size_t cachedTail;
+        alignas(64) std::atomic<size_t> tail;
+        size_t cachedHead;
+        alignas(64) T items[Capacity];
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "util/pool_allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// fixed-size pool of worker threads used by the loaders and generators
+class ThreadPool {
+    public:
+        // constructor spawns the workers, 0 means one per hardware thread
+        explicit ThreadPool(unsigned int threadCount = 0) : stopping(false) {
+            if (threadCount == 0) {
+                threadCount = std::max(1u, std::thread::hardware_concurrency());
+            }
+            for (unsigned int i = 0; i < threadCount; i++) {
+                workers.emplace_back([this] { workerLoop(); });
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                stopping = true;
+            }
+            wakeup.notify_all();
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // process wide pool shared by everything that does not need its own
+        static ThreadPool& Shared() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        unsigned int Size() const {
+            return (unsigned int)workers.size();
+        }
+
+        // queue a task and get a future for its result
+        template <typename F>
+        auto Enqueue(F &&task) -> std::future<decltype(task())> {
+            using Result = decltype(task());
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            std::future<Result> result = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                tasks.emplace([packaged] { (*packaged)(); });
+            }
+            wakeup.notify_one();
+            return result;
+        }
+
+        // run body(i) for every i in [begin, end) split into chunks across the pool.
+        // the calling thread works on chunks too, so this is safe to call from a worker
+        template <typename F>
+        void ParallelFor(int begin, int end, F &&body, int grain = 1) {
+            if (end <= begin) {
+                return;
+            }
+            grain = std::max(1, grain);
+            int chunks = (end - begin + grain - 1) / grain;
+            if (chunks == 1 || workers.empty()) {
+                for (int i = begin; i < end; i++) {
+                    body(i);
+                }
+                return;
+            }
+
+            // shared so that helpers which only get scheduled after we return stay valid
+            struct Work {
+                std::atomic<int> next{0};
+                std::atomic<int> done{0};
+                std::mutex mutex;
+                std::condition_variable finished;
+            };
+            auto work = std::make_shared<Work>();
+            auto runChunks = [work, begin, end, grain, chunks, &body] {
+                for (int c = work->next.fetch_add(1); c < chunks; c = work->next.fetch_add(1)) {
+                    int chunkEnd = std::min(end, begin + (c + 1) * grain);
+                    for (int i = begin + c * grain; i < chunkEnd; i++) {
+                        body(i);
+                    }
+                    if (work->done.fetch_add(1) + 1 == chunks) {
+                        std::lock_guard<std::mutex> lock(work->mutex);
+                        work->finished.notify_all();
+                    }
+                }
+            };
+
+            int helpers = std::min<int>(chunks - 1, (int)workers.size());
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                for (int i = 0; i < helpers; i++) {
+                    tasks.emplace(runChunks);
+                }
+            }
+            wakeup.notify_all();
+            runChunks();
+            // wait for chunks, not for helpers: a helper that starts late finds nothing
+            // left to claim, so this cannot deadlock when every worker is in here
+            std::unique_lock<std::mutex> lock(work->mutex);
+            work->finished.wait(lock, [&] { return work->done.load() == chunks; });
+        }
+
+    private:
+        // a worker without a task for this long hands its cached decode buffers back
+        static constexpr std::chrono::milliseconds IDLE_TRIM{ 2000 };
+
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex queueMutex;
+        std::condition_variable wakeup;
+        bool stopping;
+
+        void workerLoop() {
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    auto ready = [this] { return stopping || !tasks.empty(); };
+                    if (!wakeup.wait_for(lock, IDLE_TRIM, ready)) {
+                        lock.unlock();
+                        PoolArena::Local().Trim();
+                        lock.lock();
+                        wakeup.wait(lock, ready);
+                    }
+                    if (stopping && tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+};
+
+#endif
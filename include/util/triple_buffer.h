@@ -0,0 +1,57 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// hands the newest value from one writer thread to one reader thread without
+// either waiting for the other. the writer fills its own slot and swaps it with the
+// shared middle one, the reader swaps its slot with the middle one when that holds
+// something newer. values the reader was too slow for are skipped, never queued
+//
+//   writer: fill buffer.WriteSlot() completely, then buffer.Publish()
+//   reader: buffer.Acquire(); use buffer.Read()
+template <typename T>
+class TripleBuffer {
+    public:
+        TripleBuffer() : writeIndex(0), middle(1), readIndex(2) {}
+
+        TripleBuffer(const TripleBuffer&) = delete;
+        TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+        // writer thread only. holds an old value, not the last one published
+        T& WriteSlot() {
+            return slots[writeIndex];
+        }
+
+        // writer thread only
+        void Publish() {
+            writeIndex = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // reader thread only: true when something was published since the last call,
+        // Read then returns it
+        bool Acquire() {
+            if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+                return false;
+            }
+            readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        // reader thread only
+        const T& Read() const {
+            return slots[readIndex];
+        }
+
+    private:
+        // middle holds a slot index and whether the writer put it there since the last Acquire
+        static const int INDEX = 3;
+        static const int FRESH = 4;
+
+        T slots[3];
+        alignas(64) int writeIndex;
+        alignas(64) std::atomic<int> middle;
+        alignas(64) int readIndex;
+};
+
+#endif
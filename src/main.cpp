@@ -1,11 +1,31 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "util/pool_allocator.h"
+
+// stb_image allocates from per thread pools so back to back loads reuse their buffers
+#define STBI_MALLOC(sz)       poolMalloc(sz)
+#define STBI_REALLOC(p,newsz) poolRealloc(p,newsz)
+#define STBI_FREE(p)          poolFree(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "images/stb_image.h"
+#include "images/qoi.h"
 
 #include "shader/shader.h"
 #include "camera.h"
+#include "camera_path.h"
+#include "geometry/spinning_instances.h"
+#include "geometry/static_batch.h"
+#include "texture/mipmap.h"
+#include "texture/texture_registry.h"
+#include "texture/texture_residency.h"
+#include "texture/video_texture.h"
+#include "util/fixed_timestep.h"
+#include "util/frame_pacer.h"
+#include "util/gpu_profiler.h"
+#include "util/profiler.h"
+#include "util/spsc_queue.h"
+#include "util/triple_buffer.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -14,11 +34,26 @@
 #include <iostream>
 #include <cmath>
 #include <filesystem>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void writeTrace();
 
 // initial screen size settings
 unsigned int SCR_WIDTH  = 800;
@@ -26,18 +61,140 @@ unsigned int SCR_HEIGHT = 600;
 
 // initial camera settings
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
-float lastX = SCR_WIDTH / 2.0f;
-float lastY = SCR_HEIGHT / 2.0f;
+double lastX = SCR_WIDTH / 2.0;
+double lastY = SCR_HEIGHT / 2.0;
 bool firstMouse = true;
 
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// cursor movement since the camera was last turned, applied once per update
+double mouseDeltaX = 0.0;
+double mouseDeltaY = 0.0;
+bool mouseEventPending = false;
+
+// the keys held down, kept up to date by key_callback
+std::bitset<GLFW_KEY_LAST + 1> keysDown;
+
+// --on-demand only draws when something changed. SPACE starts and stops the cubes
+bool onDemand = false;
+bool spinning = true;
+// an input since the last frame packet that may change what's on screen
+bool inputChanged = false;
+uint64_t sceneVersion = 0;
+// how long an idle main thread sleeps between checks
+const double IDLE_WAIT_SECONDS = 0.5;
+
+// where F12 and --trace write the profiler's zones
+std::string tracePath = "trace.json";
+
+// what the fixed simulation steps change, the frames draw a blend of the last two
+struct SceneState {
+    glm::vec3 cameraPosition;
+    // the mix value for the textures
+    float mixValue;
+    // how far the cubes have turned, only runs while they spin
+    double spinTime;
+};
+
+// everything the render thread needs for a frame, published by the main thread
+struct FramePacket {
+    uint64_t serial;
+    // the last two simulation states, the newer one due at stateClockTicks
+    SceneState previous;
+    SceneState current;
+    Ticks stateTime;
+    Ticks stateClockTicks;
+    Ticks stepTicks;
+    // orientation and zoom follow the mouse directly, only the position is blended
+    Camera camera;
+    int width;
+    int height;
+    // changes with every step that changed the states and every input, the same
+    // value draws the same frame
+    uint64_t sceneVersion;
+    // something keeps moving, every frame differs
+    bool animating;
+};
+
+enum InputEventType {
+    INPUT_KEY, INPUT_MOUSE, INPUT_SCROLL, INPUT_RESIZE
+};
+
+// an input the main thread handled, for measuring how long it takes to reach the screen
+struct InputEvent {
+    InputEventType type;
+    // when glfw reported it
+    Ticks time;
+    // the first frame packet that includes it
+    uint64_t packet;
+};
+
+// main thread to render thread. the packets are latest wins, the events all arrive
+// unless the render thread stalls long enough to fill the queue
+SpscQueue<InputEvent, 1024> inputEvents;
+TripleBuffer<FramePacket> framePackets;
+uint64_t nextPacket = 1;
+std::atomic<bool> rendering(true);
+// the render thread has work of its own, a video playing or textures loading, so
+// the main thread keeps stepping even when the scene is settled
+std::atomic<bool> renderBusy(false);
+// wakes an idle render thread when a packet is published or rendering stops
+std::mutex publishMutex;
+std::condition_variable packetPublished;
+uint64_t publishedSerial = 0;
+
+struct RenderLoopSettings {
+    FramePacerSettings pacing;
+    bool onDemand;
+    // the loop has its own thread, so it waits for packets instead of on the events
+    bool ownThread;
+    // where to save the camera path of every frame drawn, or to take the frames from
+    std::string recordPath;
+    std::string replayPath;
+};
+
+void simulate(SceneState &state, float stepSeconds);
+void publishFrame(const FixedTimestep &clock, const InterpolatedState<SceneState> &scene);
+bool updateMainThread(GLFWwindow *window, FixedTimestep &clock, InterpolatedState<SceneState> &scene, bool wait);
+void renderLoop(GLFWwindow *window, const RenderLoopSettings &settings, const std::function<bool()> &keepRendering);
+void printFrameTimes(const char *name, const FrameTimeStats &times);
+
+int main(int argc, char **argv) {
+    // --single-thread renders between the event polls on this thread, to compare input latency.
+    // --fps caps the frame rate, --vsync 1, 0 or -1 (adaptive) picks the swap interval and
+    // --frames-in-flight lets the GPU fall further behind for more throughput.
+    // --on-demand draws only when input, an animation or streaming changed something.
+    // --record saves the camera of every frame to a file, --replay draws exactly those frames.
+    // --trace writes the profiler's zones on exit, F12 writes them at any time
+    bool renderThread = true;
+    bool traceOnExit = false;
+    FramePacerSettings pacing;
+    std::string recordPath;
+    std::string replayPath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--single-thread") {
+            renderThread = false;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            pacing.maxFps = atof(argv[++i]);
+        } else if (arg == "--vsync" && i + 1 < argc) {
+            pacing.swapInterval = atoi(argv[++i]);
+        } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            pacing.maxFramesInFlight = atoi(argv[++i]);
+        } else if (arg == "--on-demand") {
+            onDemand = true;
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+            traceOnExit = true;
+        }
+    }
+    // an on demand window starts still, so it can go idle
+    spinning = !onDemand;
 
-// stores the mix value for the textures
-float mixValue = 0.2f;
+    PROFILE_THREAD("main");
 
-int main() {
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -54,13 +211,69 @@ int main() {
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // unaccelerated deltas straight from the mouse where the platform has them
+    if (glfwRawMouseMotionSupported()) {
+        glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+    }
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    SCR_WIDTH = framebufferWidth;
+    SCR_HEIGHT = framebufferHeight;
+
+    // movement runs in steps of 1/120 s whatever the frame rate, on 64 bit ticks
+    FixedTimestep simulationClock(120);
+    InterpolatedState<SceneState> scene(SceneState{ camera.Position, 0.2f, 0.0 });
+    simulationClock.Advance(clockTicks());
+    publishFrame(simulationClock, scene);
+
+    if (renderThread) {
+        // the render thread takes the context over, this one only handles events and
+        // the simulation so a slow swap never holds input up
+        glfwMakeContextCurrent(NULL);
+        RenderLoopSettings settings = { pacing, onDemand, true, recordPath, replayPath };
+        std::thread renderer(renderLoop, window, settings, []() { return rendering.load(); });
+        while (!glfwWindowShouldClose(window)) {
+            updateMainThread(window, simulationClock, scene, true);
+        }
+        {
+            std::lock_guard<std::mutex> lock(publishMutex);
+            rendering = false;
+        }
+        packetPublished.notify_one();
+        renderer.join();
+    } else {
+        RenderLoopSettings settings = { pacing, onDemand, false, recordPath, replayPath };
+        renderLoop(window, settings, [&]() { return updateMainThread(window, simulationClock, scene, false); });
+    }
+
+    FixedTimestepStats clockStats = simulationClock.Stats();
+    std::cout << "simulation: " << clockStats.steps << " steps, " << clockStats.clampedFrames << " frames fell behind and skipped "
+              << ticksToSeconds(clockStats.skippedTicks) << " s, idle for " << ticksToSeconds(clockStats.idleTicks) << " s" << std::endl;
+    if (traceOnExit) {
+        writeTrace();
+    }
+
+    // glfw: terminate, clearing all previously allocated GLFW resources
+    glfwTerminate();
+    return 0;
+}
+
+// the GL side of the program, on the thread that owns the context: builds every GL
+// object, then draws the newest frame packet until keepRendering says stop
+void renderLoop(GLFWwindow *window, const RenderLoopSettings &settings, const std::function<bool()> &keepRendering) {
+    if (settings.ownThread) {
+        PROFILE_THREAD("render");
+    }
+    glfwMakeContextCurrent(window);
 
     // glad: load all OpenGL function pointers
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        glfwSetWindowShouldClose(window, true);
+        return;
     }
 
     // configure global opengl state
@@ -68,6 +281,7 @@ int main() {
 
     // build and compile the shader program
     Shader ourShader("include/shader/shader.vert", "include/shader/shader.frag");
+    Shader spinShader("include/shader/spinning.vert", "include/shader/shader.frag");
 
     // set up the vertex data and buffers and configure vertex attributes
     float vertices[] = {
@@ -144,6 +358,27 @@ int main() {
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
+    // the cubes turn at a constant speed, so they are animated in the vertex shader
+    // from their position, axis and speed uploaded once
+    SpinningInstances spinningCubes;
+    for (unsigned int i = 0; i < 10; i++) {
+        spinningCubes.Add(cubePositions[i], glm::vec3(1.0f, 0.3f, 0.5f), glm::radians(20.0f * i));
+    }
+    spinningCubes.Upload(VAO);
+
+    // a floor of tiles that never move: pre-transformed and merged into one buffer per
+    // chunk, so the whole floor costs a few draw calls instead of one per tile
+    auto cubeMesh = std::make_shared<MeshData>();
+    cubeMesh->vertices.assign(vertices, vertices + sizeof(vertices) / sizeof(float));
+    StaticBatcher staticBatcher(8.0f);
+    for (int z = -16; z < 16; z++) {
+        for (int x = -16; x < 16; x++) {
+            glm::mat4 tile = glm::translate(glm::mat4(1.0f), glm::vec3((float)x, -4.0f, (float)z));
+            staticBatcher.Add(cubeMesh, glm::scale(tile, glm::vec3(0.95f, 0.1f, 0.95f)), 0);
+        }
+    }
+    staticBatcher.Rebuild();
+
     // loading and creating textures;
     unsigned int texture1, texture2;
     std::filesystem::path image1RelativePath = "include/images/flower_bee.jpg";
@@ -151,141 +386,527 @@ int main() {
     std::filesystem::path image1AbsolutePath = std::filesystem::canonical(image1RelativePath);
     std::filesystem::path image2AbsolutePath = std::filesystem::canonical(image2RelativePath);
 
+    // streams the finer mips of texture 1 in as the cubes get bigger on screen
+    TextureResidency textureResidency(64 * 1024 * 1024);
+    int texture1Id = -1;
+
+    // owns the regular textures and adds up the GPU memory of all of them
+    TextureRegistry textureRegistry;
+    textureRegistry.TrackExternal("streamed", [&textureResidency]() { return textureResidency.Counters().residentBytes; });
+
     //texture 1
-    glGenTextures(1, &texture1);
-    glBindTexture(GL_TEXTURE_2D, texture1); // all of the next operations on GL_TEXTURE_2D now have effect on this texture
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set the texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // load image, create texture and generate mipmaps
     int width, height, nrChannels;
     stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture on the y axis
     unsigned char *data = stbi_load(image1AbsolutePath.string().c_str(), &width, &height, &nrChannels, 0);
     if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        // build the mips on the cpu, filtered in linear space since the photo is sRGB
+        auto mips = std::make_shared<const MipChain>(generateMipChain(data, width, height, nrChannels));
+        // only the small tail levels are uploaded here, the rest arrive in textureResidency.Update
+        texture1Id = textureResidency.Register(mips, GL_RGB);
+        texture1 = textureResidency.Texture(texture1Id);
     } else {
+        glGenTextures(1, &texture1);
         std::cout << "Failed to load texture" << std::endl;
     }
-    stbi_image_free(data);
-
-    // loading and creating a second texture
-    glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    glBindTexture(GL_TEXTURE_2D, texture1); // all of the next operations on GL_TEXTURE_2D now have effect on this texture
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     // set the texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load image, create texture and mipmaps
-    data = stbi_load(image2AbsolutePath.string().c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    stbi_image_free(data);
+
+    // loading and creating a second texture, shared with anything else that loads the same pixels
+    TextureDesc texture2Desc;
+    texture2Desc.minFilter = GL_LINEAR;
+    TextureHandle texture2Handle;
+    // prefer the qoi copy made by qoiconv, it decodes several times faster than the png
+    std::filesystem::path image2QoiPath = std::filesystem::path(image2RelativePath).replace_extension(".qoi");
+    QoiImage image2;
+    if (qoiRead(image2QoiPath.string(), image2, 0, true)) {
+        texture2Handle = textureRegistry.Acquire(image2.pixels.data(), image2.width, image2.height, image2.channels,
+                                                 texture2Desc, image2QoiPath.string());
     } else {
+        data = stbi_load(image2AbsolutePath.string().c_str(), &width, &height, &nrChannels, 0);
+        if (data) {
+            texture2Handle = textureRegistry.Acquire(data, width, height, nrChannels, texture2Desc, image2RelativePath.string());
+        }
+        stbi_image_free(data);
+    }
+    if (texture2Handle.Valid()) {
+        texture2 = texture2Handle.Texture();
+    } else {
+        glGenTextures(1, &texture2);
         std::cout << "Failed to load texture" << std::endl;
     }
-    stbi_image_free(data);
+
+    // numbered frames in include/video play on the second texture instead of the face
+    VideoTexture video;
+    auto frames = std::make_shared<ImageSequenceSource>();
+    ImageDecoder stbDecoder = [](const unsigned char *data, size_t size, unsigned char *out, size_t outSize, int *w, int *h) {
+        int n;
+        if (!out) {
+            return stbi_info_from_memory(data, (int)size, w, h, &n) == 1;
+        }
+        // decoded straight into the mapped pixel buffer, already bottom up for GL
+        // since the flip set above is global
+        return stbi_load_from_memory_into(data, (int)size, out, outSize, 0, w, h, &n, 4) != 0;
+    };
+    if (frames->Open("include/video", 30.0, stbDecoder) && video.Open(frames)) {
+        textureRegistry.TrackExternal("video", [&video]() { return video.GpuBytes(); });
+    }
 
     // tell opengl for each sampler to which texture unit it belongs to
     ourShader.use();
     ourShader.setInt("texture1", 0);
     ourShader.setInt("texture2", 1);
+    spinShader.use();
+    spinShader.setInt("texture1", 0);
+    spinShader.setInt("texture2", 1);
+
+    // input events on their way to the screen, and how long they took to get there
+    std::vector<InputEvent> unseenEvents;
+    int64_t latencySamples = 0;
+    double latencyTotal = 0.0;
+    double latencyMax = 0.0;
+    int viewportWidth = 0;
+    int viewportHeight = 0;
+
+    // kept across frames, so its matrices are only rebuilt and uploaded when the view changed
+    Camera frameCamera;
+    uint64_t uploadedCameraVersion = 0;
+
+    // holds frames back so the driver doesn't queue them up behind the input
+    FramePacer pacer;
+    pacer.Init(settings.pacing);
+
+    // the GPU time of each pass, read a few frames late so it never stalls
+    GpuProfiler gpuProfiler(settings.pacing.maxFramesInFlight + 3);
+    gpuProfiler.Init();
+
+    // ask for the texture detail the cubes need at their current size on screen
+    auto updateResidency = [&]() {
+        PROFILE_ZONE("texture residency");
+        if (texture1Id >= 0) {
+            for (unsigned int i = 0; i < 10; i++) {
+                textureResidency.RequestForObject(texture1Id, cubePositions[i], 0.87f, frameCamera, (float)viewportHeight);
+            }
+            textureResidency.Update();
+        }
+    };
+
+    // a replay takes every frame's camera and clock from the file instead of the packets
+    CameraPath recordedPath;
+    CameraPath replayedPath;
+    size_t replayFrame = 0;
+    if (!settings.replayPath.empty()) {
+        if (replayedPath.Load(settings.replayPath)) {
+            std::cout << "replaying " << replayedPath.Size() << " frames from " << settings.replayPath << std::endl;
+        } else {
+            std::cout << "Failed to load camera path " << settings.replayPath << std::endl;
+        }
+    }
+    bool replaying = !replayedPath.Empty();
+
+    // on demand: the scene version of the last frame, and the time spent without drawing
+    int64_t framesDrawn = 0;
+    uint64_t drawnVersion = 0;
+    int64_t idleWakeups = 0;
+    Ticks idleTicks = 0;
+    Ticks idleSince = 0;
+
+    // rendering loop until the main thread stops it. the pacer waits before the
+    // input is taken, so a frame always starts from the newest
+    while (keepRendering()) {
+        if (idleSince != 0) {
+            idleTicks += clockTicks() - idleSince;
+            idleSince = 0;
+        }
+
+        // a replay ends with its path
+        if (replaying && replayFrame == replayedPath.Size()) {
+            glfwSetWindowShouldClose(window, true);
+            break;
+        }
 
-    // rendering loop while the window is open
-    while(!glfwWindowShouldClose(window)) {
-        // input
-        processInput(window);
+        // on demand, a frame that would look like the last one isn't drawn. the
+        // textures are still asked for, so loads in flight are kept and uploaded.
+        // the residency update runs once per iteration, a frame drawn after this
+        // check keeps its uploads rather than taking a second budget
+        bool residencyUpdated = false;
+        if (settings.onDemand && !replaying && framesDrawn > 0) {
+            framePackets.Acquire();
+            const FramePacket &latest = framePackets.Read();
+            // ask from where the camera is now, the frame drawn below blends it further
+            frameCamera.Position = latest.current.cameraPosition;
+            frameCamera.Front = latest.camera.Front;
+            frameCamera.Up = latest.camera.Up;
+            frameCamera.Zoom = latest.camera.Zoom;
+            updateResidency();
+            residencyUpdated = true;
+            ResidencyCounters residency = textureResidency.Counters();
+            bool videoPlaying = video.IsOpen() && !video.Finished();
+            renderBusy = videoPlaying || residency.pendingLoads > 0;
+            if (latest.sceneVersion == drawnVersion && !latest.animating && !videoPlaying && residency.uploadsThisFrame == 0) {
+                // the events in this packet changed nothing, they never reach the screen
+                size_t kept = 0;
+                for (const InputEvent &unseen : unseenEvents) {
+                    if (unseen.packet > latest.serial) {
+                        unseenEvents[kept++] = unseen;
+                    }
+                }
+                unseenEvents.resize(kept);
+                idleWakeups++;
+                idleSince = clockTicks();
+                pacer.Pause();
+                if (settings.ownThread) {
+                    PROFILE_ZONE("idle");
+                    // poll quickly while textures are loading, otherwise sleep until a
+                    // packet comes. the timeout only guards against a missed wakeup
+                    auto timeout = residency.pendingLoads > 0 ? std::chrono::milliseconds(2) : std::chrono::milliseconds(250);
+                    uint64_t serial = latest.serial;
+                    std::unique_lock<std::mutex> lock(publishMutex);
+                    packetPublished.wait_for(lock, timeout, [serial]() { return publishedSerial != serial || !rendering; });
+                }
+                continue;
+            }
+        }
+
+        PROFILE_ZONE("frame");
+        pacer.BeginFrame();
+        gpuProfiler.BeginFrame();
+        InputEvent event;
+        while (inputEvents.TryPop(event)) {
+            unseenEvents.push_back(event);
+        }
 
-        // calculate deltatime
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        // the newest packet, blended between its two steps by how far the clock has got since
+        framePackets.Acquire();
+        const FramePacket &packet = framePackets.Read();
+        if (packet.width != viewportWidth || packet.height != viewportHeight) {
+            viewportWidth = packet.width;
+            viewportHeight = packet.height;
+            glViewport(0, 0, viewportWidth, viewportHeight);
+        }
+        Ticks sinceState = clockTicks() - packet.stateClockTicks;
+        float alpha = glm::clamp((float)((double)sinceState / (double)packet.stepTicks), 0.0f, 1.0f);
+        // the global camera belongs to the main thread
+        frameCamera.Position = glm::mix(packet.previous.cameraPosition, packet.current.cameraPosition, alpha);
+        frameCamera.Front = packet.camera.Front;
+        frameCamera.Up = packet.camera.Up;
+        frameCamera.Zoom = packet.camera.Zoom;
+        if (viewportHeight > 0) {
+            frameCamera.Aspect = (float)viewportWidth / (float)viewportHeight;
+        }
+        float mixValue = glm::mix(packet.previous.mixValue, packet.current.mixValue, alpha);
+        double spinTime = packet.previous.spinTime + (packet.current.spinTime - packet.previous.spinTime) * alpha;
+        Ticks frameTime = packet.stateTime + sinceState;
+        if (replaying) {
+            // the camera, the clock and the scene all come from the file, so every run
+            // shows the same frames whatever the keys do
+            const CameraPathFrame &replayed = replayedPath.Frame(replayFrame);
+            replayedPath.Apply(replayFrame, frameCamera);
+            frameTime = replayed.time;
+            mixValue = replayed.mixValue;
+            spinTime = replayed.spinTime;
+            replayFrame++;
+        } else if (!settings.recordPath.empty()) {
+            CameraPathFrame recorded = { frameTime, frameCamera.Position, packet.camera.Yaw, packet.camera.Pitch, frameCamera.Zoom,
+                                         mixValue, spinTime };
+            recordedPath.Add(recorded);
+        }
+        double time = ticksToSeconds(frameTime);
 
         // rendering commands here
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        {
+            GpuZone gpuZone(gpuProfiler, "clear");
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
+        if (!residencyUpdated) {
+            GpuZone gpuZone(gpuProfiler, "texture residency");
+            updateResidency();
+        }
+
+        // pick the video frame for this point in time, never waits for the decoder
+        {
+            PROFILE_ZONE("video");
+            GpuZone gpuZone(gpuProfiler, "video");
+            video.Update(time);
+        }
 
         // bind the textures on texture units
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture1);
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
+        glBindTexture(GL_TEXTURE_2D, video.IsOpen() ? video.Texture() : texture2);
         
-        // set the texture mix value in the shader
-        ourShader.setFloat("mixValue", mixValue);
+        // projection and view are combined by the camera, the shaders never multiply
+        // matrices. uniforms stay set in their program, so only a moved camera is uploaded
+        uint64_t cameraVersion;
+        {
+            PROFILE_ZONE("camera matrices");
+            // rebuilds them if the camera moved
+            cameraVersion = frameCamera.Version();
+        }
+        if (cameraVersion != uploadedCameraVersion) {
+            PROFILE_ZONE("uniform uploads");
+            uploadedCameraVersion = cameraVersion;
+            ourShader.use();
+            ourShader.setMat4("viewProjection", frameCamera.GetViewProjectionMatrix());
+            spinShader.use();
+            spinShader.setMat4("viewProjection", frameCamera.GetViewProjectionMatrix());
+        }
 
-        // activate shader
+        // activate shader and set the texture mix value in it
         ourShader.use();
-        
-        // pass projection matrix to shader
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        ourShader.setMat4("projection", projection);
-
-        // camera view transformation
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("view", view);
-
-        // render the scene
-        glBindVertexArray(VAO);
-        for(unsigned int i = 0; i < 10; i++) {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, (float)glfwGetTime() * (glm::radians(angle) + 0), glm::vec3(1.0f, 0.3f, 0.5f));
-            ourShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        ourShader.setFloat("mixValue", mixValue);
+
+        // render the scene, the static batches are already in world space
+        {
+            PROFILE_ZONE("draw static batches");
+            GpuZone gpuZone(gpuProfiler, "draw static batches");
+            ourShader.setMat4("model", glm::mat4(1.0f));
+            staticBatcher.Draw(frameCamera.GetFrustum(), nullptr);
+        }
+
+        // the cubes only need the time, the shader builds their model matrices
+        {
+            PROFILE_ZONE("draw spinning cubes");
+            GpuZone gpuZone(gpuProfiler, "draw spinning cubes");
+            spinShader.use();
+            spinShader.setFloat("mixValue", mixValue);
+            glBindVertexArray(VAO);
+            spinningCubes.Draw(spinShader, (float)spinTime, 36);
+        }
+
+        // glfw: swap the buffers, and fence the frame for the pacer
+        gpuProfiler.EndFrame();
+        pacer.EndFrame(window);
+        framesDrawn++;
+        drawnVersion = packet.sceneVersion;
+
+        // every event that made it into this packet has now been handed to the driver
+        Ticks swapped = clockTicks();
+        size_t kept = 0;
+        for (const InputEvent &unseen : unseenEvents) {
+            if (unseen.packet <= packet.serial) {
+                double milliseconds = ticksToSeconds(swapped - unseen.time) * 1000.0;
+                latencySamples++;
+                latencyTotal += milliseconds;
+                latencyMax = std::max(latencyMax, milliseconds);
+            } else {
+                unseenEvents[kept++] = unseen;
+            }
         }
-        // glfw: swap the buffers and poll IO events (key presses and more)
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        unseenEvents.resize(kept);
     }
 
-    // de-allocate resources once they've outlived their purpose
+    // de-allocate resources once they've outlived their purpose, while the context is still current
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
-    
-    // glfw: terminate, clearing all previously allocated GLFW resources
-    glfwTerminate();
-    return 0;
+    spinningCubes.Release();
+    StaticBatchStats batchStats = staticBatcher.Stats();
+    std::cout << "static batching: " << batchStats.objects << " objects in " << batchStats.batches << " batches, last frame "
+              << batchStats.drawCalls << " draw calls for " << batchStats.drawnObjects << " objects" << std::endl;
+    staticBatcher.Release();
+    if (video.IsOpen()) {
+        VideoTextureStats videoStats = video.Stats();
+        std::cout << "video: " << videoStats.presentedFrames << " frames shown, " << videoStats.droppedFrames << " dropped, "
+                  << videoStats.lateFrames << " late, " << videoStats.decodeMilliseconds << " ms per decode" << std::endl;
+    }
+    video.Release();
+    texture2Handle.Reset();
+    textureRegistry.Release();
+    textureResidency.Release();
+    if (latencySamples > 0) {
+        std::cout << "input latency to swap: " << latencySamples << " events, " << latencyTotal / latencySamples << " ms average, "
+                  << latencyMax << " ms worst" << std::endl;
+    }
+    if (!settings.recordPath.empty()) {
+        if (recordedPath.Save(settings.recordPath)) {
+            std::cout << "recorded " << recordedPath.Size() << " frames to " << settings.recordPath << std::endl;
+        } else {
+            std::cout << "Failed to save camera path " << settings.recordPath << std::endl;
+        }
+    }
+    FramePacerStats pacerStats = pacer.Stats();
+    pacer.Release();
+    std::cout << "frames: " << pacerStats.frames << ", swap interval " << pacerStats.actualSwapInterval << std::endl;
+    printFrameTimes("  cpu", pacerStats.cpu);
+    printFrameTimes("  gpu", pacerStats.gpu);
+    printFrameTimes("  present interval", pacerStats.present);
+    printFrameTimes("  pacing wait", pacerStats.wait);
+    GpuProfilerStats gpuStats = gpuProfiler.Stats();
+    std::vector<GpuPassStats> gpuPasses = gpuProfiler.Passes();
+    gpuProfiler.Release();
+    std::cout << "gpu passes: " << gpuStats.resolvedFrames << " frames timed, " << gpuStats.droppedFrames << " dropped" << std::endl;
+    for (const GpuPassStats &pass : gpuPasses) {
+        std::cout << "  " << pass.label << ": " << pass.average << " ms average, " << pass.max << " ms worst" << std::endl;
+    }
+    if (settings.onDemand) {
+        // what the idle time would have cost drawn at the measured frame rate
+        double idleSeconds = ticksToSeconds(idleTicks);
+        double skippedFrames = pacerStats.present.average > 0.0 ? idleSeconds * 1000.0 / pacerStats.present.average : 0.0;
+        std::cout << "on demand: " << framesDrawn << " frames drawn, idle for " << idleSeconds << " s in " << idleWakeups
+                  << " wakeups, about " << (int64_t)skippedFrames << " frames saved: " << skippedFrames * pacerStats.cpu.average
+                  << " ms cpu, " << skippedFrames * pacerStats.gpu.average << " ms gpu" << std::endl;
+    }
+    glfwMakeContextCurrent(NULL);
 }
 
-// process all input: query GLFW whether relevant kays are pressed this frame and react accordingly
+void printFrameTimes(const char *name, const FrameTimeStats &times) {
+    std::cout << name << ": " << times.average << " ms average, " << times.p50 << " / " << times.p95 << " / " << times.p99
+              << " ms at 50 / 95 / 99%, " << times.max << " ms worst" << std::endl;
+}
+
+bool sameState(const SceneState &a, const SceneState &b) {
+    return a.cameraPosition == b.cameraPosition && a.mixValue == b.mixValue && a.spinTime == b.spinTime;
+}
 
+// nothing on screen moves until the next input: the cubes are stopped, no key that
+// moves anything is held and the last step changed nothing
+bool sceneSettled(const InterpolatedState<SceneState> &scene) {
+    bool moving = keysDown[GLFW_KEY_W] || keysDown[GLFW_KEY_S] || keysDown[GLFW_KEY_A] || keysDown[GLFW_KEY_D] ||
+                  keysDown[GLFW_KEY_UP] || keysDown[GLFW_KEY_DOWN];
+    return !spinning && !moving && sameState(scene.Previous(), scene.Current());
+}
+
+// the main thread's part of a frame: events, held keys and the simulation steps
+// that are due, then a new frame packet. with wait it sleeps until the next step
+// unless an event comes first. on demand, a settled scene sleeps until an input and
+// the simulation skips the time it slept
+bool updateMainThread(GLFWwindow *window, FixedTimestep &clock, InterpolatedState<SceneState> &scene, bool wait) {
+    double untilStep = ticksToSeconds(clock.StateClockTicks() + clock.StepTicks() - clockTicks());
+    {
+        PROFILE_ZONE("events");
+        if (onDemand && !renderBusy && sceneSettled(scene)) {
+            glfwWaitEventsTimeout(IDLE_WAIT_SECONDS);
+            clock.Skip(clockTicks());
+        } else if (wait && untilStep > 0.0) {
+            glfwWaitEventsTimeout(untilStep);
+        } else {
+            glfwPollEvents();
+        }
+    }
+    processInput(window);
+
+    // all the cursor events since the last update turn the camera once
+    if (mouseDeltaX != 0.0 || mouseDeltaY != 0.0) {
+        camera.ProcessMouseMovement((float)mouseDeltaX, (float)mouseDeltaY);
+        mouseDeltaX = 0.0;
+        mouseDeltaY = 0.0;
+    }
+
+    // run the simulation steps that are due. the frames drawn from the two states
+    // only change if the steps changed either of them, a step that leaves a settled
+    // scene as it was doesn't make a new frame. uploads and video frames ask the
+    // render thread for their own
+    int steps = clock.Advance(clockTicks());
+    SceneState previousBefore = scene.Previous();
+    SceneState currentBefore = scene.Current();
+    for (int i = 0; i < steps; i++) {
+        PROFILE_ZONE("simulate");
+        scene.BeginStep();
+        simulate(scene.Current(), clock.StepSeconds());
+    }
+    bool stepsChanged = steps > 0 && !(sameState(scene.Previous(), previousBefore) && sameState(scene.Current(), currentBefore));
+    if (stepsChanged || inputChanged) {
+        sceneVersion++;
+        inputChanged = false;
+    }
+    publishFrame(clock, scene);
+    return !glfwWindowShouldClose(window);
+}
+
+void publishFrame(const FixedTimestep &clock, const InterpolatedState<SceneState> &scene) {
+    PROFILE_ZONE("publish");
+    FramePacket &packet = framePackets.WriteSlot();
+    packet.serial = nextPacket++;
+    packet.previous = scene.Previous();
+    packet.current = scene.Current();
+    packet.stateTime = clock.StateTime();
+    packet.stateClockTicks = clock.StateClockTicks();
+    packet.stepTicks = clock.StepTicks();
+    packet.camera = camera;
+    packet.width = SCR_WIDTH;
+    packet.height = SCR_HEIGHT;
+    packet.sceneVersion = sceneVersion;
+    packet.animating = !sceneSettled(scene);
+    framePackets.Publish();
+    mouseEventPending = false;
+
+    // an idle render thread sleeps until this
+    {
+        std::lock_guard<std::mutex> lock(publishMutex);
+        publishedSerial = packet.serial;
+    }
+    packetPublished.notify_one();
+}
+
+// the zones the profiler still has, from every thread
+void writeTrace() {
+    if (!PROFILER_ENABLED) {
+        std::cout << "no trace, the profiler is only built in with -DPROFILER=ON" << std::endl;
+    } else if (PROFILE_WRITE_TRACE(tracePath)) {
+        std::cout << "wrote trace " << tracePath << std::endl;
+    } else {
+        std::cout << "Failed to write trace " << tracePath << std::endl;
+    }
+}
+
+// records an input for the latency numbers, dropped when the render thread is far behind
+void pushInputEvent(InputEventType type) {
+    InputEvent event = { type, clockTicks(), nextPacket };
+    inputEvents.TryPush(event);
+}
+
+// process all input: react to the keys held down this frame
 void processInput(GLFWwindow *window) {    
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    PROFILE_ZONE("processInput");
+    if (keysDown[GLFW_KEY_ESCAPE]) {
         glfwSetWindowShouldClose(window, true);
     }
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-        mixValue += 0.001f;
+}
+
+// one fixed step of what the held keys move. the mouse turns the camera directly
+// every frame, only its position is simulated
+void simulate(SceneState &state, float stepSeconds) {
+    if (keysDown[GLFW_KEY_UP]) {
+        state.mixValue += 0.06f * stepSeconds;
     }    
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-        mixValue -= 0.001f;
+    if (keysDown[GLFW_KEY_DOWN]) {
+        state.mixValue -= 0.06f * stepSeconds;
     }
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+    if (spinning) {
+        state.spinTime += stepSeconds;
+    }
+    camera.Position = state.cameraPosition;
+    if (keysDown[GLFW_KEY_W]) {
+        camera.ProcessKeyboard(FORWARD, stepSeconds);
     }    
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+    if (keysDown[GLFW_KEY_S]) {
+        camera.ProcessKeyboard(BACKWARD, stepSeconds);
     }    
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        camera.ProcessKeyboard(LEFT, deltaTime);
+    if (keysDown[GLFW_KEY_A]) {
+        camera.ProcessKeyboard(LEFT, stepSeconds);
     }    
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+    if (keysDown[GLFW_KEY_D]) {
+        camera.ProcessKeyboard(RIGHT, stepSeconds);
     }
+    state.cameraPosition = camera.Position;
 }
 
 // glfw: whenever the window size changes, this callback function executes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-    // make sure the viewport mtches the new window dimensions
-    glViewport(0, 0, width, height);
+    // the render thread matches the viewport to the next frame packet
     SCR_WIDTH = width;
     SCR_HEIGHT = height;
+    inputChanged = true;
+    pushInputEvent(INPUT_RESIZE);
 }
 
 // get mouse movement
@@ -295,16 +916,40 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
         lastY = ypos;
         firstMouse = false;
     }
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos;
+    // a fast mouse reports thousands of times a second, the camera turns once per update
+    mouseDeltaX += xpos - lastX;
+    mouseDeltaY += lastY - ypos;
 
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    // the oldest movement not yet in a frame packet is the one that waits longest
+    if (!mouseEventPending) {
+        pushInputEvent(INPUT_MOUSE);
+        mouseEventPending = true;
+    }
+    inputChanged = true;
 }
 
 // zoom with the scroll
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     camera.processMouseScroll(static_cast<float>(yoffset));
+    inputChanged = true;
+    pushInputEvent(INPUT_SCROLL);
+}
+
+// keeps keysDown for processInput and simulate, and times the presses and releases
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (key < 0 || action == GLFW_REPEAT) {
+        return;
+    }
+    keysDown[key] = action == GLFW_PRESS;
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+        spinning = !spinning;
+    }
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+        writeTrace();
+    }
+    inputChanged = true;
+    pushInputEvent(INPUT_KEY);
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+// converts every png, tga and bmp in a directory to qoi, one file per pool
+// thread. jpegs are left alone, qoi is lossless and would be several times larger. files whose .qoi is newer than the source are skipped.
+//
+// usage: qoiconv <input directory> [output directory] [--force]
+// the output directory defaults to the input directory
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "images/stb_image.h"
+#include "images/qoi.h"
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static bool isSourceImage(const fs::path &path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".png" || extension == ".tga" || extension == ".bmp";
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> args;
+    bool force = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--force") == 0) {
+            force = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.empty()) {
+        printf("usage: qoiconv <input directory> [output directory] [--force]\n");
+        return 1;
+    }
+    fs::path input = args[0];
+    fs::path output = args.size() > 1 ? fs::path(args[1]) : input;
+    std::error_code error;
+    fs::create_directories(output, error);
+
+    std::vector<fs::path> sources;
+    for (const auto &entry : fs::directory_iterator(input, error)) {
+        if (entry.is_regular_file() && isSourceImage(entry.path())) {
+            sources.push_back(entry.path());
+        }
+    }
+    std::sort(sources.begin(), sources.end());
+
+    std::atomic<int> converted(0), skipped(0), failed(0);
+    std::atomic<size_t> sourceBytes(0), qoiBytes(0);
+    auto start = std::chrono::steady_clock::now();
+
+    ThreadPool::Shared().ParallelFor(0, (int)sources.size(), [&](int i) {
+        const fs::path &source = sources[i];
+        fs::path target = output / source.filename();
+        target.replace_extension(".qoi");
+        std::error_code fileError;
+        if (!force && fs::exists(target, fileError) &&
+            fs::last_write_time(target, fileError) >= fs::last_write_time(source, fileError)) {
+            skipped++;
+            return;
+        }
+
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(source.string().c_str(), &width, &height, &channels, 0);
+        if (pixels && channels < 3) {
+            // qoi only stores rgb and rgba
+            stbi_image_free(pixels);
+            int wanted = channels == 2 ? 4 : 3;
+            pixels = stbi_load(source.string().c_str(), &width, &height, &channels, wanted);
+            channels = wanted;
+        }
+        if (!pixels || !qoiWrite(target.string(), pixels, width, height, channels)) {
+            printf("failed: %s\n", source.string().c_str());
+            failed++;
+        } else {
+            converted++;
+            sourceBytes += (size_t)fs::file_size(source, fileError);
+            qoiBytes += (size_t)fs::file_size(target, fileError);
+        }
+        stbi_image_free(pixels);
+    }, 1);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%d converted, %d up to date, %d failed in %.2f s on %u threads\n",
+           converted.load(), skipped.load(), failed.load(), seconds, ThreadPool::Shared().Size());
+    if (converted > 0) {
+        printf("%.1f KB of source images became %.1f KB of qoi\n", sourceBytes / 1024.0, qoiBytes / 1024.0);
+    }
+    return failed > 0 ? 1 : 0;
+}
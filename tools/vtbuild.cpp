@@ -0,0 +1,72 @@
+// cuts an image into the tiled mip file the virtual texture streams from.
+// the image is flipped like every other texture the program loads, so v = 0
+// is its bottom row.
+//
+// usage: vtbuild <image> [output.vtex] [--page <size>] [--border <texels>] [--linear]
+// the output defaults to the image path with a .vtex extension
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "images/stb_image.h"
+#include "texture/tiled_texture.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char **argv) {
+    std::vector<std::string> args;
+    int pageSize = 128;
+    int border = 1;
+    MipSettings settings;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--page") == 0 && i + 1 < argc) {
+            pageSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--border") == 0 && i + 1 < argc) {
+            border = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--linear") == 0) {
+            settings.srgb = false;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.empty()) {
+        printf("usage: vtbuild <image> [output.vtex] [--page <size>] [--border <texels>] [--linear]\n");
+        return 1;
+    }
+    fs::path source = args[0];
+    fs::path target = args.size() > 1 ? fs::path(args[1]) : fs::path(source).replace_extension(".vtex");
+
+    auto start = std::chrono::steady_clock::now();
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char *pixels = stbi_load(source.string().c_str(), &width, &height, &channels, 0);
+    if (!pixels) {
+        printf("failed to load %s\n", source.string().c_str());
+        return 1;
+    }
+    bool written = writeTiledTexture(target.string(), pixels, width, height, channels, pageSize, border, settings);
+    stbi_image_free(pixels);
+    if (!written) {
+        printf("failed to write %s\n", target.string().c_str());
+        return 1;
+    }
+
+    TiledTextureFile file;
+    if (!file.Open(target.string())) {
+        printf("failed to read back %s\n", target.string().c_str());
+        return 1;
+    }
+    const TiledTextureInfo &info = file.Info();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::error_code error;
+    printf("%dx%d -> %s: %d levels, %dx%d pages of %d+%d texels at level 0, %.1f KB in %.2f s\n",
+           width, height, target.string().c_str(), info.levels, info.pagesPerSide, info.pagesPerSide, info.pageSize,
+           2 * info.border, fs::file_size(target, error) / 1024.0, seconds);
+    return 0;
+}